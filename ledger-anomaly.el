@@ -0,0 +1,237 @@
+;;; ledger-anomaly.el --- Find months of abnormal spending
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; `ledger-anomaly' lists the months in which an account received
+;; abnormally more than usual.  The monthly totals of each account are
+;; summed in one pass over the postings of the index of
+;; ledger-index.el, rather than by a ledger query per account and
+;; month.  Each month of an account is then compared with the mean and
+;; standard deviation of the months preceding it, kept as running sums
+;; over a sliding window.  Each anomaly is listed with the postings
+;; making up its total; RET on one of them visits it.
+
+;;; Code:
+
+(require 'calendar)
+(require 'ledger-index)
+(require 'ledger-report) ; for ledger-report-visit-source
+(require 'ledger-tree) ; for ledger-tree-postings
+
+(defgroup ledger-anomaly nil
+  "Options for finding abnormal spending."
+  :group 'ledger)
+
+(defcustom ledger-anomaly-buffer-name "*Ledger Anomalies*"
+  "Name of the buffer listing abnormal months."
+  :type 'string
+  :group 'ledger-anomaly)
+
+(defcustom ledger-anomaly-account-regexp "^Expenses"
+  "Regexp matching the accounts checked for abnormal months."
+  :type 'regexp
+  :group 'ledger-anomaly)
+
+(defcustom ledger-anomaly-window 12
+  "Number of months a month is compared with."
+  :type 'integer
+  :group 'ledger-anomaly)
+
+(defcustom ledger-anomaly-min-months 3
+  "Number of preceding months needed to judge a month."
+  :type 'integer
+  :group 'ledger-anomaly)
+
+(defcustom ledger-anomaly-threshold 3.0
+  "Standard deviations above the mean making a month abnormal."
+  :type 'number
+  :group 'ledger-anomaly)
+
+(defvar-local ledger-anomaly-files nil
+  "Journal files checked for the anomalies shown in the buffer.")
+
+(defun ledger-anomaly-month (day)
+  "Return the month number of the day number DAY, counted from year 0."
+  (let ((date (calendar-gregorian-from-absolute day)))
+    (+ (* 12 (nth 2 date)) (1- (nth 0 date)))))
+
+(defun ledger-anomaly-totals (buffers)
+  "Return the monthly totals of the matching accounts of BUFFERS.
+The result is a hash table mapping each (ACCOUNT COMMODITY) to a
+hash table mapping month numbers to a pair (TOTAL . POSTINGS),
+POSTINGS being the (DAY PAYEE AMOUNT MARKER) of the postings
+making up TOTAL, AMOUNT as text.  The posting of a transaction
+left without an amount counts for the amount balancing the others."
+  (let ((totals (make-hash-table :test 'equal))
+        (case-fold-search nil))
+    (dolist (buffer buffers)
+      (maphash
+       (lambda (marker record)
+         (dolist (posting (ledger-tree-postings record))
+           (when (string-match-p ledger-anomaly-account-regexp (car posting))
+             (let* ((key (list (car posting) (nth 2 posting)))
+                    (months (or (gethash key totals)
+                                (puthash key (make-hash-table) totals)))
+                    (month (ledger-anomaly-month (aref record 0)))
+                    (cell (or (gethash month months)
+                              (puthash month (cons 0 nil) months))))
+               (setcar cell (+ (car cell) (nth 1 posting)))
+               (setcdr cell (cons (list (aref record 0) (aref record 1)
+                                        (ledger-format-amount (nth 1 posting)
+                                                              (nth 2 posting))
+                                        marker)
+                                  (cdr cell)))))))
+       (buffer-local-value 'ledger-index-xacts buffer)))
+    totals))
+
+(defun ledger-anomaly-series (months)
+  "Return the abnormal months of the hash table MONTHS of an account.
+MONTHS maps month numbers to (TOTAL . POSTINGS) as returned by
+`ledger-anomaly-totals'.  Months without postings count as zero.
+Each anomaly is a list (MONTH TOTAL MEAN DEVIATION POSTINGS)."
+  (let (first last)
+    (maphash (lambda (month _cell)
+               (setq first (if first (min first month) month)
+                     last (if last (max last month) month)))
+             months)
+    (let ((window (make-vector ledger-anomaly-window 0))
+          (sum 0.0)
+          (squares 0.0)
+          (size 0)
+          anomalies)
+      (dotimes (i (1+ (- last first)))
+        (let* ((month (+ first i))
+               (cell (gethash month months))
+               (total (if cell (car cell) 0)))
+          (when (>= size ledger-anomaly-min-months)
+            (let* ((mean (/ sum size))
+                   (variance (max 0.0 (- (/ squares size) (* mean mean))))
+                   ;; A steady series would flag any change at all.
+                   (deviation (max (sqrt variance) (* 0.05 (abs mean)))))
+              (when (and (> deviation 0)
+                         (> (- total mean) (* ledger-anomaly-threshold deviation)))
+                (push (list month total mean deviation
+                            (sort (copy-sequence (cdr cell))
+                                  (lambda (a b) (< (car a) (car b)))))
+                      anomalies))))
+          ;; Slide the window: drop the oldest month once it is full.
+          (let ((slot (% i ledger-anomaly-window)))
+            (if (< size ledger-anomaly-window)
+                (setq size (1+ size))
+              (setq sum (- sum (aref window slot))
+                    squares (- squares (* (aref window slot) (aref window slot)))))
+            (aset window slot total)
+            (setq sum (+ sum total)
+                  squares (+ squares (* total total))))))
+      (nreverse anomalies))))
+
+(defun ledger-anomaly-journal (buffers)
+  "Return the anomalies of BUFFERS, most recent first.
+Each anomaly is a list (ACCOUNT COMMODITY MONTH TOTAL MEAN
+DEVIATION POSTINGS)."
+  (let (anomalies)
+    (maphash (lambda (key months)
+               (dolist (anomaly (ledger-anomaly-series months))
+                 (push (append key anomaly) anomalies)))
+             (ledger-anomaly-totals buffers))
+    (sort anomalies
+          (lambda (a b)
+            (or (> (nth 2 a) (nth 2 b))
+                (and (= (nth 2 a) (nth 2 b))
+                     (string< (car a) (car b))))))))
+
+(defvar ledger-anomaly-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [return] 'ledger-report-visit-source)
+    (define-key map [?g] 'ledger-anomaly-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-anomaly-mode'.")
+
+(define-derived-mode ledger-anomaly-mode text-mode "Ledger-Anomaly"
+  "A mode for listing months of abnormal spending.")
+
+(defun ledger-anomaly-insert (anomaly)
+  "Insert ANOMALY and the postings making up its total."
+  (let ((month (nth 2 anomaly))
+        (commodity (nth 1 anomaly)))
+    (insert (format "%04d/%02d  %s  %s, mean %s, deviation %s\n"
+                    (/ month 12) (1+ (% month 12))
+                    (nth 0 anomaly)
+                    (ledger-format-amount (nth 3 anomaly) commodity)
+                    (ledger-format-amount (nth 4 anomaly) commodity)
+                    (ledger-format-amount (nth 5 anomaly) commodity)))
+    (dolist (posting (nth 6 anomaly))
+      (let ((beg (point))
+            (marker (nth 3 posting)))
+        (insert (format "    %s  %s  %s\n"
+                        (ledger-format-date (ledger-index-day-date (nth 0 posting)))
+                        (or (nth 1 posting) "")
+                        (nth 2 posting)))
+        (set-text-properties beg (1- (point))
+                             (list 'ledger-source
+                                   (cons (buffer-file-name (marker-buffer marker))
+                                         marker)
+                                   'font-lock-face
+                                   'ledger-font-report-clickable-face))))
+    (insert "\n")))
+
+(defun ledger-anomaly-display (files)
+  "List the anomalies of FILES in the anomaly buffer."
+  (let* ((start (float-time))
+         (anomalies (ledger-anomaly-journal (ledger-index-buffers files)))
+         (elapsed (- (float-time) start)))
+    (with-current-buffer (get-buffer-create ledger-anomaly-buffer-name)
+      (let ((inhibit-read-only t))
+        (erase-buffer)
+        (ledger-anomaly-mode)
+        (setq ledger-anomaly-files files)
+        (insert (format "Accounts matching %s, %s deviations above the mean of %d months\n\n"
+                        ledger-anomaly-account-regexp
+                        ledger-anomaly-threshold
+                        ledger-anomaly-window))
+        (mapc #'ledger-anomaly-insert anomalies)
+        (goto-char (point-min))
+        (set-buffer-modified-p nil)
+        (setq buffer-read-only t))
+      (display-buffer (current-buffer)))
+    (message "%d anomalies found in %.2f s" (length anomalies) elapsed)))
+
+(defun ledger-anomaly ()
+  "List the months in which an account received abnormally more than usual.
+
+Accounts matching `ledger-anomaly-account-regexp' are checked.
+The total of each month is compared with the mean of the
+`ledger-anomaly-window' months before it, and listed when it
+exceeds it by more than `ledger-anomaly-threshold' standard
+deviations.  The postings making up the total are listed below
+it; RET visits the posting at point."
+  (interactive)
+  (ledger-anomaly-display (ledger-journal-files)))
+
+(defun ledger-anomaly-redo ()
+  "Look for anomalies again in the files of the anomaly buffer."
+  (interactive)
+  (ledger-anomaly-display ledger-anomaly-files))
+
+(provide 'ledger-anomaly)
+
+;;; ledger-anomaly.el ends here
@@ -0,0 +1,210 @@
+;;; ledger-closed.el --- Checksums of closed periods of the journal
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Years that are reconciled and closed no longer change, yet building
+;; the index of ledger-index.el parses them again in every session.
+;; `ledger-closed-record' closes the period before a date: for each
+;; file of the journal, the text up to its first transaction on or
+;; after that date is checksummed, and saved in `ledger-closed-file'
+;; along with the index records of the transactions it holds.
+;;
+;; When the index of a file is built again, the checksum of its closed
+;; text is verified, which is much cheaper than parsing it, and the
+;; saved records are used for the closed transactions.  If the closed
+;; text changed, on disk or by an edit, a warning is shown and the
+;; file is indexed from scratch.
+
+;;; Code:
+
+(require 'ledger-index)
+
+(declare-function ledger-read-date "ledger-mode" (prompt))
+
+(defgroup ledger-closed nil
+  "Options for closed periods of the journal."
+  :group 'ledger)
+
+(defcustom ledger-closed-file (locate-user-emacs-file "ledger-closed.eld")
+  "File keeping the checksums, elements and index records of closed periods."
+  :type 'file
+  :group 'ledger-closed)
+
+(defvar ledger-closed-periods 'unloaded
+  "List of the closed periods read from `ledger-closed-file'.
+Each period is a list (FILE BEFORE END HASH ENTRIES ELEMENTS): the
+text of FILE up to the position END, holding its transactions dated
+before BEFORE, has the checksum HASH, ENTRIES are the (POSITION .
+RECORD) of its transactions, see ledger-index.el, and ELEMENTS the
+\(POSITION KIND HASH) of its elements, see ledger-track.el.
+Periods saved without ELEMENTS have their text scanned.")
+
+(defvar-local ledger-closed-end nil
+  "Marker at the end of the closed text of the buffer, or nil.")
+
+(defvar-local ledger-closed-warned nil
+  "Non-nil once a change to the closed text of the buffer was reported.")
+
+(defun ledger-closed-load ()
+  "Return the closed periods, reading them from `ledger-closed-file' once."
+  (when (eq ledger-closed-periods 'unloaded)
+    (setq ledger-closed-periods
+          (when (file-readable-p ledger-closed-file)
+            (with-temp-buffer
+              (insert-file-contents ledger-closed-file)
+              (read (current-buffer))))))
+  ledger-closed-periods)
+
+(defun ledger-closed-save ()
+  "Write the closed periods to `ledger-closed-file'."
+  (let ((print-length nil)
+        (print-level nil))
+    (with-temp-file ledger-closed-file
+      (insert ";; Closed periods of ledger files, see ledger-closed.el\n")
+      (prin1 ledger-closed-periods (current-buffer))
+      (insert "\n"))))
+
+(defun ledger-closed-hash (end)
+  "Return the checksum of the text of the buffer up to END."
+  (secure-hash 'sha1 (current-buffer) (point-min) end))
+
+(defun ledger-closed-warn ()
+  "Warn that the closed text of the current buffer was modified."
+  (setq ledger-closed-warned t)
+  (display-warning
+   'ledger
+   (format (concat "The closed period of %s has been modified; use "
+                   "`ledger-closed-record' to close it again if this was intended")
+           buffer-file-name)
+   :error))
+
+(defun ledger-closed-after-change (beg _end _length)
+  "Warn once if the change at BEG touches the closed text."
+  (when (and ledger-closed-end
+             (not ledger-closed-warned)
+             (< beg ledger-closed-end))
+    (ledger-closed-warn)))
+
+(defun ledger-closed-watch (end)
+  "Watch for changes to the current buffer before END."
+  (setq ledger-closed-end (copy-marker end)
+        ledger-closed-warned nil)
+  (add-hook 'after-change-functions #'ledger-closed-after-change nil t))
+
+(defun ledger-closed-period ()
+  "Return the closed period of the file of the current buffer, or nil."
+  (and buffer-file-name
+       (assoc (file-truename buffer-file-name) (ledger-closed-load))))
+
+(defun ledger-closed-verified ()
+  "Return the closed period of the current buffer if its text is unchanged.
+The checksum is computed once, after which the closed text is
+watched for changes.  Return nil if no period was closed, or warn
+and return nil if its text does not match its checksum."
+  (let ((period (ledger-closed-period)))
+    (when period
+      (let ((end (nth 2 period)))
+        (cond ((and ledger-closed-end
+                    (not ledger-closed-warned)
+                    (= ledger-closed-end end))
+               period)
+              ((and (<= end (point-max))
+                    (string= (ledger-closed-hash end) (nth 3 period)))
+               (ledger-closed-watch end)
+               period)
+              (t
+               (ledger-closed-warn)
+               nil))))))
+
+(defun ledger-closed-records ()
+  "Return the saved index records of the closed text of the current buffer.
+The result maps positions to records, for `ledger-index-restore-functions',
+or is nil, see `ledger-closed-verified'."
+  (let ((period (ledger-closed-verified)))
+    (when period
+      (let ((records (make-hash-table)))
+        (dolist (entry (nth 4 period))
+          (puthash (car entry) (cdr entry) records))
+        records))))
+
+(add-hook 'ledger-index-restore-functions #'ledger-closed-records)
+
+(defun ledger-closed-elements ()
+  "Return the saved elements of the closed text of the current buffer.
+The result is a pair (END . ELEMENTS) for
+`ledger-track-restore-functions', or nil, see `ledger-closed-verified'."
+  (let ((period (ledger-closed-verified)))
+    (when (and period (nth 5 period))
+      (cons (nth 2 period) (nth 5 period)))))
+
+(add-hook 'ledger-track-restore-functions #'ledger-closed-elements)
+
+(defun ledger-closed-close (before)
+  "Close the period of the current buffer before the date BEFORE.
+Return the period, or nil if the buffer has no transaction before BEFORE."
+  (save-restriction
+    (widen)
+    (let ((day (time-to-days (ledger-parse-iso-date before)))
+          (end (point-max))
+          closed)
+      ;; Entries come sorted by position: the closed text ends at the
+      ;; first transaction of the open period.
+      (catch 'open
+        (dolist (entry (ledger-index-snapshot))
+          (when (>= (aref (cdr entry) 0) day)
+            (setq end (car entry))
+            (throw 'open nil))
+          (push entry closed)))
+      (when closed
+        (ledger-closed-watch end)
+        (let (elements)
+          (dolist (element (ledger-track-snapshot))
+            (when (< (car element) end)
+              (push element elements)))
+          (list (file-truename buffer-file-name) before end
+                (ledger-closed-hash end) (nreverse closed) (nreverse elements)))))))
+
+(defun ledger-closed-record (before &optional files)
+  "Close the period of the journal before the date BEFORE.
+
+The text of each file of the journal up to its first transaction
+dated on or after BEFORE is checksummed and its index saved in
+`ledger-closed-file'.  Later sessions reuse the saved index instead
+of parsing that text again, as long as it is unchanged.  FILES
+default to the files of the journal of the current buffer."
+  (interactive (list (ledger-read-date "Close the period before: ")))
+  (unless (ledger-parse-iso-date before)
+    (error "Invalid date %s" before))
+  (let ((count 0))
+    (dolist (buffer (ledger-index-buffers files))
+      (with-current-buffer buffer
+        (let ((period (ledger-closed-close before))
+              (old (ledger-closed-period)))
+          (setq ledger-closed-periods (delq old ledger-closed-periods))
+          (when period
+            (push period ledger-closed-periods)
+            (setq count (1+ count))))))
+    (ledger-closed-save)
+    (message "%d files closed before %s" count before)))
+
+(provide 'ledger-closed)
+
+;;; ledger-closed.el ends here
@@ -85,6 +85,43 @@ Returns a list with (value commodity)."
            ;; nothing found, return 0
            (t (list 0 ledger-reconcile-default-commodity)))))))
 
+(defun ledger-parse-amount (str)
+  "Return the amount at the start of STR as a list (VALUE COMMODITY).
+Return nil if STR does not start with an amount, as for an
+expression.  A price or annotation following the amount is
+ignored.  Unlike `ledger-split-commodity-string' no buffer is
+used, so this is cheap enough to call on every posting."
+  (when (and str (string-match ledger-amount-parse-regex str))
+    (let ((value (ledger-string-to-number (match-string 4 str)))
+          (commodity (or (match-string 2 str) (match-string 5 str))))
+      (list (if (or (match-beginning 1) (match-beginning 3)) (- value) value)
+            (if (and commodity (eq (aref commodity 0) ?\"))
+                (substring commodity 1 -1)
+              commodity)))))
+
+(defun ledger-parse-unit-price (str open close value)
+  "Return the unit price between OPEN and CLOSE in STR, or nil.
+A doubled OPEN gives the price of VALUE units rather than of one.
+CLOSE is nil for a price running to the end of STR."
+  (let* ((rest (if close (concat "[^" close "]*") ".*"))
+         (double (concat (regexp-quote (concat open open)) "[ \t=]*\\(" rest "\\)"))
+         (single (concat (regexp-quote open) "[ \t=]*\\(" rest "\\)")))
+    (cond ((string-match double str)
+           (let ((total (ledger-parse-amount (match-string 1 str))))
+             (when (and total (not (zerop value)))
+               (list (/ (abs (car total)) (abs (float value))) (nth 1 total)))))
+          ((string-match single str)
+           (ledger-parse-amount (match-string 1 str))))))
+
+(defun ledger-parse-amount-prices (str value)
+  "Return the prices annotating the amount STR of VALUE units.
+The result is a pair (LOT . PRICE): LOT is the lot price given
+in braces and PRICE the price given by @, each as the (VALUE
+COMMODITY) of one unit, or nil when not given.  Total prices,
+{{...}} and @@, are divided by VALUE."
+  (cons (ledger-parse-unit-price str "{" "}" value)
+        (ledger-parse-unit-price str "@" nil value)))
+
 (defun ledger-string-balance-to-commoditized-amount (str)
   "Return a commoditized amount (val, 'comm') from STR."
                                         ; break any balances with multi commodities into a list
@@ -137,6 +174,43 @@ longer ones are after the value."
         (concat str " " commodity)
       (concat commodity " " str))))
 
+(defconst ledger-amount-max-decimals 8
+  "Most decimals shown by `ledger-format-amount'.")
+
+(defun ledger-amount-zerop (value &optional decimals)
+  "Return non-nil if VALUE rounds to zero with DECIMALS decimals.
+DECIMALS defaults to `ledger-amount-max-decimals', so that the
+residues of float additions count as zero."
+  (< (abs value) (* 0.5 (expt 10.0 (- (or decimals ledger-amount-max-decimals))))))
+
+(defun ledger-amount-decimals (value)
+  "Return the number of decimals needed to show VALUE, at least two.
+Amounts summed as floats carry residues in their last digits, so
+VALUE is given the fewest decimals showing it up to a relative
+error of 1e-9, at most `ledger-amount-max-decimals'."
+  (let ((decimals 2)
+        (tolerance (* 1e-9 (max 1.0 (abs value)))))
+    (while (and (< decimals ledger-amount-max-decimals)
+                (let ((scale (expt 10.0 decimals)))
+                  (> (abs (- value (/ (fround (* value scale)) scale))) tolerance)))
+      (setq decimals (1+ decimals)))
+    decimals))
+
+(defun ledger-format-amount (value commodity)
+  "Return VALUE in COMMODITY as a string.
+VALUE has two decimals, or as many as `ledger-amount-decimals'
+finds, and a decimal comma when the journal uses one.  COMMODITY
+goes where `ledger-commodity-to-string' puts it."
+  (let* ((decimals (ledger-amount-decimals value))
+         (str (format (format "%%.%df" decimals)
+                      ;; No "-0.00" for a total that is zero but for residues.
+                      (if (ledger-amount-zerop value decimals) 0.0 value))))
+    (when (assoc "decimal-comma" ledger-environment-alist)
+      (setq str (subst-char-in-string ?. ?, str)))
+    (cond ((null commodity) str)
+          ((> (length commodity) 1) (concat str " " commodity))
+          (t (concat commodity str)))))
+
 (defun ledger-read-commodity-string (prompt)
   "Read an amount from mini-buffer using PROMPT."
   (let ((str (read-from-minibuffer
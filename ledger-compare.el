@@ -0,0 +1,304 @@
+;;; ledger-compare.el --- Compare balances between git revisions of the journal
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Before committing a cleanup of the journal, one wants to be sure
+;; the balances did not change.  `ledger-compare-revisions' copies the
+;; files of the journal, as of two git revisions, into temporary
+;; directories, following the include directives of each revision.
+;; Ledger then runs on both copies at the same time, in the
+;; background, and the account totals read from its XML output, see
+;; ledger-query.el, are compared.  Only the accounts whose total
+;; changed are listed.
+
+;;; Code:
+
+(require 'ledger-commodities)
+(require 'ledger-exec)
+(require 'ledger-query)
+(require 'ledger-report) ; for ledger-master-file
+
+(defgroup ledger-compare nil
+  "Options for comparing balances between revisions of the journal."
+  :group 'ledger)
+
+(defcustom ledger-compare-buffer-name "*Ledger Compare*"
+  "Name of the buffer listing the accounts whose balance changed."
+  :type 'string
+  :group 'ledger-compare)
+
+(defvar-local ledger-compare-args nil
+  "Arguments of `ledger-compare-revisions' for the comparison in the buffer.")
+
+(defun ledger-compare-git (top &rest args)
+  "Run git with ARGS in the directory TOP and return its output."
+  (let ((default-directory (file-name-as-directory top))
+        (coding-system-for-read 'utf-8))
+    (with-temp-buffer
+      (unless (eq (apply #'call-process "git" nil (list t nil) nil args) 0)
+        (error "Command failed: git %s" (mapconcat #'identity args " ")))
+      (buffer-string))))
+
+(defun ledger-compare-expand (top rev tree name)
+  "Return the files of REV named by the include NAME, relative to TOP.
+NAME is an absolute file name and may use wildcards.  TREE is the
+list of the files of REV relative to TOP, and REV nil stands for
+the working tree."
+  (if (null rev)
+      (mapcar (lambda (file) (file-relative-name file top))
+              (or (file-expand-wildcards name t) (list name)))
+    (let ((regexp (wildcard-to-regexp (file-relative-name name top)))
+          files)
+      (dolist (file tree)
+        (when (string-match-p regexp file)
+          (push file files)))
+      (nreverse files))))
+
+(defun ledger-compare-materialize (top rev master dir)
+  "Copy the files of the journal rooted at MASTER, as of REV, under DIR.
+TOP is the top directory of the git repository and MASTER a file
+name relative to it.  REV nil stands for the files saved in the
+working tree.  Include directives are followed as in
+`ledger-journal-files'; absolute ones are rewritten to name the
+copies, and an include outside of TOP is an error.  Return the
+names of the files copied, relative to TOP."
+  (let ((top (file-name-as-directory (expand-file-name top)))
+        (tree (when rev
+                (split-string (ledger-compare-git top "ls-tree" "-r" "--name-only"
+                                                  "--full-tree" rev)
+                              "\n" t)))
+        (pending (list master))
+        files)
+    (while pending
+      (let ((current (pop pending)))
+        (unless (or (member current files)
+                    (if rev
+                        (not (member current tree))
+                      (not (file-readable-p (expand-file-name current top)))))
+          (push current files)
+          (let ((target (expand-file-name current dir))
+                (source-dir (file-name-directory (expand-file-name current top)))
+                includes)
+            (with-temp-buffer
+              (if rev
+                  (insert (ledger-compare-git top "show" (concat rev ":" current)))
+                (insert-file-contents (expand-file-name current top)))
+              (goto-char (point-min))
+              (while (re-search-forward ledger-include-directive-regex nil t)
+                (let* ((name (match-string-no-properties 1))
+                       (absolute (expand-file-name name source-dir)))
+                  (unless (string-prefix-p top absolute)
+                    (setq absolute (file-truename absolute)))
+                  (unless (string-prefix-p top absolute)
+                    (error "%s includes %s, which is outside of %s" current name top))
+                  ;; An absolute include would still read the working tree.
+                  (when (file-name-absolute-p name)
+                    (replace-match (expand-file-name (file-relative-name absolute top) dir)
+                                   t t nil 1))
+                  (setq includes
+                        (append includes
+                                (ledger-compare-expand top rev tree absolute)))))
+              (make-directory (file-name-directory target) t)
+              (let ((coding-system-for-write 'utf-8))
+                (write-region nil nil target nil 'silent)))
+            (setq pending (append includes pending))))))
+    (nreverse files)))
+
+(defun ledger-compare-covers-p (a b)
+  "Return non-nil if every amount of the balance A is the same in B."
+  (let ((result t))
+    (dolist (amount a)
+      (let ((other (ledger-query-balance-amount b (nth 1 amount))))
+        (unless (= (car amount) (if other (car other) 0))
+          (setq result nil))))
+    result))
+
+(defun ledger-compare-balances (old new)
+  "Return the accounts whose total differs between OLD and NEW.
+OLD and NEW are lists of accounts as returned by
+`ledger-query-accounts'.  The result is a list of (ACCOUNT
+OLD-TOTAL NEW-TOTAL) sorted by account, a total being nil for an
+account missing on its side."
+  (let ((totals (make-hash-table :test 'equal))
+        changes)
+    (dolist (account old)
+      (puthash (plist-get account :account)
+               (list (plist-get account :total) nil)
+               totals))
+    (dolist (account new)
+      (let* ((name (plist-get account :account))
+             (entry (or (gethash name totals)
+                        (puthash name (list nil nil) totals))))
+        (setcar (cdr entry) (plist-get account :total))))
+    (maphash (lambda (name entry)
+               (unless (and (ledger-compare-covers-p (car entry) (nth 1 entry))
+                            (ledger-compare-covers-p (nth 1 entry) (car entry)))
+                 (push (cons name entry) changes)))
+             totals)
+    (sort changes (lambda (a b) (string< (car a) (car b))))))
+
+(defvar ledger-compare-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [?g] 'ledger-compare-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-compare-mode'.")
+
+(define-derived-mode ledger-compare-mode text-mode "Ledger-Compare"
+  "A mode for listing the accounts whose balance changed between revisions.")
+
+(defun ledger-compare-label (rev)
+  "Return the name of REV shown to the user."
+  (or rev "working tree"))
+
+(defun ledger-compare-balance-string (balance)
+  "Return BALANCE as a string."
+  (if balance
+      (mapconcat (lambda (amount) (ledger-format-amount (car amount) (nth 1 amount)))
+                 balance ", ")
+    "-"))
+
+(defun ledger-compare-display (args changes)
+  "List CHANGES, as returned by `ledger-compare-balances', for ARGS.
+ARGS are the arguments of `ledger-compare-revisions'."
+  (with-current-buffer (get-buffer-create ledger-compare-buffer-name)
+    (let ((inhibit-read-only t))
+      (erase-buffer)
+      (ledger-compare-mode)
+      (setq ledger-compare-args args)
+      (insert (format "Balances from %s to %s: %d accounts changed\n\n"
+                      (ledger-compare-label (car args))
+                      (ledger-compare-label (nth 1 args))
+                      (length changes)))
+      (dolist (change changes)
+        (insert (format "%-40s %20s -> %s\n"
+                        (car change)
+                        (ledger-compare-balance-string (nth 1 change))
+                        (ledger-compare-balance-string (nth 2 change)))))
+      (goto-char (point-min))
+      (set-buffer-modified-p nil)
+      (setq buffer-read-only t))
+    (display-buffer (current-buffer))))
+
+(defun ledger-compare-finish (state)
+  "Show the comparison of STATE once ledger finished on both revisions.
+STATE is a vector [RESULTS DIRS ARGS]: RESULTS holds the accounts
+of each revision, or `failed', DIRS the temporary directories to
+delete and ARGS the arguments of `ledger-compare-revisions'."
+  (let ((results (aref state 0))
+        (args (aref state 2)))
+    (when (and (aref results 0) (aref results 1))
+      (dolist (dir (aref state 1))
+        (delete-directory dir t))
+      (cond ((eq (aref results 0) 'failed)
+             (message "Ledger failed on %s" (ledger-compare-label (car args))))
+            ((eq (aref results 1) 'failed)
+             (message "Ledger failed on %s" (ledger-compare-label (nth 1 args))))
+            (t
+             (ledger-compare-display args
+                                     (ledger-compare-balances (aref results 0)
+                                                              (aref results 1))))))))
+
+(defun ledger-compare-receive (state index output)
+  "Store the accounts of the XML in the buffer OUTPUT in slot INDEX of STATE."
+  (aset (aref state 0) index
+        (with-current-buffer output
+          (ledger-query-root-accounts (ledger-query-parse-buffer))))
+  (ledger-compare-finish state))
+
+(defun ledger-compare-sentinel (sentinel state index process event)
+  "Call SENTINEL with PROCESS and EVENT, and note in STATE if ledger failed.
+INDEX is the slot of the revision of PROCESS in STATE."
+  (funcall sentinel process event)
+  (when (and (memq (process-status process) '(exit signal))
+             (null (aref (aref state 0) index)))
+    (aset (aref state 0) index 'failed)
+    (ledger-compare-finish state)))
+
+(defun ledger-compare-start (state index file)
+  "Start ledger on the copy FILE of the master file, for slot INDEX of STATE."
+  (with-temp-buffer
+    ;; Ledger reading the journal from its input resolves the
+    ;; includes from its working directory.
+    (setq default-directory (file-name-directory file))
+    (insert-file-contents file)
+    (let ((process (ledger-exec-ledger-async
+                    (current-buffer)
+                    (apply-partially #'ledger-compare-receive state index)
+                    "xml")))
+      (set-process-sentinel process
+                            (apply-partially #'ledger-compare-sentinel
+                                             (process-sentinel process)
+                                             state index)))))
+
+(defun ledger-compare-revisions (old new &optional master)
+  "List the accounts whose balance differs between the git revisions OLD and NEW.
+
+The files of the journal of the current buffer, as of each
+revision, are copied to temporary directories, and ledger runs on
+both copies at the same time.  Accounts whose total changed are
+listed with their total in both revisions.  A revision nil, or
+entered empty, stands for the files saved in the working tree.
+MASTER is the master file of the journal, it defaults to that of
+the current buffer."
+  (interactive
+   (list (read-string "Old revision (default HEAD): " nil nil "HEAD")
+         (read-string "New revision (default working tree): ")))
+  (let* ((old (unless (equal old "") old))
+         (new (unless (equal new "") new))
+         (master (or master (ledger-master-file)))
+         (top (progn
+                (unless master
+                  (error "The journal has no file"))
+                (file-name-as-directory
+                 (car (split-string (ledger-compare-git (file-name-directory master)
+                                                        "rev-parse" "--show-toplevel")
+                                    "\n" t)))))
+         (relative (file-relative-name master top))
+         (state (vector (make-vector 2 nil) nil (list old new master)))
+         copies)
+    (condition-case err
+        (dolist (rev (list old new))
+          (let ((dir (make-temp-file "ledger-compare-" t)))
+            (aset state 1 (cons dir (aref state 1)))
+            (unless (ledger-compare-materialize top rev relative dir)
+              (error "%s is not in %s" relative (ledger-compare-label rev)))
+            (push (expand-file-name relative dir) copies)))
+      (error
+       (dolist (dir (aref state 1))
+         (delete-directory dir t))
+       (signal (car err) (cdr err))))
+    (setq copies (nreverse copies))
+    (ledger-compare-start state 0 (car copies))
+    (ledger-compare-start state 1 (nth 1 copies))
+    (message "Comparing the balances of %s and %s..."
+             (ledger-compare-label old) (ledger-compare-label new))))
+
+(defun ledger-compare-redo ()
+  "Compare the revisions of the compare buffer again."
+  (interactive)
+  (ledger-compare-revisions (or (car ledger-compare-args) "")
+                            (or (nth 1 ledger-compare-args) "")
+                            (nth 2 ledger-compare-args)))
+
+(provide 'ledger-compare)
+
+;;; ledger-compare.el ends here
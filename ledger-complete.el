@@ -30,6 +30,9 @@
 (require 'ledger-context)
 (require 'ledger-xact)
 (require 'ledger-schedule)
+(require 'ledger-exec)
+(require 'ledger-index)
+(require 'ledger-report) ; for ledger-master-file
 
 (defun ledger-parse-arguments ()
   "Parse whitespace separated arguments in the current region."
@@ -57,20 +60,240 @@
       (cons (reverse args) (reverse begins)))))
 
 
+(defvar ledger-complete-payee-functions nil
+  "Abnormal hook of functions returning payees to offer for completion.
+Each function is called without arguments and returns a list of
+payees known from outside the current buffer.")
+
+(defvar ledger-complete-account-functions nil
+  "Abnormal hook of functions returning accounts to offer for completion.
+Each function is called without arguments and returns a list of
+account names known from outside the current buffer.")
+
+(defun ledger-complete-extra-candidates (hook)
+  "Return the candidates returned by the functions of HOOK."
+  (let (candidates)
+    (run-hook-wrapped hook
+                      (lambda (function)
+                        (setq candidates (append (funcall function) candidates))
+                        nil))
+    candidates))
+
+;; Payee candidates come ranked by how often and how recently each
+;; payee was used.  The uses of each payee are counted per day from
+;; the index of ledger-index.el, and kept up to date as it changes.
+;; The ranking is kept sorted: when payees change, only their scores
+;; are computed again and merged back into it.
+
+(defcustom ledger-complete-payee-half-life 90
+  "Number of days after which a transaction weighs half as much in payee ranking."
+  :type 'integer
+  :group 'ledger)
+
+(defvar-local ledger-complete-payees nil
+  "Hash table mapping each payee of the buffer to its uses.
+The uses are a hash table mapping day numbers to the number of
+transactions of the payee on that day.  This is nil until payees
+are first completed in the buffer.")
+
+(defvar-local ledger-complete-payee-ranking nil
+  "List of (SCORE . PAYEE) of the payees of the buffer, highest score first.")
+
+(defvar-local ledger-complete-payee-dirty nil
+  "Hash table of the payees whose uses changed since they were ranked.")
+
+(defun ledger-complete-count-payee (payee day delta)
+  "Add DELTA to the uses of PAYEE on the day number DAY."
+  (let* ((days (or (gethash payee ledger-complete-payees)
+                   (puthash payee (make-hash-table) ledger-complete-payees)))
+         (count (+ (gethash day days 0) delta)))
+    (if (> count 0)
+        (puthash day count days)
+      (remhash day days))
+    (when (zerop (hash-table-count days))
+      (remhash payee ledger-complete-payees))
+    (puthash payee t ledger-complete-payee-dirty)))
+
+(defun ledger-complete-index-changed (_marker old new)
+  "Update the payee and account uses of the buffer for the index record OLD becoming NEW."
+  (when (and ledger-complete-payees
+             (not (and old new
+                       (equal (aref old 1) (aref new 1))
+                       (= (aref old 0) (aref new 0)))))
+    (when (and old (aref old 1))
+      (ledger-complete-count-payee (aref old 1) (aref old 0) -1))
+    (when (and new (aref new 1))
+      (ledger-complete-count-payee (aref new 1) (aref new 0) 1)))
+  (when (and ledger-complete-account-uses
+             (not (and old new
+                       (= (aref old 0) (aref new 0))
+                       (equal (mapcar #'car (aref old 2))
+                              (mapcar #'car (aref new 2))))))
+    (when old
+      (ledger-complete-count-postings old -1))
+    (when new
+      (ledger-complete-count-postings new 1))))
+
+(add-hook 'ledger-index-functions #'ledger-complete-index-changed)
+
+(defun ledger-complete-payee-uses ()
+  "Bring the payee uses of the buffer up to date and return them."
+  (unless ledger-index-xacts
+    (setq ledger-complete-payees nil))
+  (let ((xacts (ledger-index-update)))
+    (unless ledger-complete-payees
+      (setq ledger-complete-payees (make-hash-table :test 'equal)
+            ledger-complete-payee-dirty (make-hash-table :test 'equal)
+            ledger-complete-payee-ranking nil)
+      (maphash (lambda (_marker record)
+                 (when (aref record 1)
+                   (ledger-complete-count-payee (aref record 1) (aref record 0) 1)))
+               xacts))
+    ledger-complete-payees))
+
+(defun ledger-complete-payee-score (days)
+  "Return the score of a payee whose uses per day are DAYS.
+This is the base 2 logarithm of the sum of 2^(DAY/H) over its
+transactions, H being `ledger-complete-payee-half-life'.  As it
+does not depend on the current date, a score only changes with
+the uses of its payee."
+  (let ((half-life (float ledger-complete-payee-half-life))
+        (latest 0)
+        (sum 0.0))
+    (maphash (lambda (day _count)
+               (setq latest (max latest day)))
+             days)
+    (maphash (lambda (day count)
+               (setq sum (+ sum (* count (expt 2.0 (/ (- day latest) half-life))))))
+             days)
+    (+ (/ latest half-life) (log sum 2))))
+
+(defun ledger-complete-rank-before-p (a b)
+  "Return non-nil if the ranking entry A comes before B."
+  (or (> (car a) (car b))
+      (and (= (car a) (car b))
+           (string< (cdr a) (cdr b)))))
+
+(defun ledger-complete-merge-ranking (a b)
+  "Merge the sorted ranking entries A and B."
+  (let (merged)
+    (while (and a b)
+      (if (ledger-complete-rank-before-p (car a) (car b))
+          (setq merged (cons (car a) merged)
+                a (cdr a))
+        (setq merged (cons (car b) merged)
+              b (cdr b))))
+    (nconc (nreverse merged) a b)))
+
+(defun ledger-complete-ranked-payees ()
+  "Return the payees of the buffer, most often and recently used first."
+  (let ((payees (ledger-complete-payee-uses))
+        (dirty ledger-complete-payee-dirty))
+    (when (> (hash-table-count dirty) 0)
+      (let (changed kept)
+        (maphash (lambda (payee _)
+                   (let ((days (gethash payee payees)))
+                     (when days
+                       (push (cons (ledger-complete-payee-score days) payee) changed))))
+                 dirty)
+        (dolist (entry ledger-complete-payee-ranking)
+          (unless (gethash (cdr entry) dirty)
+            (push entry kept)))
+        (setq ledger-complete-payee-ranking
+              (ledger-complete-merge-ranking
+               (sort changed #'ledger-complete-rank-before-p)
+               (nreverse kept)))
+        (clrhash dirty)))
+    (mapcar #'cdr ledger-complete-payee-ranking)))
+
+(defun ledger-complete-table-alist (table)
+  "Return the entries of the hash table TABLE as an alist sorted by key.
+The keys are strings or numbers, and values that are hash tables
+are converted too."
+  (let (alist)
+    (maphash (lambda (key value)
+               (push (cons key (if (hash-table-p value)
+                                   (ledger-complete-table-alist value)
+                                 value))
+                     alist))
+             table)
+    (sort alist (lambda (a b)
+                  (if (stringp (car a))
+                      (string< (car a) (car b))
+                    (< (car a) (car b)))))))
+
+(defun ledger-complete-rebuild-payees ()
+  "Return the payee uses of the buffer computed from scratch."
+  (let ((ledger-complete-payees (make-hash-table :test 'equal))
+        (ledger-complete-payee-dirty (make-hash-table :test 'equal)))
+    (dolist (entry (ledger-index-rescan))
+      (let ((record (cdr entry)))
+        (when (aref record 1)
+          (ledger-complete-count-payee (aref record 1) (aref record 0) 1))))
+    ledger-complete-payees))
+
+(defun ledger-complete-payees-snapshot ()
+  "Return the payee uses of the buffer as a sorted alist."
+  (if (null ledger-complete-payees)
+      :inactive
+    (ledger-complete-table-alist (ledger-complete-payee-uses))))
+
+(defun ledger-complete-payees-rescan ()
+  "Return the payee uses of the buffer computed from scratch, as for the snapshot."
+  (ledger-complete-table-alist (ledger-complete-rebuild-payees)))
+
+(ledger-verify-register 'ledger-complete-payees
+                        'ledger-complete-payees-snapshot
+                        'ledger-complete-payees-rescan)
+
+(defun ledger-complete-ranking-snapshot ()
+  "Return the ranked payees of the buffer."
+  (if (null ledger-complete-payees)
+      :inactive
+    (ledger-complete-ranked-payees)))
+
+(defun ledger-complete-ranking-rescan ()
+  "Return the ranked payees of the buffer computed from scratch."
+  (let (ranking)
+    (maphash (lambda (payee days)
+               (push (cons (ledger-complete-payee-score days) payee) ranking))
+             (ledger-complete-rebuild-payees))
+    (mapcar #'cdr (sort ranking #'ledger-complete-rank-before-p))))
+
+(ledger-verify-register 'ledger-complete-payee-ranking
+                        'ledger-complete-ranking-snapshot
+                        'ledger-complete-ranking-rescan)
+
+(defun ledger-complete-xact-at-point ()
+  "Return the index record of the xact whose header is at point, or nil."
+  (let ((record (ledger-track-record-at (point))))
+    (when (and record
+               (eq (aref record 1) 'xact)
+               (= (aref record 0) (line-beginning-position)))
+      (gethash (aref record 0) ledger-index-xacts))))
+
 (defun ledger-payees-in-buffer ()
-  "Scan buffer and return list of all payees."
-  (let ((origin (point))
-        payees-list)
-    (save-excursion
-      (goto-char (point-min))
-      (while (re-search-forward
-              ledger-payee-any-status-regex nil t)  ;; matches first line
-        (unless (and (>= origin (match-beginning 0))
-                     (< origin (match-end 0)))
-          (setq payees-list (cons (match-string-no-properties 3)
-                                  payees-list)))))  ;; add the payee
-    ;; to the list
-    (pcomplete-uniqify-list (nreverse payees-list))))
+  "Return the payees of the buffer, most relevant first.
+See `ledger-complete-ranked-payees'.  The xact at point, whose
+payee is being typed, is not counted.  Payees known from outside
+the buffer follow."
+  (ledger-complete-payee-uses)
+  (let ((own (save-restriction
+               (widen)
+               (ledger-complete-xact-at-point)))
+        payees
+        extra)
+    (when (and own (aref own 1))
+      (ledger-complete-count-payee (aref own 1) (aref own 0) -1))
+    (unwind-protect
+        (setq payees (ledger-complete-ranked-payees))
+      (when (and own (aref own 1))
+        (ledger-complete-count-payee (aref own 1) (aref own 0) 1)))
+    (dolist (payee (ledger-complete-extra-candidates
+                    'ledger-complete-payee-functions))
+      (unless (gethash payee ledger-complete-payees)
+        (push payee extra)))
+    (append payees (delete-dups (nreverse extra)))))
 
 
 (defun ledger-find-accounts-in-buffer ()
@@ -90,6 +313,10 @@
                   (while (re-search-forward seed-regex nil t)
                     (unless (ledger-between origin (match-beginning 0) (match-end 0))
                       (setq accounts (cons (match-string-no-properties 2) accounts))))
+                  (dolist (account (ledger-complete-extra-candidates
+                                    'ledger-complete-account-functions))
+                    (when (string-prefix-p (car pcomplete-args) account)
+                      (setq accounts (cons account accounts))))
                   accounts)))
         (let ((root account-tree))
           (setq account-elements
@@ -133,6 +360,199 @@
                   (cdr root))
           'string-lessp))))
 
+;; Account candidates are annotated with their balance and the date
+;; they were last used.  Asking ledger for the balance of each
+;; candidate would be far too slow, so the balances of all accounts
+;; are queried at once in the background whenever the buffer changed
+;; since the last query, and the annotations read them from a cache.
+;; The dates come from the index of ledger-index.el.
+
+(defcustom ledger-complete-annotate-accounts t
+  "If non-nil, annotate account candidates with their balance and last use."
+  :type 'boolean
+  :group 'ledger)
+
+(defvar-local ledger-complete-balances nil
+  "Hash table mapping account names to their balance, as text.")
+
+(defvar-local ledger-complete-balances-tick nil
+  "Modification stamp of the journal when its balances were last queried.
+See `ledger-complete-journal-tick'.")
+
+(defvar-local ledger-complete-balances-files nil
+  "Files included by the buffer when its balances were last queried.")
+
+(defvar-local ledger-complete-balances-process nil
+  "Process querying the balances of the buffer, if any.")
+
+(defvar-local ledger-complete-account-uses nil
+  "Hash table mapping each account of the buffer to its uses.
+The uses are a hash table mapping day numbers to the number of
+postings to the account on that day.  This is nil until accounts
+are first annotated in the buffer.")
+
+(defvar-local ledger-complete-last-used nil
+  "Hash table mapping account names to the day number they were last used.
+It is kept up to date with `ledger-complete-account-uses'.")
+
+(defun ledger-complete-parse-balances ()
+  "Return the balances in the output of the balance query in the current buffer.
+Each line holds an account, a tab and its balance; the other
+amounts of a balance in several commodities follow on lines of
+their own."
+  (let ((balances (make-hash-table :test 'equal))
+        account)
+    (dolist (line (split-string (buffer-string) "\n" t))
+      (if (string-match "\\`\\([^\t]+\\)\t\\(.*\\)\\'" line)
+          (puthash (setq account (match-string 1 line)) (match-string 2 line) balances)
+        (when account
+          (puthash account (concat (gethash account balances) ", " line) balances))))
+    balances))
+
+(defun ledger-complete-store-balances (buffer output)
+  "Cache the balances of BUFFER parsed from the buffer OUTPUT."
+  (let ((balances (with-current-buffer output
+                    (ledger-complete-parse-balances))))
+    (when (buffer-live-p buffer)
+      (with-current-buffer buffer
+        (setq ledger-complete-balances balances)))))
+
+(defun ledger-complete-count-account (account day delta)
+  "Add DELTA to the uses of ACCOUNT on the day number DAY."
+  (let* ((days (or (gethash account ledger-complete-account-uses)
+                   (puthash account (make-hash-table) ledger-complete-account-uses)))
+         (count (+ (gethash day days 0) delta)))
+    (if (> count 0)
+        (puthash day count days)
+      (remhash day days))
+    (cond ((zerop (hash-table-count days))
+           (remhash account ledger-complete-account-uses)
+           (remhash account ledger-complete-last-used))
+          ((> day (gethash account ledger-complete-last-used 0))
+           (puthash account day ledger-complete-last-used))
+          ((and (<= count 0)
+                (eql day (gethash account ledger-complete-last-used)))
+           ;; The last use went away, look for the one before.
+           (let ((latest 0))
+             (maphash (lambda (used _count)
+                        (setq latest (max latest used)))
+                      days)
+             (puthash account latest ledger-complete-last-used))))))
+
+(defun ledger-complete-count-postings (record delta)
+  "Add DELTA to the uses of the accounts of the postings of the index RECORD."
+  (dolist (posting (aref record 2))
+    (ledger-complete-count-account (car posting) (aref record 0) delta)))
+
+(defun ledger-complete-account-days ()
+  "Bring the last use of the accounts of the buffer up to date and return it.
+This is a hash table mapping each account to the day it was last
+used, built from the index the first time and then updated as the
+index changes."
+  (unless ledger-index-xacts
+    (setq ledger-complete-account-uses nil))
+  (let ((xacts (ledger-index-update)))
+    (unless ledger-complete-account-uses
+      (setq ledger-complete-account-uses (make-hash-table :test 'equal)
+            ledger-complete-last-used (make-hash-table :test 'equal))
+      (maphash (lambda (_marker record)
+                 (ledger-complete-count-postings record 1))
+               xacts))
+    ledger-complete-last-used))
+
+(defun ledger-complete-last-used-snapshot ()
+  "Return the last use of the accounts of the buffer as a sorted alist."
+  (if (null ledger-complete-account-uses)
+      :inactive
+    (ledger-complete-table-alist (ledger-complete-account-days))))
+
+(defun ledger-complete-last-used-rescan ()
+  "Return the last use of the accounts computed from scratch, as for the snapshot."
+  (let ((days (make-hash-table :test 'equal)))
+    (dolist (entry (ledger-index-rescan))
+      (let ((record (cdr entry)))
+        (dolist (posting (aref record 2))
+          (when (> (aref record 0) (gethash (car posting) days 0))
+            (puthash (car posting) (aref record 0) days)))))
+    (ledger-complete-table-alist days)))
+
+(ledger-verify-register 'ledger-complete-last-used
+                        'ledger-complete-last-used-snapshot
+                        'ledger-complete-last-used-rescan)
+
+(defun ledger-complete-journal-tick (buffer files)
+  "Return the modification stamp of the journal read from BUFFER.
+It changes whenever BUFFER or one of the included FILES, which
+ledger reads from disk, changes."
+  (cons (buffer-chars-modified-tick buffer)
+        (mapcar (lambda (file)
+                  (nth 5 (file-attributes file)))
+                files)))
+
+(defun ledger-complete-refresh-balances ()
+  "Query the balances of the accounts again if the journal changed since.
+Ledger runs on the master file, so that the balances shown in an
+included file cover the whole journal."
+  (ledger-complete-account-days)
+  (let* ((file (ledger-master-file))
+         (master (if file (find-file-noselect file) (current-buffer)))
+         (tick (ledger-complete-journal-tick master ledger-complete-balances-files)))
+    (unless (or (equal tick ledger-complete-balances-tick)
+                (and ledger-complete-balances-process
+                     (process-live-p ledger-complete-balances-process)))
+      ;; The includes themselves may have changed.
+      (setq ledger-complete-balances-files
+            (and file (cdr (ledger-journal-files file))))
+      (setq ledger-complete-balances-tick
+            (ledger-complete-journal-tick master ledger-complete-balances-files)
+            ledger-complete-balances-process
+            (ledger-exec-ledger-async
+             master
+             (apply-partially #'ledger-complete-store-balances (current-buffer))
+             "balance" "--flat" "--empty"
+             "--format" "%(account)\t%(scrub(display_total))\n")))))
+
+(defun ledger-complete-account-annotation (buffer account)
+  "Return the balance and last use of ACCOUNT cached in BUFFER, as an annotation."
+  (let ((balances (buffer-local-value 'ledger-complete-balances buffer))
+        (days (buffer-local-value 'ledger-complete-last-used buffer)))
+    (let ((balance (and balances (gethash account balances)))
+          (day (and days (gethash account days))))
+      (when (or balance day)
+        (concat "  " (or balance "")
+                (if day
+                    (concat "  " (ledger-format-date (ledger-index-day-date day)))
+                  ""))))))
+
+(defun ledger-complete-ranked-table (table string predicate action)
+  "Complete STRING with PREDICATE and ACTION in TABLE, keeping its order."
+  (if (eq action 'metadata)
+      '(metadata (display-sort-function . identity)
+                 (cycle-sort-function . identity))
+    (complete-with-action action table string predicate)))
+
+(defun ledger-complete-completions-at-point ()
+  "Return the completions at point, for `completion-at-point-functions'.
+Payee candidates keep their ranking, and account candidates are
+annotated as `ledger-complete-annotate-accounts' says."
+  (let ((completions (pcomplete-completions-at-point))
+        (payee (eq (save-excursion (ledger-thing-at-point)) 'transaction)))
+    (cond ((null completions) nil)
+          (payee
+           ;; Payees come ranked, keep them in that order.
+           (cons (car completions)
+                 (cons (nth 1 completions)
+                       (cons (apply-partially #'ledger-complete-ranked-table
+                                              (nth 2 completions))
+                             (nthcdr 3 completions)))))
+          (ledger-complete-annotate-accounts
+           (ledger-complete-refresh-balances)
+           (append completions
+                   (list :annotation-function
+                         (apply-partially #'ledger-complete-account-annotation
+                                          (current-buffer)))))
+          (t completions))))
+
 (defun ledger-complete-at-point ()
   "Do appropriate completion for the thing at point."
   (interactive)
@@ -88,6 +88,58 @@ otherwise the error output is displayed and an error is raised."
             (display-buffer (ledger-exec-handle-error errfile))
             (error "Ledger execution failed")))))))
 
+(defun ledger-exec-async-sentinel (callback process _event)
+  "Call CALLBACK with the output of PROCESS once it succeeded."
+  (when (memq (process-status process) '(exit signal))
+    (let ((outbuf (process-buffer process))
+          (errbuf (process-get process 'ledger-exec-errors)))
+      (unwind-protect
+          (when (ledger-exec-success-p (process-exit-status process) outbuf)
+            (funcall callback outbuf))
+        (kill-buffer outbuf)
+        (when (buffer-live-p errbuf)
+          (kill-buffer errbuf))))))
+
+(defun ledger-exec-start (command callback)
+  "Run COMMAND, a list of a program and its arguments, in the background.
+When it succeeds, CALLBACK is called with a buffer holding its
+output, which is killed afterwards.  Errors and warnings, written
+to a buffer of their own, are ignored.  COMMAND runs in
+`default-directory'.  Return the process."
+  (let* ((errbuf (generate-new-buffer " *ledger-async-errors*"))
+         (process (make-process
+                   :name "ledger"
+                   :buffer (generate-new-buffer " *ledger-async*")
+                   :command command
+                   :coding 'utf-8
+                   :connection-type 'pipe
+                   :noquery t
+                   :stderr errbuf
+                   :sentinel (apply-partially #'ledger-exec-async-sentinel
+                                              callback))))
+    (process-put process 'ledger-exec-errors errbuf)
+    (set-process-query-on-exit-flag (get-buffer-process errbuf) nil)
+    process))
+
+(defun ledger-exec-ledger-async (input-buffer callback &rest args)
+  "Run Ledger on INPUT-BUFFER in the background, passing ARGS.
+When ledger succeeds, CALLBACK is called with a buffer holding its
+output, see `ledger-exec-start'.  Ledger runs in the directory of
+INPUT-BUFFER, from which it resolves the includes of its input.
+Return the process."
+  (if (null ledger-binary-path)
+      (error "The variable `ledger-binary-path' has not been set")
+    (let ((process (with-current-buffer input-buffer
+                     (ledger-exec-start (append (list ledger-binary-path "-f" "-")
+                                                args)
+                                        callback))))
+      (with-current-buffer input-buffer
+        (save-restriction
+          (widen)
+          (process-send-region process (point-min) (point-max))))
+      (process-send-eof process)
+      process)))
+
 (defun ledger-version-greater-p (needed)
   "Verify the ledger binary is usable for `ledger-mode' (version greater than NEEDED)."
   (let ((version-strings '()))
@@ -45,13 +45,36 @@
     (goto-char beg)
     (beginning-of-line)
     (while (< (point) end)
-      (cond ((or (looking-at ledger-xact-start-regex)
-                 (looking-at ledger-posting-regex)
-                 (looking-at ledger-recurring-line-regexp))
-             (ledger-fontify-xact-at (point)))
-            ((looking-at ledger-directive-start-regex)
-             (ledger-fontify-directive-at (point))))
-      (ledger-navigate-next-xact-or-directive))))
+      (let ((block (ledger-navigate-comment-at (point))))
+        ;; Skip comment blocks as a whole, except for the comments of
+        ;; the postings of an xact.
+        (if (and block
+                 (or (eq (nth 2 block) 'block)
+                     (not (looking-at "[ \t]"))))
+            (progn
+              (ledger-fontify-set-face block 'ledger-font-comment-face)
+              (goto-char (nth 1 block)))
+          (if (looking-at "P[ \t]")
+              (ledger-fontify-price-run end)
+            (cond ((or (looking-at ledger-xact-start-regex)
+                       (looking-at ledger-posting-regex)
+                       (looking-at ledger-recurring-line-regexp))
+                   (ledger-fontify-xact-at (point)))
+                  ((looking-at ledger-directive-start-regex)
+                   (ledger-fontify-directive-at (point))))
+            (ledger-navigate-next-xact-or-directive)))))))
+
+(defun ledger-fontify-price-run (limit)
+  "Fontify the P directives from point on, and move past them.
+The run of P lines stops at the first other line or at the line
+of LIMIT, and gets its face at once rather than line by line."
+  (let ((start (point)))
+    (if (re-search-forward "^\\(?:[^P]\\|P[^ \t]\\)" limit t)
+        (goto-char (match-beginning 0))
+      (goto-char limit)
+      (unless (bolp)
+        (forward-line)))
+    (ledger-fontify-set-face (list start (point)) 'ledger-font-price-directive-face)))
 
 (defun ledger-fontify-xact-at (position)
   "Fontify the xact at POSITION."
@@ -0,0 +1,175 @@
+;;; ledger-index.el --- Parsed transactions of ledger buffers
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Analyses over the whole journal, such as finding recurring
+;; transactions, need the date, payee and amounts of every
+;; transaction.  Parsing them again for each analysis is what makes
+;; these slow, so the index keeps them parsed per buffer and reparses
+;; only the transactions an edit touched, using the events of
+;; ledger-track.el.
+;;
+;; The index of a buffer is the hash table `ledger-index-xacts',
+;; mapping the start marker of each xact to a vector
+;; [DAY PAYEE POSTINGS].  DAY is the date as a day number, see
+;; `time-to-days'.  POSTINGS is a list of (ACCOUNT AMOUNT VALUE
+;; COMMODITY), AMOUNT being the text of the amount, and VALUE and
+;; COMMODITY its parse by `ledger-parse-amount'; they are nil for a
+;; posting without an amount.
+
+;;; Code:
+
+(require 'calendar)
+(require 'ledger-commodities)
+(require 'ledger-xact)
+(require 'ledger-track)
+(require 'ledger-verify)
+(require 'ledger-report) ; for ledger-journal-files
+
+(defvar-local ledger-index-xacts nil
+  "Hash table mapping the marker of each xact of the buffer to its record.
+See the commentary of ledger-index.el for the records.")
+
+(defvar-local ledger-index-build-time nil
+  "Seconds taken by the last build of the index of the buffer.
+This includes scanning the buffer with ledger-track.el when it was
+not tracked yet.")
+
+(defvar ledger-index-functions nil
+  "Abnormal hook run when the record of an xact changes.
+Each function is called in the indexed buffer with the marker of
+the xact, its old record and its new record.  The old record is
+nil for an xact being indexed, the new one for a removed xact.")
+
+(defvar ledger-index-restore-functions nil
+  "Abnormal hook run when the index of a buffer is built.
+Each function is called in the widened buffer with no argument
+and may return a hash table mapping xact positions to records
+known to be current, which are used instead of parsing those
+xacts.  See ledger-closed.el.")
+
+(defun ledger-index-record (xact)
+  "Return the index record of the parsed XACT."
+  (vector (time-to-days (plist-get xact :date))
+          (plist-get xact :payee)
+          (mapcar (lambda (posting)
+                    (let ((amount (plist-get posting :amount)))
+                      (cons (plist-get posting :account)
+                            (cons amount (ledger-parse-amount amount)))))
+                  (plist-get xact :postings))))
+
+(defun ledger-index-set (marker record)
+  "Make RECORD the record of the xact at MARKER, or remove it if nil."
+  (let ((old (gethash marker ledger-index-xacts)))
+    (if record
+        (puthash marker record ledger-index-xacts)
+      (remhash marker ledger-index-xacts))
+    (when (or old record)
+      (run-hook-with-args 'ledger-index-functions marker old record))))
+
+(defun ledger-index-xact (marker)
+  "Index the xact starting at MARKER."
+  (let ((xact (ledger-xact-parse-at marker)))
+    (ledger-index-set marker
+                      (when (and xact (plist-get xact :date))
+                        (ledger-index-record xact)))))
+
+(defun ledger-index-track (events)
+  "Update the index for the structural change EVENTS."
+  (save-restriction
+    (widen)
+    (dolist (event events)
+      (let ((marker (plist-get event :marker)))
+        (if (and (not (eq (plist-get event :op) 'removed))
+                 (eq (plist-get event :kind) 'xact))
+            (ledger-index-xact marker)
+          (ledger-index-set marker nil))))))
+
+(defun ledger-index-build ()
+  "Index every transaction of the current buffer."
+  (setq ledger-index-xacts (make-hash-table :test 'eq))
+  (let ((start (float-time)))
+    (save-restriction
+      (widen)
+      (let ((restored (run-hook-with-args-until-success
+                       'ledger-index-restore-functions)))
+        (dolist (marker (ledger-track-markers 'xact))
+          (let ((record (and restored
+                             (gethash (marker-position marker) restored))))
+            (if record
+                (ledger-index-set marker record)
+              (ledger-index-xact marker))))))
+    (setq ledger-index-build-time (- (float-time) start)))
+  (ledger-track-subscribe 'ledger-index-track))
+
+(defun ledger-index-update ()
+  "Bring the index of the current buffer up to date and return it."
+  (if ledger-index-xacts
+      (ledger-track-flush)
+    (ledger-index-build))
+  ledger-index-xacts)
+
+(defun ledger-index-buffers (&optional files)
+  "Return the buffers of FILES with their index up to date.
+FILES defaults to the files of the journal of the current buffer."
+  (mapcar (lambda (file)
+            (with-current-buffer (find-file-noselect file)
+              (ledger-index-update)
+              (current-buffer)))
+          (or files (ledger-journal-files))))
+
+(defun ledger-index-day-date (day)
+  "Return the time value of the day number DAY."
+  (let ((date (calendar-gregorian-from-absolute day)))
+    (encode-time 0 0 0 (nth 1 date) (nth 0 date) (nth 2 date))))
+
+(defun ledger-index-entries (entries)
+  "Return ENTRIES, (POSITION . RECORD) pairs, sorted by position."
+  (sort entries (lambda (a b) (< (car a) (car b)))))
+
+(defun ledger-index-snapshot ()
+  "Return the index of the buffer as (POSITION . RECORD) pairs."
+  (if (null ledger-index-xacts)
+      :inactive
+    (ledger-track-flush)
+    (let (entries)
+      (maphash (lambda (marker record)
+                 (push (cons (marker-position marker) record) entries))
+               ledger-index-xacts)
+      (ledger-index-entries entries))))
+
+(defun ledger-index-rescan ()
+  "Return the index of the buffer computed from scratch, as for `ledger-index-snapshot'."
+  (save-restriction
+    (widen)
+    (let (entries)
+      (dolist (element (ledger-track-scan))
+        (when (eq (nth 1 element) 'xact)
+          (let ((xact (ledger-xact-parse-at (car element))))
+            (when (and xact (plist-get xact :date))
+              (push (cons (car element) (ledger-index-record xact)) entries)))))
+      (ledger-index-entries entries))))
+
+(ledger-verify-register 'ledger-index 'ledger-index-snapshot 'ledger-index-rescan)
+
+(provide 'ledger-index)
+
+;;; ledger-index.el ends here
@@ -0,0 +1,435 @@
+;;; ledger-lots.el --- Cost basis and gains of commodity lots
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; A posting of a commodity with a lot price, {COST}, or a price,
+;; @ PRICE, is a trade: buying opens a lot of the commodity in the
+;; account of the posting, and selling closes the oldest lots first
+;; (FIFO) or the newest (LIFO), see `ledger-lots-method'.  Closing a
+;; lot realizes the gain between its cost and the price it is sold
+;; at, and the lots left open have an unrealized gain at the latest
+;; market price, taken from P directives and from the prices of the
+;; trades.
+;;
+;; The trades are read from the index of ledger-index.el.  The open
+;; lots and realized gains after the latest trade are kept, and a
+;; trade added after it is applied to them alone; any other change
+;; to the trades replays them all.
+
+;;; Code:
+
+(require 'ledger-commodities)
+(require 'ledger-index)
+(require 'ledger-report) ; for ledger-report-visit-source
+
+(declare-function ledger-read-date "ledger-mode" (prompt))
+
+(defgroup ledger-lots nil
+  "Options for the cost basis of commodity lots."
+  :group 'ledger)
+
+(defcustom ledger-lots-buffer-name "*Ledger Lots*"
+  "Name of the buffer listing the lots and their gains."
+  :type 'string
+  :group 'ledger-lots)
+
+(defcustom ledger-lots-method 'fifo
+  "Which lots a sale closes first: the oldest or the newest."
+  :type '(choice (const :tag "First in, first out" fifo)
+                 (const :tag "Last in, first out" lifo))
+  :group 'ledger-lots)
+
+(defvar ledger-lots-state nil
+  "Lots after the latest trade applied, or nil if they must be replayed.
+This is a vector [OPEN REALIZED PRICES DAY METHOD INDEXES].  OPEN is a
+hash table mapping each (ACCOUNT . COMMODITY) to a queue of lots,
+a pair (LOTS . LAST-CELL), the lots to close first coming first;
+each lot is a vector [DAY QUANTITY COST MARKER DECIMALS], COST
+being the (VALUE COMMODITY) of one unit and DECIMALS the number of
+decimals its quantity was written with.  REALIZED is the list of sales,
+latest first, see `ledger-lots-close'.  PRICES is a hash table
+mapping each commodity to the (DAY VALUE COMMODITY) prices of its
+trades, latest first.  DAY is the day of the latest trade, METHOD
+the value of `ledger-lots-method' used and INDEXES the indexes of
+the buffers the trades come from.")
+
+(defvar ledger-lots-pending nil
+  "Trades added after those of `ledger-lots-state', not applied yet.")
+
+(defun ledger-lots-decimals (amount)
+  "Return the number of decimals of the quantity of the AMOUNT text."
+  (let ((number (and amount
+                     (string-match ledger-amount-parse-regex amount)
+                     (match-string 4 amount))))
+    (if (and number (string-match "[.,]\\([0-9]+\\)\\'" number))
+        (length (match-string 1 number))
+      0)))
+
+(defun ledger-lots-record-trades (marker record)
+  "Return the trades of the index RECORD of the xact at MARKER.
+Each trade is a vector [DAY ACCOUNT QUANTITY COMMODITY COST PRICE
+MARKER DECIMALS]: COST is the (VALUE COMMODITY) of one unit given
+by the lot price, else by the price, PRICE that given by the price
+and DECIMALS the number of decimals of QUANTITY."
+  (let (trades)
+    (dolist (posting (aref record 2))
+      (let ((value (nth 2 posting))
+            (commodity (nth 3 posting)))
+        (when (and value commodity (not (zerop value)))
+          (let* ((prices (ledger-parse-amount-prices (nth 1 posting) value))
+                 (cost (or (car prices) (cdr prices))))
+            (when (and cost (not (equal (nth 1 cost) commodity)))
+              (push (vector (aref record 0) (car posting) value commodity
+                            cost (cdr prices) marker
+                            (ledger-lots-decimals (nth 1 posting)))
+                    trades))))))
+    (nreverse trades)))
+
+(defun ledger-lots-trade-before-p (a b)
+  "Return non-nil if the trade A comes before B."
+  (or (< (aref a 0) (aref b 0))
+      (and (= (aref a 0) (aref b 0))
+           (eq (marker-buffer (aref a 6)) (marker-buffer (aref b 6)))
+           (< (aref a 6) (aref b 6)))))
+
+(defun ledger-lots-trades (buffers)
+  "Return the trades of the indexed BUFFERS in order."
+  (let (trades)
+    (dolist (buffer buffers)
+      (maphash (lambda (marker record)
+                 (setq trades (nconc (ledger-lots-record-trades marker record) trades)))
+               (buffer-local-value 'ledger-index-xacts buffer)))
+    (sort trades 'ledger-lots-trade-before-p)))
+
+(defun ledger-lots-make-state (indexes)
+  "Return the state of no trade at all in INDEXES, see `ledger-lots-state'."
+  (vector (make-hash-table :test 'equal) nil (make-hash-table :test 'equal)
+          0 ledger-lots-method indexes))
+
+(defun ledger-lots-indexes (buffers)
+  "Return the indexes of BUFFERS."
+  (mapcar (lambda (buffer) (buffer-local-value 'ledger-index-xacts buffer))
+          buffers))
+
+(defun ledger-lots-close (state trade quantity)
+  "Close QUANTITY units of the lots of STATE for the sale TRADE.
+Each sale of part of a lot is recorded in the realized sales of
+STATE as (TRADE LOT QUANTITY GAIN), LOT being nil for units
+without an open lot.  GAIN is nil when the sale has no price in
+the commodity of the cost of the lot.  Quantities are floats, so
+a remainder below half the last decimal written of the quantities
+is taken as zero."
+  (let ((queue (gethash (cons (aref trade 1) (aref trade 3)) (aref state 0)))
+        (price (or (aref trade 5) (aref trade 4))))
+    (while (> quantity 0)
+      (let* ((lot (car (car queue)))
+             (taken (if lot (min quantity (aref lot 1)) quantity))
+             (cost (and lot (aref lot 2)))
+             (tolerance (/ 0.5 (expt 10.0 (if lot
+                                               (max (aref trade 7) (aref lot 4))
+                                             (aref trade 7))))))
+        (aset state 1 (cons (list trade lot taken
+                                  (when (and cost (equal (nth 1 cost) (nth 1 price)))
+                                    (* taken (- (car price) (car cost)))))
+                            (aref state 1)))
+        (setq quantity (- quantity taken))
+        (when (< quantity tolerance)
+          (setq quantity 0))
+        (when lot
+          (aset lot 1 (- (aref lot 1) taken))
+          (when (< (aref lot 1) tolerance)
+            (setcar queue (cdr (car queue)))))))))
+
+(defun ledger-lots-apply (state trade)
+  "Apply TRADE to the lots of STATE."
+  (let ((quantity (aref trade 2))
+        (price (or (aref trade 5) (aref trade 4))))
+    (puthash (aref trade 3)
+             (cons (cons (aref trade 0) price) (gethash (aref trade 3) (aref state 2)))
+             (aref state 2))
+    (if (< quantity 0)
+        (ledger-lots-close state trade (- quantity))
+      (let* ((key (cons (aref trade 1) (aref trade 3)))
+             (queue (or (gethash key (aref state 0))
+                        (puthash key (cons nil nil) (aref state 0))))
+             (cell (list (vector (aref trade 0) quantity (aref trade 4) (aref trade 6)
+                                 (aref trade 7)))))
+        (cond ((null (car queue))
+               (setcar queue cell)
+               (setcdr queue cell))
+              ((eq (aref state 4) 'lifo)
+               (setcdr cell (car queue))
+               (setcar queue cell))
+              (t
+               (setcdr (cdr queue) cell)
+               (setcdr queue cell)))))
+    (aset state 3 (max (aref state 3) (aref trade 0)))))
+
+(defun ledger-lots-replay (buffers &optional day)
+  "Return the state after the trades of BUFFERS, up to the day number DAY."
+  (let ((state (ledger-lots-make-state (ledger-lots-indexes buffers)))
+        (trades (ledger-lots-trades buffers)))
+    (while (and trades (or (null day) (<= (aref (car trades) 0) day)))
+      (ledger-lots-apply state (pop trades)))
+    state))
+
+(defun ledger-lots-index-changed (marker old new)
+  "Note the trades of the index record OLD being replaced by those of NEW."
+  ;; An index being built is not that of the state, whose trades
+  ;; would otherwise be added twice.
+  (when (and ledger-lots-state
+             (memq ledger-index-xacts (aref ledger-lots-state 5)))
+    (let ((removed (and old (ledger-lots-record-trades marker old)))
+          (added (and new (ledger-lots-record-trades marker new))))
+      (cond
+       ((equal removed added))
+       ((or removed
+            (let ((earlier nil))
+              (dolist (trade added)
+                (when (< (aref trade 0) (aref ledger-lots-state 3))
+                  (setq earlier t)))
+              earlier))
+        (setq ledger-lots-state nil
+              ledger-lots-pending nil))
+       (t
+        (setq ledger-lots-pending (append ledger-lots-pending added)))))))
+
+(add-hook 'ledger-index-functions #'ledger-lots-index-changed)
+
+(defun ledger-lots-current (buffers)
+  "Return the state after all the trades of the indexed BUFFERS."
+  (dolist (buffer buffers)
+    (with-current-buffer buffer
+      (ledger-index-update)))
+  (if (and ledger-lots-state
+           (equal (ledger-lots-indexes buffers) (aref ledger-lots-state 5))
+           (eq (aref ledger-lots-state 4) ledger-lots-method))
+      (dolist (trade (sort ledger-lots-pending 'ledger-lots-trade-before-p))
+        (ledger-lots-apply ledger-lots-state trade))
+    (setq ledger-lots-state (ledger-lots-replay buffers)))
+  (setq ledger-lots-pending nil)
+  ledger-lots-state)
+
+(defun ledger-lots-at (buffers day)
+  "Return the state of the lots of the indexed BUFFERS on the day number DAY."
+  (let ((state (ledger-lots-current buffers)))
+    (if (<= (aref state 3) day)
+        state
+      (ledger-lots-replay buffers day))))
+
+(defun ledger-lots-directive-prices (buffers prices)
+  "Add the prices of the P directives of BUFFERS to the hash table PRICES."
+  (dolist (buffer buffers)
+    (with-current-buffer buffer
+      (save-excursion
+        (save-restriction
+          (widen)
+          (goto-char (point-min))
+          (while (re-search-forward ledger-price-directive-regex nil t)
+            (let ((date (ledger-parse-iso-date (match-string-no-properties 1)))
+                  (commodity (match-string-no-properties 2))
+                  (price (ledger-parse-amount (match-string-no-properties 3))))
+              (when (and date price)
+                (when (eq (aref commodity 0) ?\")
+                  (setq commodity (substring commodity 1 -1)))
+                (puthash commodity
+                         (cons (cons (time-to-days date) price)
+                               (gethash commodity prices))
+                         prices)))))))))
+
+(defun ledger-lots-market (prices commodity currency day)
+  "Return the latest price in PRICES of COMMODITY in CURRENCY up to DAY, or nil."
+  (let (best)
+    (dolist (price (gethash commodity prices))
+      (when (and (<= (car price) day)
+                 (equal (nth 2 price) currency)
+                 (or (null best) (> (car price) (car best))))
+        (setq best price)))
+    (cadr best)))
+
+(defun ledger-lots-gains (buffers day)
+  "Return the realized and unrealized gains of BUFFERS on the day number DAY.
+The result is a list (REALIZED OPEN): REALIZED lists the sales up
+to DAY, oldest first, see `ledger-lots-close', and OPEN lists the
+lots open on DAY as (ACCOUNT COMMODITY LOT MARKET GAIN), MARKET
+being the latest price of a unit in the commodity of its cost and
+GAIN nil when there is none."
+  (let* ((state (ledger-lots-at buffers day))
+         (prices (make-hash-table :test 'equal))
+         realized open)
+    (maphash (lambda (commodity list) (puthash commodity list prices))
+             (aref state 2))
+    (ledger-lots-directive-prices buffers prices)
+    (dolist (sale (aref state 1))
+      (when (<= (aref (car sale) 0) day)
+        (push sale realized)))
+    (maphash (lambda (key queue)
+               (dolist (lot (car queue))
+                 (let* ((cost (aref lot 2))
+                        (market (ledger-lots-market prices (cdr key) (nth 1 cost) day)))
+                   (push (list (car key) (cdr key) lot market
+                               (when market (* (aref lot 1) (- market (car cost)))))
+                         open))))
+             (aref state 0))
+    (list realized
+          (sort open (lambda (a b)
+                       (or (string< (car a) (car b))
+                           (and (equal (car a) (car b))
+                                (or (string< (nth 1 a) (nth 1 b))
+                                    (and (equal (nth 1 a) (nth 1 b))
+                                         (< (aref (nth 2 a) 0)
+                                            (aref (nth 2 b) 0)))))))))))
+
+(defvar-local ledger-lots-files nil
+  "Journal files whose lots are shown in the buffer.")
+
+(defvar-local ledger-lots-day nil
+  "Day number of the lots shown in the buffer.")
+
+(defvar ledger-lots-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [return] 'ledger-report-visit-source)
+    (define-key map [?g] 'ledger-lots-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-lots-mode'.")
+
+(define-derived-mode ledger-lots-mode text-mode "Ledger-Lots"
+  "A mode for listing commodity lots and their gains.")
+
+(defun ledger-lots-add-total (totals value commodity)
+  "Add VALUE in COMMODITY to the (VALUE COMMODITY) TOTALS and return them."
+  (let ((rest totals))
+    (while (and rest (not (equal (nth 1 (car rest)) commodity)))
+      (setq rest (cdr rest)))
+    (if rest
+        (progn (setcar (car rest) (+ (car (car rest)) value)) totals)
+      (append totals (list (list value commodity))))))
+
+(defun ledger-lots-insert-line (text marker)
+  "Insert the line TEXT leading to the xact at MARKER."
+  (let ((beg (point)))
+    (insert text)
+    (set-text-properties beg (point)
+                         (list 'ledger-source
+                               (cons (buffer-file-name (marker-buffer marker)) marker)
+                               'font-lock-face
+                               'ledger-font-report-clickable-face))
+    (insert "\n")))
+
+(defun ledger-lots-day-string (day)
+  "Return the day number DAY as a date."
+  (ledger-format-date (ledger-index-day-date day)))
+
+(defun ledger-lots-insert-totals (totals)
+  "Insert the line of the gains TOTALS."
+  (insert (format "  Total: %s\n\n"
+                  (if totals
+                      (mapconcat (lambda (total) (ledger-format-amount (car total) (nth 1 total)))
+                                 totals ", ")
+                    "0"))))
+
+(defun ledger-lots-insert (gains)
+  "Insert the realized and unrealized GAINS, see `ledger-lots-gains'."
+  (let (totals)
+    (insert "Realized gains\n\n")
+    (dolist (sale (car gains))
+      (let ((trade (car sale))
+            (lot (nth 1 sale))
+            (price (or (aref (car sale) 5) (aref (car sale) 4))))
+        (ledger-lots-insert-line
+         (format "  %s  %s  %g %s bought %s, sold at %s: %s"
+                 (ledger-lots-day-string (aref trade 0))
+                 (aref trade 1)
+                 (nth 2 sale)
+                 (aref trade 3)
+                 (if lot
+                     (format "%s at %s" (ledger-lots-day-string (aref lot 0))
+                             (ledger-format-amount (car (aref lot 2)) (nth 1 (aref lot 2))))
+                   "in no open lot")
+                 (ledger-format-amount (car price) (nth 1 price))
+                 (if (nth 3 sale)
+                     (ledger-format-amount (nth 3 sale) (nth 1 price))
+                   "unknown"))
+         (aref trade 6))
+        (when (nth 3 sale)
+          (setq totals (ledger-lots-add-total totals (nth 3 sale) (nth 1 price))))))
+    (ledger-lots-insert-totals totals)
+    (setq totals nil)
+    (insert "Open lots\n\n")
+    (dolist (entry (nth 1 gains))
+      (let* ((lot (nth 2 entry))
+             (cost (aref lot 2)))
+        (ledger-lots-insert-line
+         (format "  %s  %g %s bought %s at %s, market %s: %s"
+                 (car entry)
+                 (aref lot 1)
+                 (nth 1 entry)
+                 (ledger-lots-day-string (aref lot 0))
+                 (ledger-format-amount (car cost) (nth 1 cost))
+                 (if (nth 3 entry) (ledger-format-amount (nth 3 entry) (nth 1 cost)) "unknown")
+                 (if (nth 4 entry) (ledger-format-amount (nth 4 entry) (nth 1 cost)) "unknown"))
+         (aref lot 3))
+        (when (nth 4 entry)
+          (setq totals (ledger-lots-add-total totals (nth 4 entry) (nth 1 cost))))))
+    (ledger-lots-insert-totals totals)))
+
+(defun ledger-lots-display (files day)
+  "List the lots of FILES and their gains on the day number DAY."
+  (let ((gains (ledger-lots-gains (ledger-index-buffers files) day)))
+    (with-current-buffer (get-buffer-create ledger-lots-buffer-name)
+      (let ((inhibit-read-only t))
+        (erase-buffer)
+        (ledger-lots-mode)
+        (setq ledger-lots-files files
+              ledger-lots-day day)
+        (insert (format "Lots on %s, %s\n\n"
+                        (ledger-lots-day-string day)
+                        (upcase (symbol-name ledger-lots-method))))
+        (ledger-lots-insert gains)
+        (goto-char (point-min))
+        (set-buffer-modified-p nil)
+        (setq buffer-read-only t))
+      (display-buffer (current-buffer)))))
+
+(defun ledger-lots (date &optional files)
+  "List the realized gains up to DATE and the lots open on DATE.
+
+Postings with a lot price or a price open lots when buying and
+close them when selling, in the order of `ledger-lots-method'.
+Realized gains are those of the lots closed, unrealized ones those
+of the open lots at the latest price of their commodity, from P
+directives and trades.  RET visits the trade at point.  FILES
+default to the files of the journal of the current buffer."
+  (interactive (list (ledger-read-date "Date: ")))
+  (ledger-lots-display (or files (ledger-journal-files))
+                       (time-to-days (if (stringp date)
+                                         (ledger-parse-iso-date date)
+                                       date))))
+
+(defun ledger-lots-redo ()
+  "List the lots of the files of the lots buffer again."
+  (interactive)
+  (ledger-lots-display ledger-lots-files ledger-lots-day))
+
+(provide 'ledger-lots)
+
+;;; ledger-lots.el ends here
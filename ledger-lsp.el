@@ -0,0 +1,626 @@
+;;; ledger-lsp.el --- Language server for ledger journals
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; A language server for ledger journals, speaking the Language Server
+;; Protocol over standard input and output.  It runs in a separate
+;; batch Emacs:
+;;
+;;   emacs --batch -Q -L DIR -l ledger-lsp -f ledger-lsp-serve
+;;
+;; and keeps every file of the journal, following include directives,
+;; in buffers indexed by ledger-index.el.  Edits sent by the client
+;; are applied to those buffers, so only the transactions they touch
+;; are parsed again.  Account and payee counts, account balances and
+;; unbalanced transactions are kept up to date from the changes of
+;; the index, and serve completion, hover balances, definitions,
+;; references and diagnostics.
+;;
+;; Loading this file registers the server with eglot, see
+;; `ledger-lsp-register-with-eglot'.  Buffers not managed by eglot
+;; keep using the completion and navigation of ledger-mode, which
+;; also remain in use in managed buffers behind those of eglot.
+
+;;; Code:
+
+(require 'json)
+(require 'url-util)
+(require 'ledger-commodities)
+(require 'ledger-index)
+(require 'ledger-navigate)
+(require 'ledger-revert)
+(require 'ledger-track)
+
+(declare-function ledger-mode "ledger-mode")
+(defvar eglot-server-programs)
+
+(defgroup ledger-lsp nil
+  "Options for the ledger language server."
+  :group 'ledger)
+
+(defcustom ledger-lsp-register-with-eglot t
+  "If non-nil, eglot uses the ledger language server for `ledger-mode'.
+This must be set before ledger-lsp.el is loaded."
+  :type 'boolean
+  :group 'ledger-lsp)
+
+(defconst ledger-lsp-directory
+  (file-name-directory (or load-file-name buffer-file-name))
+  "Directory ledger-lsp.el was loaded from.")
+
+(defvar ledger-lsp-accounts (make-hash-table :test 'equal)
+  "Hash table mapping each account of the journal to [COUNT BALANCE].
+COUNT is the number of its postings and BALANCE an alist of the
+sum of their amounts by commodity.")
+
+(defvar ledger-lsp-payees (make-hash-table :test 'equal)
+  "Hash table mapping each payee of the journal to its number of xacts.")
+
+(defvar ledger-lsp-problems (make-hash-table :test 'eq)
+  "Hash table mapping the marker of each faulty xact to its problem.")
+
+(defvar ledger-lsp-buffers nil
+  "Buffers of the journal files known to the server.")
+
+(defvar ledger-lsp-open (make-hash-table :test 'equal)
+  "Hash table of the files opened by the client.")
+
+(defconst ledger-lsp-methods
+  '(("initialize" . ledger-lsp-initialize)
+    ("initialized" . ignore)
+    ("shutdown" . ignore)
+    ("exit" . ledger-lsp-exit)
+    ("textDocument/didOpen" . ledger-lsp-did-open)
+    ("textDocument/didChange" . ledger-lsp-did-change)
+    ("textDocument/didSave" . ledger-lsp-did-save)
+    ("textDocument/didClose" . ledger-lsp-did-close)
+    ("textDocument/completion" . ledger-lsp-completion)
+    ("textDocument/hover" . ledger-lsp-hover)
+    ("textDocument/definition" . ledger-lsp-definition)
+    ("textDocument/references" . ledger-lsp-references))
+  "Alist of the methods of the protocol and the functions handling them.
+Each function is called with the params of the message and
+returns the result of a request.")
+
+(defconst ledger-lsp-posting-regex
+  "[ \t]+\\(?:[*!][ \t]*\\)?[[(]?"
+  "Regexp matching the start of a posting line up to its account.")
+
+(defconst ledger-lsp-payee-start-regex
+  "[0-9][^ \t\n]*\\(?:[ \t]+[*!]\\)?\\(?:[ \t]+([^)\n]*)\\)?[ \t]+"
+  "Regexp matching the start of a transaction line up to its payee.")
+
+;;; The model
+
+(defun ledger-lsp-count (table key delta)
+  "Add DELTA to the count of KEY in TABLE, removing it at zero.
+Return the entry of KEY, a vector [COUNT BALANCE]."
+  (let ((entry (or (gethash key table)
+                   (puthash key (vector 0 nil) table))))
+    (aset entry 0 (+ (aref entry 0) delta))
+    (when (<= (aref entry 0) 0)
+      (remhash key table))
+    entry))
+
+(defun ledger-lsp-add-record (record sign)
+  "Add the postings and payee of RECORD to the model, or remove them if SIGN is -1."
+  (when (aref record 1)
+    (ledger-lsp-count ledger-lsp-payees (aref record 1) sign))
+  (dolist (posting (aref record 2))
+    (let ((entry (ledger-lsp-count ledger-lsp-accounts (car posting) sign))
+          (value (nth 2 posting)))
+      (when value
+        (let ((cell (assoc (nth 3 posting) (aref entry 1))))
+          (if cell
+              (setcdr cell (+ (cdr cell) (* sign value)))
+            (aset entry 1 (cons (cons (nth 3 posting) (* sign value))
+                                (aref entry 1)))))))))
+
+(defun ledger-lsp-virtual-p (marker)
+  "Return non-nil if the xact at MARKER has a virtual posting."
+  (save-excursion
+    (goto-char marker)
+    (re-search-forward "^[ \t]+\\(?:[*!][ \t]*\\)?[[(]"
+                       (ledger-track-element-end marker) t)))
+
+(defun ledger-lsp-xact-problem (marker record)
+  "Return the problem of the xact at MARKER indexed as RECORD, or nil.
+Transactions with prices, lots, expressions or several
+commodities are left to ledger."
+  (let ((elided 0)
+        (sum 0)
+        (checkable t)
+        commodity)
+    (dolist (posting (aref record 2))
+      (let ((amount (nth 1 posting)))
+        (cond ((null amount)
+               (setq elided (1+ elided)))
+              ((or (null (nth 2 posting))
+                   (string-match-p "[@{=]" amount)
+                   (and commodity (not (equal commodity (nth 3 posting)))))
+               (setq checkable nil))
+              (t
+               (setq commodity (nth 3 posting)
+                     sum (+ sum (nth 2 posting)))))))
+    (cond ((> elided 1)
+           "Only one posting without an amount is allowed")
+          ((and checkable
+                (zerop elided)
+                (> (abs sum) 1e-6)
+                (not (ledger-lsp-virtual-p marker)))
+           (format "Transaction does not balance, off by %s"
+                   (ledger-commodity-to-string (list sum commodity)))))))
+
+(defun ledger-lsp-index-changed (marker old new)
+  "Update the model for the xact at MARKER whose record changed from OLD to NEW."
+  (when old
+    (ledger-lsp-add-record old -1))
+  (if (null new)
+      (remhash marker ledger-lsp-problems)
+    (ledger-lsp-add-record new 1)
+    (let ((problem (ledger-lsp-xact-problem marker new)))
+      (if problem
+          (puthash marker problem ledger-lsp-problems)
+        (remhash marker ledger-lsp-problems)))))
+
+(defun ledger-lsp-start ()
+  "Start with an empty model kept up to date from the indexes."
+  (clrhash ledger-lsp-accounts)
+  (clrhash ledger-lsp-payees)
+  (clrhash ledger-lsp-problems)
+  (clrhash ledger-lsp-open)
+  (setq ledger-lsp-buffers nil)
+  (add-hook 'ledger-index-functions 'ledger-lsp-index-changed))
+
+(defun ledger-lsp-stop ()
+  "Stop updating the model."
+  (remove-hook 'ledger-index-functions 'ledger-lsp-index-changed))
+
+(defun ledger-lsp-visit (file)
+  "Return the indexed buffer of FILE, adding it to the model."
+  ;; Nothing may be asked: the standard input carries the protocol.
+  (let* ((large-file-warning-threshold nil)
+         (buffer (find-file-noselect file t)))
+    (with-current-buffer buffer
+      (unless (derived-mode-p 'ledger-mode)
+        (ledger-mode))
+      (ledger-index-update))
+    (unless (memq buffer ledger-lsp-buffers)
+      (setq ledger-lsp-buffers (append ledger-lsp-buffers (list buffer))))
+    buffer))
+
+(defun ledger-lsp-load-journal (buffer)
+  "Add the files of the journal of BUFFER to the model."
+  (mapc #'ledger-lsp-visit
+        (with-current-buffer buffer
+          (ledger-journal-files))))
+
+(defun ledger-lsp-refresh ()
+  "Bring the files not opened by the client up to date with the disk."
+  (dolist (buffer ledger-lsp-buffers)
+    (with-current-buffer buffer
+      (unless (or (gethash buffer-file-name ledger-lsp-open)
+                  (verify-visited-file-modtime buffer))
+        (ledger-revert-buffer t t)
+        (ledger-index-update)))))
+
+;;; Positions
+
+(defun ledger-lsp-uri-file (uri)
+  "Return the file name of the file URI."
+  (decode-coding-string
+   (url-unhex-string (replace-regexp-in-string "\\`file://" "" uri))
+   'utf-8))
+
+(defun ledger-lsp-file-uri (file)
+  "Return the URI of FILE."
+  (concat "file://"
+          (url-hexify-string (encode-coding-string (expand-file-name file) 'utf-8)
+                             url-path-allowed-chars)))
+
+(defun ledger-lsp-document-buffer (params)
+  "Return the buffer of the text document of PARAMS."
+  (ledger-lsp-visit (ledger-lsp-uri-file
+                     (plist-get (plist-get params :textDocument) :uri))))
+
+(defun ledger-lsp-code-units (char)
+  "Return the number of UTF-16 code units of CHAR."
+  (if (> char #xFFFF) 2 1))
+
+(defun ledger-lsp-point (position)
+  "Return the buffer position of the protocol POSITION.
+Its character is a column in UTF-16 code units, as the protocol
+counts them."
+  (let* ((pos (ledger-navigate-line-position (1+ (plist-get position :line))))
+         (eol (save-excursion
+                (goto-char pos)
+                (line-end-position)))
+         (units (plist-get position :character)))
+    (while (and (> units 0) (< pos eol))
+      (setq units (- units (ledger-lsp-code-units (char-after pos)))
+            pos (1+ pos)))
+    pos))
+
+(defun ledger-lsp-position (pos)
+  "Return the protocol position of the buffer position POS."
+  (let* ((line (ledger-navigate-line-number pos))
+         (bol (ledger-navigate-line-position line))
+         (units 0))
+    (while (< bol pos)
+      (setq units (+ units (ledger-lsp-code-units (char-after bol)))
+            bol (1+ bol)))
+    (list :line (1- line)
+          :character units)))
+
+(defun ledger-lsp-range (beg end)
+  "Return the protocol range from BEG to END."
+  (list :start (ledger-lsp-position beg)
+        :end (ledger-lsp-position end)))
+
+(defun ledger-lsp-location (beg end)
+  "Return the protocol location of the text from BEG to END."
+  (list :uri (ledger-lsp-file-uri buffer-file-name)
+        :range (ledger-lsp-range beg end)))
+
+(defun ledger-lsp-account-at-point ()
+  "Return (ACCOUNT BEG END) for the account of the posting at point, or nil."
+  (let ((pos (point)))
+    (save-excursion
+      (beginning-of-line)
+      (when (and (looking-at (concat ledger-lsp-posting-regex
+                                     "\\([^ \t\n;[(][^\t\n]*?\\)[])]?"
+                                     "\\(?:[ \t][ \t]\\|\t\\|[ \t]*$\\)"))
+                 (<= (match-beginning 1) pos (match-end 1)))
+        (list (match-string-no-properties 1) (match-beginning 1) (match-end 1))))))
+
+;;; Requests
+
+(defun ledger-lsp-initialize (_params)
+  "Return the capabilities of the server."
+  (list :capabilities
+        (list :textDocumentSync (list :openClose t :change 2 :save t)
+              :completionProvider (list :triggerCharacters [":"])
+              :hoverProvider t
+              :definitionProvider t
+              :referencesProvider t)
+        :serverInfo (list :name "ledger-lsp")))
+
+(defun ledger-lsp-exit (_params)
+  "Exit the server."
+  (ledger-lsp-stop)
+  (kill-emacs 0))
+
+(defun ledger-lsp-diagnostics (buffer)
+  "Return the diagnostics of BUFFER."
+  (let (diagnostics)
+    (maphash (lambda (marker problem)
+               (when (eq (marker-buffer marker) buffer)
+                 (push (cons (marker-position marker) problem) diagnostics)))
+             ledger-lsp-problems)
+    (with-current-buffer buffer
+      (vconcat
+       (mapcar (lambda (diagnostic)
+                 (list :range (ledger-lsp-range
+                               (car diagnostic)
+                               (save-excursion
+                                 (goto-char (car diagnostic))
+                                 (line-end-position)))
+                       :severity 1
+                       :source "ledger"
+                       :message (cdr diagnostic)))
+               (sort diagnostics (lambda (a b) (< (car a) (car b)))))))))
+
+(defun ledger-lsp-publish (buffer)
+  "Send the diagnostics of BUFFER to the client."
+  (ledger-lsp-notify "textDocument/publishDiagnostics"
+                     (list :uri (ledger-lsp-file-uri (buffer-file-name buffer))
+                           :diagnostics (ledger-lsp-diagnostics buffer))))
+
+(defun ledger-lsp-did-open (params)
+  "Add the opened document of PARAMS and its journal to the model."
+  (let ((buffer (ledger-lsp-document-buffer params))
+        (text (plist-get (plist-get params :textDocument) :text)))
+    (with-current-buffer buffer
+      (puthash buffer-file-name t ledger-lsp-open)
+      (unless (string= text (save-restriction
+                              (widen)
+                              (buffer-substring-no-properties (point-min) (point-max))))
+        (widen)
+        (erase-buffer)
+        (insert text)
+        (ledger-index-update)))
+    (ledger-lsp-load-journal buffer)
+    (mapc #'ledger-lsp-publish ledger-lsp-buffers)
+    nil))
+
+(defun ledger-lsp-did-change (params)
+  "Apply the changes of PARAMS to their document."
+  (let ((buffer (ledger-lsp-document-buffer params)))
+    (with-current-buffer buffer
+      (save-restriction
+        (widen)
+        (dolist (change (plist-get params :contentChanges))
+          (let ((range (plist-get change :range)))
+            (if (null range)
+                (erase-buffer)
+              (let ((beg (ledger-lsp-point (plist-get range :start)))
+                    (end (ledger-lsp-point (plist-get range :end))))
+                (delete-region beg end)
+                (goto-char beg)))
+            (insert (plist-get change :text)))))
+      (ledger-index-update))
+    (ledger-lsp-publish buffer)
+    nil))
+
+(defun ledger-lsp-did-save (params)
+  "Record that the document of PARAMS matches its file."
+  (with-current-buffer (ledger-lsp-document-buffer params)
+    (set-visited-file-modtime)
+    (set-buffer-modified-p nil))
+  nil)
+
+(defun ledger-lsp-did-close (params)
+  "Bring the closed document of PARAMS back to the text of its file."
+  (with-current-buffer (ledger-lsp-document-buffer params)
+    (remhash buffer-file-name ledger-lsp-open)
+    (when (and (buffer-modified-p)
+               (file-readable-p buffer-file-name))
+      (ledger-revert-incremental)
+      (set-visited-file-modtime)
+      (set-buffer-modified-p nil)
+      (ledger-index-update)
+      (ledger-lsp-publish (current-buffer))))
+  nil)
+
+(defun ledger-lsp-completion-items (table kind beg end)
+  "Return completion items for the keys of TABLE, replacing BEG to END.
+KIND is the protocol kind of the items."
+  (let ((range (ledger-lsp-range beg end))
+        items)
+    (maphash (lambda (key entry)
+               (push (list :label key
+                           :kind kind
+                           :detail (format "%d uses" (aref entry 0))
+                           :textEdit (list :range range :newText key))
+                     items))
+             table)
+    (vconcat items)))
+
+(defun ledger-lsp-completion (params)
+  "Return the accounts or payees completing the text at the position of PARAMS."
+  (ledger-lsp-refresh)
+  (with-current-buffer (ledger-lsp-document-buffer params)
+    (save-restriction
+      (widen)
+      (goto-char (ledger-lsp-point (plist-get params :position)))
+      (let ((pos (point)))
+        (beginning-of-line)
+        (cond ((and (looking-at ledger-lsp-posting-regex)
+                    (<= (match-end 0) pos)
+                    (not (string-match-p "  \\|\t" (buffer-substring (match-end 0) pos))))
+               (ledger-lsp-completion-items ledger-lsp-accounts 6 (match-end 0) pos))
+              ((and (looking-at ledger-lsp-payee-start-regex)
+                    (<= (match-end 0) pos))
+               (ledger-lsp-completion-items ledger-lsp-payees 4 (match-end 0) pos))
+              (t []))))))
+
+(defun ledger-lsp-balance (account)
+  "Return the balance of ACCOUNT and its subaccounts as an alist by commodity."
+  (let ((prefix (concat account ":"))
+        balance)
+    (maphash (lambda (name entry)
+               (when (or (string= name account)
+                         (string-prefix-p prefix name))
+                 (dolist (cell (aref entry 1))
+                   (let ((total (assoc (car cell) balance)))
+                     (if total
+                         (setcdr total (+ (cdr total) (cdr cell)))
+                       (push (cons (car cell) (cdr cell)) balance))))))
+             ledger-lsp-accounts)
+    (sort balance (lambda (a b) (string< (or (car a) "") (or (car b) ""))))))
+
+(defun ledger-lsp-hover (params)
+  "Return the balance of the account at the position of PARAMS."
+  (ledger-lsp-refresh)
+  (with-current-buffer (ledger-lsp-document-buffer params)
+    (save-restriction
+      (widen)
+      (goto-char (ledger-lsp-point (plist-get params :position)))
+      (let ((account (ledger-lsp-account-at-point)))
+        (when account
+          (list :contents
+                (list :kind "markdown"
+                      :value (concat
+                              "**" (car account) "**\n\n"
+                              (mapconcat (lambda (cell)
+                                           (concat "    "
+                                                   (ledger-commodity-to-string
+                                                    (list (cdr cell) (car cell)))))
+                                         (ledger-lsp-balance (car account))
+                                         "\n")))
+                :range (ledger-lsp-range (nth 1 account) (nth 2 account))))))))
+
+(defun ledger-lsp-account-references (account)
+  "Return the locations of the postings to ACCOUNT in the journal."
+  (let ((regex (concat "^" ledger-lsp-posting-regex
+                       "\\(" (regexp-quote account) "\\)"
+                       "\\(?:[])]\\|[ \t][ \t]\\|\t\\|[ \t]*$\\)"))
+        locations)
+    (dolist (buffer ledger-lsp-buffers)
+      (with-current-buffer buffer
+        (save-excursion
+          (save-restriction
+            (widen)
+            (let (found)
+              (maphash (lambda (marker record)
+                         (when (assoc account (aref record 2))
+                           (goto-char marker)
+                           (let ((end (ledger-track-element-end marker)))
+                             (while (re-search-forward regex end t)
+                               (push (cons (match-beginning 1) (match-end 1)) found)))))
+                       ledger-index-xacts)
+              (dolist (match (sort found (lambda (a b) (< (car a) (car b)))))
+                (push (ledger-lsp-location (car match) (cdr match)) locations)))))))
+    (nreverse locations)))
+
+(defun ledger-lsp-account-declaration (account)
+  "Return the location of the account directive of ACCOUNT, or nil."
+  (let ((regex (concat "^account[ \t]+\\(" (regexp-quote account) "\\)[ \t]*$"))
+        location)
+    (dolist (buffer ledger-lsp-buffers)
+      (unless location
+        (with-current-buffer buffer
+          (save-excursion
+            (save-restriction
+              (widen)
+              (goto-char (point-min))
+              (when (re-search-forward regex nil t)
+                (setq location (ledger-lsp-location (match-beginning 1)
+                                                    (match-end 1)))))))))
+    location))
+
+(defun ledger-lsp-account-params (params)
+  "Return the account at the position of PARAMS, or nil."
+  (ledger-lsp-refresh)
+  (with-current-buffer (ledger-lsp-document-buffer params)
+    (save-restriction
+      (widen)
+      (save-excursion
+        (goto-char (ledger-lsp-point (plist-get params :position)))
+        (car (ledger-lsp-account-at-point))))))
+
+(defun ledger-lsp-definition (params)
+  "Return the declaration, or else the first posting, of the account at PARAMS."
+  (let ((account (ledger-lsp-account-params params)))
+    (when account
+      (let ((location (or (ledger-lsp-account-declaration account)
+                          (car (ledger-lsp-account-references account)))))
+        (if location (vector location) [])))))
+
+(defun ledger-lsp-references (params)
+  "Return the postings to the account at the position of PARAMS."
+  (let ((account (ledger-lsp-account-params params)))
+    (if account
+        (vconcat (ledger-lsp-account-references account))
+      [])))
+
+;;; Transport
+
+(defun ledger-lsp-read-line ()
+  "Read a header line from the standard input, without its line ending."
+  (let (chars char)
+    (while (/= (setq char (read-char)) ?\n)
+      (unless (= char ?\r)
+        (push char chars)))
+    (concat (nreverse chars))))
+
+(defun ledger-lsp-read-message ()
+  "Read a message from the standard input and return it as a plist."
+  (let (length line)
+    (while (not (string= (setq line (ledger-lsp-read-line)) ""))
+      (when (string-match "\\`Content-Length:[ \t]*\\([0-9]+\\)" line)
+        (setq length (string-to-number (match-string 1 line)))))
+    (let ((body (make-string (or length 0) 0)))
+      (dotimes (i (length body))
+        (aset body i (read-char)))
+      (let ((json-object-type 'plist)
+            (json-array-type 'list)
+            (json-key-type 'keyword))
+        (json-read-from-string (decode-coding-string body 'utf-8))))))
+
+(defun ledger-lsp-escape (char)
+  "Return the JSON escape of the non-ASCII CHAR."
+  (if (> char #xFFFF)
+      (let ((code (- char #x10000)))
+        (format "\\u%04x\\u%04x"
+                (+ #xD800 (ash code -10))
+                (+ #xDC00 (logand code #x3FF))))
+    (format "\\u%04x" char)))
+
+(defun ledger-lsp-send (message)
+  "Write MESSAGE, a plist, to the standard output."
+  (let ((body (replace-regexp-in-string
+               "[^[:ascii:]]"
+               (lambda (char) (ledger-lsp-escape (string-to-char char)))
+               (json-encode (append '(:jsonrpc "2.0") message))
+               t t)))
+    ;; Unlike `princ', this flushes the standard output after writing.
+    (send-string-to-terminal
+     (format "Content-Length: %d\r\n\r\n%s" (length body) body))))
+
+(defun ledger-lsp-notify (method params)
+  "Send the notification METHOD with PARAMS to the client."
+  (ledger-lsp-send (list :method method :params params)))
+
+(defun ledger-lsp-handle (message)
+  "Handle MESSAGE, answering it if it is a request."
+  (let* ((id (plist-get message :id))
+         (method (plist-get message :method))
+         (handler (cdr (assoc method ledger-lsp-methods))))
+    (cond ((null method))             ; A response to the server.
+          (handler
+           (let ((result (condition-case err
+                             (list :result (funcall handler (plist-get message :params)))
+                           (error
+                            (list :error (list :code -32603
+                                               :message (error-message-string err)))))))
+             (when id
+               (ledger-lsp-send (cons :id (cons id result))))))
+          (id
+           (ledger-lsp-send (list :id id
+                                  :error (list :code -32601
+                                               :message (format "Unknown method %s"
+                                                                method))))))))
+
+(defun ledger-lsp-serve ()
+  "Run the language server over the standard input and output.
+This never returns and is meant for a batch Emacs, see the
+commentary of ledger-lsp.el."
+  (require 'ledger-mode)
+  (setq enable-local-variables :safe)
+  (put 'ledger-master-file 'safe-local-variable #'stringp)
+  ;; Keep the line endings of the headers as they are written.
+  (when (fboundp 'set-binary-mode)
+    (set-binary-mode 'stdin t)
+    (set-binary-mode 'stdout t))
+  (ledger-lsp-start)
+  (while t
+    (ledger-lsp-handle (ledger-lsp-read-message))))
+
+;;; Eglot
+
+(defun ledger-lsp-server-command ()
+  "Return the command running the ledger language server."
+  (list (expand-file-name invocation-name invocation-directory)
+        "--batch" "-Q" "-L" ledger-lsp-directory
+        "-l" "ledger-lsp" "-f" "ledger-lsp-serve"))
+
+(defun ledger-lsp-register-eglot ()
+  "Make eglot use the ledger language server for `ledger-mode' buffers."
+  (add-to-list 'eglot-server-programs
+               (cons 'ledger-mode (ledger-lsp-server-command))))
+
+(when ledger-lsp-register-with-eglot
+  (eval-after-load 'eglot '(ledger-lsp-register-eglot)))
+
+(provide 'ledger-lsp)
+
+;;; ledger-lsp.el ends here
@@ -0,0 +1,349 @@
+;;; ledger-merge.el --- Three-way merge of ledger journals
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Merge two copies of a journal that diverged from a common base.
+;; Rather than lines, the merge compares elements: transactions,
+;; directives and comments.  Each is keyed by its content with layout
+;; normalized, so realigned amounts or reordered postings are no
+;; change at all.  Counting keys in the three versions tells which
+;; elements each side added or removed, and the changes of both
+;; sides are combined.  Only a transaction changed differently on
+;; both sides, or changed on one side and deleted on the other, is a
+;; conflict; it is written with the usual conflict markers.
+;;
+;; To use it as a git merge driver, add to .git/config:
+;;
+;;   [merge "ledger"]
+;;           name = ledger journal merge
+;;           driver = emacs --batch -l ledger-mode -f ledger-merge-batch %O %A %B
+;;
+;; and to .gitattributes:
+;;
+;;   *.ledger merge=ledger
+
+;;; Code:
+
+(require 'ledger-xact)
+
+(declare-function smerge-next "smerge-mode")
+
+(defgroup ledger-merge nil
+  "Options for merging journals."
+  :group 'ledger)
+
+(defcustom ledger-merge-ours-label "ours"
+  "Label of our side in conflict markers."
+  :type 'string
+  :group 'ledger-merge)
+
+(defcustom ledger-merge-theirs-label "theirs"
+  "Label of their side in conflict markers."
+  :type 'string
+  :group 'ledger-merge)
+
+(defun ledger-merge-normalize (text)
+  "Return the key of the element TEXT.
+Blanks are collapsed and the postings are sorted, each with the
+comment lines following it, so that layout does not count."
+  (let* ((lines (delete "" (mapcar (lambda (line)
+                                     (replace-regexp-in-string
+                                      "[ \t]+" " " (ledger-xact-trim line)))
+                                   (split-string text "\n"))))
+         units)
+    (dolist (line (cdr lines))
+      (if (and units (string-prefix-p ";" line))
+          (setcar units (concat (car units) "\n" line))
+        (push line units)))
+    (mapconcat 'identity (cons (car lines) (sort units 'string<)) "\n")))
+
+(defun ledger-merge-elements (text)
+  "Split the journal TEXT into elements.
+An element starts on a line that is not indented and extends
+over the indented and blank lines following it.  Each element is
+a vector [TEXT KEY IDENTITY DATE]; IDENTITY and DATE are nil but
+for transactions, whose IDENTITY is their date and payee."
+  (with-temp-buffer
+    (insert text)
+    (goto-char (point-min))
+    (let (elements)
+      (while (not (eobp))
+        (let ((beg (point))
+              (xact (ledger-xact-parse-at (point))))
+          (forward-line)
+          (while (and (not (eobp))
+                      (looking-at "[ \t]\\|$"))
+            (forward-line))
+          (let ((element (buffer-substring-no-properties beg (point)))
+                (date (plist-get xact :date)))
+            (push (vector element
+                          (ledger-merge-normalize element)
+                          (when date
+                            (concat (format-time-string "%Y/%m/%d" date)
+                                    " " (plist-get xact :payee)))
+                          date)
+                  elements))))
+      (nreverse elements))))
+
+(defun ledger-merge-count (elements)
+  "Return a hash table counting the keys of ELEMENTS."
+  (let ((counts (make-hash-table :test 'equal)))
+    (dolist (element elements)
+      (puthash (aref element 1)
+               (1+ (gethash (aref element 1) counts 0))
+               counts))
+    counts))
+
+(defun ledger-merge-resolve-count (base ours theirs)
+  "Return the merged count of a key counted BASE, OURS and THEIRS times.
+A change made on both sides is taken once."
+  (cond ((= ours theirs) ours)
+        ((= ours base) theirs)
+        ((= theirs base) ours)
+        (t (max 0 (- (+ ours theirs) base)))))
+
+(defun ledger-merge-changes (elements counts base-counts test)
+  "Group the ELEMENTS whose key COUNTS compare to BASE-COUNTS by TEST.
+Return a hash table mapping each transaction identity to the list
+of its elements whose key is counted more (TEST `>') or less
+\(TEST `<') than in the base."
+  (let ((changes (make-hash-table :test 'equal))
+        (seen (make-hash-table :test 'equal)))
+    (dolist (element elements)
+      (let ((key (aref element 1))
+            (identity (aref element 2)))
+        (when (and identity
+                   (not (gethash key seen))
+                   (funcall test
+                            (gethash key counts 0)
+                            (gethash key base-counts 0)))
+          (puthash key t seen)
+          (puthash identity (cons element (gethash identity changes)) changes))))
+    changes))
+
+(defun ledger-merge-find-conflicts (base ours theirs counts)
+  "Return the conflicts between the changes of OURS and THEIRS to BASE.
+BASE, OURS and THEIRS are element lists and COUNTS the list of
+their key counts.  Each conflict is a vector [OURS BASE THEIRS]
+of elements, OURS or THEIRS being nil for a deletion."
+  (let* ((base-counts (nth 0 counts))
+         (ours-removed (ledger-merge-changes base (nth 1 counts) base-counts '<))
+         (theirs-removed (ledger-merge-changes base (nth 2 counts) base-counts '<))
+         (ours-added (ledger-merge-changes ours (nth 1 counts) base-counts '>))
+         (theirs-added (ledger-merge-changes theirs (nth 2 counts) base-counts '>))
+         conflicts)
+    (maphash
+     (lambda (identity removed)
+       (let ((theirs-gone (gethash identity theirs-removed))
+             (ours-new (gethash identity ours-added))
+             (theirs-new (gethash identity theirs-added)))
+         ;; Only unambiguous pairings of one transaction are judged.
+         (when (and (null (cdr removed))
+                    (equal theirs-gone removed)
+                    (null (cdr ours-new))
+                    (null (cdr theirs-new))
+                    (or ours-new theirs-new)
+                    (not (and ours-new theirs-new
+                              (equal (aref (car ours-new) 1)
+                                     (aref (car theirs-new) 1)))))
+           (push (vector (car ours-new) (car removed) (car theirs-new))
+                 conflicts))))
+     ours-removed)
+    conflicts))
+
+(defun ledger-merge-chunk (element)
+  "Return the text of ELEMENT for a conflict block, or the empty string."
+  (if element
+      (concat (replace-regexp-in-string "[ \t\n]+\\'" "" (aref element 0)) "\n")
+    ""))
+
+(defun ledger-merge-insert (element)
+  "Insert the text of ELEMENT, separated from a preceding transaction."
+  (unless (or (bobp) (eq (char-before) ?\n))
+    (insert "\n"))
+  (when (and (aref element 3)
+             (not (bobp))
+             (not (looking-back "\n\n" nil)))
+    (insert "\n"))
+  (insert (aref element 0)))
+
+(defun ledger-merge-insert-conflict (conflict)
+  "Insert CONFLICT between conflict markers."
+  (ledger-merge-insert
+   (vector (concat "<<<<<<< " ledger-merge-ours-label "\n"
+                   (ledger-merge-chunk (aref conflict 0))
+                   "||||||| base\n"
+                   (ledger-merge-chunk (aref conflict 1))
+                   "=======\n"
+                   (ledger-merge-chunk (aref conflict 2))
+                   ">>>>>>> " ledger-merge-theirs-label "\n\n")
+           nil nil (aref (aref conflict 1) 3))))
+
+(defun ledger-merge-strings (base ours theirs)
+  "Merge the journals OURS and THEIRS, which diverged from BASE.
+Return (TEXT . CONFLICTS), TEXT being the merged journal and
+CONFLICTS the number of conflicts marked in it.
+
+The merge follows the order of OURS.  Elements added by THEIRS
+are inserted in date order, or after the element preceding them
+in THEIRS if they are not transactions."
+  (let* ((base (ledger-merge-elements base))
+         (ours (ledger-merge-elements ours))
+         (theirs (ledger-merge-elements theirs))
+         (counts (list (ledger-merge-count base)
+                       (ledger-merge-count ours)
+                       (ledger-merge-count theirs)))
+         (conflicts (ledger-merge-find-conflicts base ours theirs counts))
+         (ours-conflicts (make-hash-table :test 'equal))
+         (wanted (make-hash-table :test 'equal))
+         (anchored (make-hash-table :test 'equal))
+         dated
+         trailing)
+    ;; Merged count of each key, conflicting keys being left out.
+    (dolist (table counts)
+      (maphash (lambda (key _count)
+                 (puthash key (ledger-merge-resolve-count
+                               (gethash key (nth 0 counts) 0)
+                               (gethash key (nth 1 counts) 0)
+                               (gethash key (nth 2 counts) 0))
+                          wanted))
+               table))
+    (dolist (conflict conflicts)
+      (dolist (element (append conflict nil))
+        (when element
+          (puthash (aref element 1) 0 wanted)))
+      (if (aref conflict 0)
+          (puthash (aref (aref conflict 0) 1) conflict ours-conflicts)
+        (push conflict dated)))
+    ;; Elements of THEIRS wanted more often than OURS has them.
+    (let ((needed (make-hash-table :test 'equal))
+          (anchor nil))
+      (dolist (element theirs)
+        (let* ((key (aref element 1))
+               (need (gethash key needed
+                              (- (gethash key wanted 0)
+                                 (gethash key (nth 1 counts) 0)))))
+          (if (<= need 0)
+              (when (> (gethash key (nth 1 counts) 0) 0)
+                (setq anchor key))
+            (puthash key (1- need) needed)
+            (cond ((aref element 3)
+                   (push element dated))
+                  (anchor
+                   (puthash anchor (cons element (gethash anchor anchored))
+                            anchored))
+                  (t
+                   (push element trailing)))))))
+    (setq dated (sort (nreverse dated)
+                      (lambda (a b)
+                        (ledger-time-less-p (ledger-merge-date a)
+                                            (ledger-merge-date b)))))
+    (with-temp-buffer
+      (let ((emitted (make-hash-table :test 'equal)))
+        (dolist (element ours)
+          (let ((key (aref element 1))
+                (date (aref element 3)))
+            (when date
+              (while (and dated
+                          (ledger-time-less-p (ledger-merge-date (car dated)) date))
+                (ledger-merge-insert-any (pop dated))))
+            (let ((conflict (gethash key ours-conflicts)))
+              (cond (conflict
+                     (remhash key ours-conflicts)
+                     (ledger-merge-insert-conflict conflict))
+                    ((< (gethash key emitted 0) (gethash key wanted 0))
+                     (puthash key (1+ (gethash key emitted 0)) emitted)
+                     (ledger-merge-insert element))))
+            (dolist (added (reverse (gethash key anchored)))
+              (ledger-merge-insert added))
+            (remhash key anchored))))
+      (mapc 'ledger-merge-insert-any dated)
+      (mapc 'ledger-merge-insert (nreverse trailing))
+      (unless (or (bobp) (eq (char-before) ?\n))
+        (insert "\n"))
+      (cons (buffer-string) (length conflicts)))))
+
+(defun ledger-merge-date (item)
+  "Return the date of ITEM, an element or a conflict."
+  (if (= (length item) 3)
+      (aref (aref item 1) 3)
+    (aref item 3)))
+
+(defun ledger-merge-insert-any (item)
+  "Insert ITEM, an element or a conflict."
+  (if (= (length item) 3)
+      (ledger-merge-insert-conflict item)
+    (ledger-merge-insert item)))
+
+(defun ledger-merge-read-file (file)
+  "Return the contents of FILE."
+  (with-temp-buffer
+    (insert-file-contents file)
+    (buffer-string)))
+
+(defun ledger-merge-files (base theirs)
+  "Merge into the current buffer the changes of THEIRS since BASE.
+BASE and THEIRS are files holding the common ancestor of the
+current journal and the other copy of it.  Conflicts are marked
+and `smerge-mode' is turned on to resolve them."
+  (interactive
+   (list (read-file-name "Base version: " nil nil t)
+         (read-file-name "Their version: " nil nil t)))
+  (let ((result (ledger-merge-strings
+                 (ledger-merge-read-file base)
+                 (save-restriction
+                   (widen)
+                   (buffer-substring-no-properties (point-min) (point-max)))
+                 (ledger-merge-read-file theirs))))
+    (save-restriction
+      (widen)
+      (let ((point (point)))
+        (delete-region (point-min) (point-max))
+        (insert (car result))
+        (goto-char (min point (point-max)))))
+    (if (zerop (cdr result))
+        (message "Merged without conflicts")
+      (smerge-mode 1)
+      (goto-char (point-min))
+      (smerge-next)
+      (message "Merged with %d conflicts" (cdr result)))))
+
+(defun ledger-merge-batch ()
+  "Merge the journals named on the command line, as a git merge driver.
+The arguments are the base, our and their files.  The result is
+written to our file; Emacs exits with status 1 if it has
+conflicts."
+  (let ((base (nth 0 command-line-args-left))
+        (ours (nth 1 command-line-args-left))
+        (theirs (nth 2 command-line-args-left)))
+    (setq command-line-args-left nil)
+    (unless theirs
+      (error "Usage: emacs --batch -l ledger-mode -f ledger-merge-batch BASE OURS THEIRS"))
+    (let ((result (ledger-merge-strings (ledger-merge-read-file base)
+                                        (ledger-merge-read-file ours)
+                                        (ledger-merge-read-file theirs))))
+      (with-temp-file ours
+        (insert (car result)))
+      (kill-emacs (if (zerop (cdr result)) 0 1)))))
+
+(provide 'ledger-merge)
+
+;;; ledger-merge.el ends here
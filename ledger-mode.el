@@ -50,9 +50,28 @@
 (require 'ledger-state)
 (require 'ledger-test)
 (require 'ledger-texi)
+(require 'ledger-track)
+(require 'ledger-verify)
 (require 'ledger-xact)
 (require 'ledger-schedule)
+(require 'ledger-merge)
+(require 'ledger-revert)
+(require 'ledger-search)
+(require 'ledger-window)
 (require 'ledger-check)
+(require 'ledger-index)
+(require 'ledger-recur)
+(require 'ledger-anomaly)
+(require 'ledger-lsp)
+(require 'ledger-closed)
+(require 'ledger-query)
+(require 'ledger-sum)
+(require 'ledger-stats)
+(require 'ledger-compare)
+(require 'ledger-tree)
+(require 'ledger-lots)
+(require 'ledger-prices)
+(require 'ledger-snapshot)
 
 ;;; Code:
 
@@ -275,10 +294,19 @@ With a prefix argument, remove the effective date."
   "Ledger menu"
   '("Ledger"
     ["Narrow to REGEX" ledger-occur]
+    ["Search Transactions" ledger-search]
     ["Show all transactions" ledger-occur-mode ledger-occur-mode]
     ["Ledger Statistics" ledger-display-ledger-stats ledger-works]
+    ["Journal Statistics" ledger-stats]
+    ["Browse Account Tree" ledger-tree]
+    ["Commodity Lots and Gains" ledger-lots]
     "---"
     ["Show upcoming transactions" ledger-schedule-upcoming]
+    ["Propose Scheduled Transactions" ledger-recur-propose]
+    ["Find Spending Anomalies" ledger-anomaly]
+    ["Close Period" ledger-closed-record]
+    ["Compare Balances Between Revisions" ledger-compare-revisions]
+    ["Compare Report Snapshots" ledger-snapshot-compare]
     ["Add Transaction (ledger xact)" ledger-add-transaction ledger-works]
     ["Complete Transaction" ledger-fully-complete-xact]
     ["Delete Transaction" ledger-delete-current-transaction]
@@ -300,6 +328,7 @@ With a prefix argument, remove the effective date."
     ["Sort Buffer" ledger-sort-buffer]
     ["Mark Sort Beginning" ledger-sort-insert-start-mark]
     ["Mark Sort End" ledger-sort-insert-end-mark]
+    ["Keep Sorted" ledger-sort-keep-mode]
     ["Set effective date" ledger-insert-effective-date]
     "---"
     ["Customize Ledger Mode" (lambda () (interactive) (customize-group 'ledger))]
@@ -321,8 +350,9 @@ With a prefix argument, remove the effective date."
 
   (setq-local pcomplete-parse-arguments-function 'ledger-parse-arguments)
   (setq-local pcomplete-command-completion-function 'ledger-complete-at-point)
-  (add-hook 'completion-at-point-functions 'pcomplete-completions-at-point nil t)
+  (add-hook 'completion-at-point-functions 'ledger-complete-completions-at-point nil t)
   (add-hook 'after-save-hook 'ledger-report-redo nil t)
+  (setq-local revert-buffer-function 'ledger-revert-buffer)
 
   (add-hook 'post-command-hook 'ledger-highlight-xact-under-point nil t)
 
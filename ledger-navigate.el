@@ -27,6 +27,7 @@
 
 (require 'ledger-regex)
 (require 'ledger-context)
+(require 'ledger-verify)
 
 (defun ledger-navigate-next-xact ()
   "Move point to beginning of next xact."
@@ -83,10 +84,382 @@
   (end-of-line)
   (point))
 
+;; Ledger reports locations as line numbers.  Rather than walking the
+;; buffer from its start for each of them, the starts of its lines
+;; are kept in a table updated as the buffer is edited.  The table is
+;; split in chunks, so an edit only rescans the chunks it touches and
+;; shifts the positions of the following ones.
+
+(defvar ledger-navigate-line-chunk-size 256
+  "Maximum number of lines in a chunk of the line table.")
+
+(defvar-local ledger-navigate-lines nil
+  "Table of the line starts of the buffer, or nil if not built yet.
+This is a vector of chunks, each a vector [FIRST BASE OFFSETS]
+where FIRST is the number of the first line of the chunk, BASE the
+position of its start and OFFSETS a vector of the offsets from
+BASE of the starts of its lines.")
+
+(defun ledger-navigate-scan-lines (beg &optional end)
+  "Return the chunks of the lines starting from BEG up to END.
+BEG is the start of a line and END the start of the line after
+the last one, or nil for the end of the buffer.  The chunks are
+left unnumbered."
+  (save-excursion
+    (goto-char beg)
+    (let ((base beg)
+          (offsets (list 0))
+          (count 1)
+          chunks)
+      (while (search-forward "\n" end t)
+        (when (or (null end) (< (point) end))
+          (when (= count ledger-navigate-line-chunk-size)
+            (push (vector 0 base (vconcat (nreverse offsets))) chunks)
+            (setq base (point)
+                  offsets nil
+                  count 0))
+          (push (- (point) base) offsets)
+          (setq count (1+ count))))
+      (push (vector 0 base (vconcat (nreverse offsets))) chunks)
+      (nreverse chunks))))
+
+(defun ledger-navigate-number-lines (from)
+  "Number the lines of the chunks of the line table from index FROM."
+  (let* ((table ledger-navigate-lines)
+         (line (if (zerop from)
+                   1
+                 (let ((previous (aref table (1- from))))
+                   (+ (aref previous 0) (length (aref previous 2))))))
+         (index from))
+    (while (< index (length table))
+      (aset (aref table index) 0 line)
+      (setq line (+ line (length (aref (aref table index) 2)))
+            index (1+ index)))))
+
+(defun ledger-navigate-chunk-index (key value)
+  "Return the index of the last chunk whose element KEY is at most VALUE.
+KEY is 0 to search by line number and 1 by position."
+  (let* ((table ledger-navigate-lines)
+         (low 0)
+         (high (1- (length table))))
+    (while (< low high)
+      (let ((mid (/ (+ low high 1) 2)))
+        (if (<= (aref (aref table mid) key) value)
+            (setq low mid)
+          (setq high (1- mid)))))
+    low))
+
+(defun ledger-navigate-lines-enable ()
+  "Build the line table of the current buffer if it does not exist."
+  (unless ledger-navigate-lines
+    (save-match-data
+      (save-restriction
+        (widen)
+        (setq ledger-navigate-lines
+              (vconcat (ledger-navigate-scan-lines (point-min))))
+        (ledger-navigate-number-lines 0)))
+    (add-hook 'after-change-functions 'ledger-navigate-lines-after-change nil t)))
+
+(defun ledger-navigate-lines-after-change (beg end len)
+  "Update the line table for the change of LEN chars into BEG to END."
+  (when ledger-navigate-lines
+    (save-match-data
+      (save-restriction
+        (widen)
+        (let* ((table ledger-navigate-lines)
+               (delta (- end beg len))
+               (first (ledger-navigate-chunk-index 1 beg))
+               (next (1+ (ledger-navigate-chunk-index 1 (+ beg len))))
+               (index next))
+          (while (< index (length table))
+            (let ((chunk (aref table index)))
+              (aset chunk 1 (+ (aref chunk 1) delta)))
+            (setq index (1+ index)))
+          (setq ledger-navigate-lines
+                (vconcat (substring table 0 first)
+                         (ledger-navigate-scan-lines
+                          (aref (aref table first) 1)
+                          (when (< next (length table))
+                            (aref (aref table next) 1)))
+                         (substring table next)))
+          (ledger-navigate-number-lines first))))))
+
+(defun ledger-navigate-line-position (line-number)
+  "Return the position of the start of line LINE-NUMBER.
+Lines are counted from the start of the buffer, ignoring any
+narrowing.  Past the last line, return the end of the buffer."
+  (ledger-navigate-lines-enable)
+  (let* ((chunk (aref ledger-navigate-lines
+                      (ledger-navigate-chunk-index 0 (max line-number 1))))
+         (index (- (max line-number 1) (aref chunk 0))))
+    (if (< index (length (aref chunk 2)))
+        (+ (aref chunk 1) (aref (aref chunk 2) index))
+      (save-restriction
+        (widen)
+        (point-max)))))
+
+(defun ledger-navigate-line-number (pos)
+  "Return the number of the line at POS, counted as `ledger-navigate-line-position'."
+  (ledger-navigate-lines-enable)
+  (let* ((chunk (aref ledger-navigate-lines (ledger-navigate-chunk-index 1 pos)))
+         (offsets (aref chunk 2))
+         (offset (- pos (aref chunk 1)))
+         (low 0)
+         (high (1- (length offsets))))
+    (while (< low high)
+      (let ((mid (/ (+ low high 1) 2)))
+        (if (<= (aref offsets mid) offset)
+            (setq low mid)
+          (setq high (1- mid)))))
+    (+ (aref chunk 0) low)))
+
+(defun ledger-navigate-lines-snapshot ()
+  "Return the line starts recorded in the line table."
+  (if (null ledger-navigate-lines)
+      :inactive
+    (let (starts)
+      (mapc (lambda (chunk)
+              (mapc (lambda (offset)
+                      (push (+ (aref chunk 1) offset) starts))
+                    (aref chunk 2)))
+            ledger-navigate-lines)
+      (nreverse starts))))
+
+(defun ledger-navigate-lines-scan ()
+  "Return the line starts of the buffer, scanning it from scratch."
+  (save-excursion
+    (save-restriction
+      (widen)
+      (goto-char (point-min))
+      (let ((starts (list (point))))
+        (while (search-forward "\n" nil t)
+          (push (point) starts))
+        (nreverse starts)))))
+
+(ledger-verify-register 'ledger-navigate-lines
+                        'ledger-navigate-lines-snapshot
+                        'ledger-navigate-lines-scan)
+
 (defun ledger-navigate-to-line (line-number)
   "Rapidly move point to line LINE-NUMBER."
-  (goto-char (point-min))
-  (forward-line (1- line-number)))
+  (if (buffer-narrowed-p)
+      (progn
+        (goto-char (point-min))
+        (forward-line (1- line-number)))
+    (goto-char (ledger-navigate-line-position line-number))))
+
+;; Comment blocks, runs of lines starting with ";" and the blocks of
+;; the "comment", "test" and "!comment" directives, are kept in an
+;; index updated as the buffer is edited, so finding the block around
+;; a position does not walk its lines.
+
+(defconst ledger-navigate-comment-start-regex
+  (concat "^ *;\\|" ledger-multiline-comment-start-regex
+          "\\|" ledger-comment-directive-start-regex)
+  "Regexp matching the first line of a comment block.")
+
+(defvar-local ledger-navigate-comments nil
+  "Vector of the comment blocks of the buffer, or nil if not built yet.
+Each block is a list (BEG END KIND), BEG being the start of its
+first line and END the start of the line after its last one.
+KIND is `lines' for a run of lines starting with \";\" and `block'
+for the block of a directive.  Blocks are in buffer order.  The
+positions of the blocks from the index in
+`ledger-navigate-comments-shift' on are off by its delta.")
+
+(defvar-local ledger-navigate-comments-shift nil
+  "Pending shift of the comment index, a pair (INDEX . DELTA).
+DELTA is yet to be added to the positions of the blocks of
+`ledger-navigate-comments' from INDEX on.  Edits in the same area
+move the same blocks, so rather than shifting every block after
+an edit, the shift is only moved when an edit is elsewhere.")
+
+(defun ledger-navigate-next-comment (pos limit)
+  "Return the first comment block starting from POS and before LIMIT, or nil.
+POS is the start of a line.  The block may extend past LIMIT."
+  (save-excursion
+    (goto-char pos)
+    (when (re-search-forward ledger-navigate-comment-start-regex limit t)
+      (let ((beg (match-beginning 0))
+            (kind 'block))
+        (goto-char beg)
+        (cond ((looking-at " *;")
+               (setq kind 'lines)
+               (while (and (looking-at " *;")
+                           (zerop (forward-line)))))
+              ((looking-at "!")
+               (forward-line)
+               (when (re-search-forward ledger-multiline-comment-end-regex nil 'move)
+                 (forward-line)))
+              (t
+               (forward-line)
+               (when (re-search-forward ledger-comment-directive-end-regex nil 'move)
+                 (forward-line))))
+        (list beg (point) kind)))))
+
+(defun ledger-navigate-scan-comments (beg end &optional following)
+  "Return the comment blocks starting from BEG up to END.
+BEG is the start of a line.  FOLLOWING are the blocks known to
+come after END; those a new block overlaps are dropped and the
+text they covered scanned again.  Return (BLOCKS . FOLLOWING)
+with the blocks left of FOLLOWING."
+  (let ((pos beg)
+        blocks)
+    (while (< pos end)
+      (let ((block (ledger-navigate-next-comment pos end)))
+        (if (null block)
+            (setq pos end)
+          (push block blocks)
+          (setq pos (nth 1 block))
+          (while (and following (< (car (car following)) pos))
+            (setq end (max end (nth 1 (car following)))
+                  following (cdr following))))))
+    (cons (nreverse blocks) following)))
+
+(defun ledger-navigate-comments-enable ()
+  "Build the comment index of the current buffer if it does not exist."
+  (unless ledger-navigate-comments
+    (save-match-data
+      (save-restriction
+        (widen)
+        (setq ledger-navigate-comments
+              (vconcat (car (ledger-navigate-scan-comments (point-min) (point-max))))
+              ledger-navigate-comments-shift
+              (cons (length ledger-navigate-comments) 0))))
+    (add-hook 'after-change-functions 'ledger-navigate-comments-after-change nil t)))
+
+(defun ledger-navigate-comment-block (index)
+  "Return the comment block at INDEX of the comment index."
+  (let ((block (aref ledger-navigate-comments index))
+        (shift ledger-navigate-comments-shift))
+    (if (and (>= index (car shift)) (/= (cdr shift) 0))
+        (list (+ (car block) (cdr shift)) (+ (nth 1 block) (cdr shift)) (nth 2 block))
+      block)))
+
+(defun ledger-navigate-comments-add (from to delta)
+  "Add DELTA to the positions of the blocks from index FROM up to TO."
+  (while (< from to)
+    (let ((block (aref ledger-navigate-comments from)))
+      (aset ledger-navigate-comments from
+            (list (+ (car block) delta) (+ (nth 1 block) delta) (nth 2 block))))
+    (setq from (1+ from))))
+
+(defun ledger-navigate-comments-move-shift (index)
+  "Make the pending shift of the comment index start at INDEX.
+Only the blocks between its old and new start are updated."
+  (let ((shift ledger-navigate-comments-shift))
+    (cond ((< (car shift) index)
+           (ledger-navigate-comments-add (car shift) index (cdr shift)))
+          ((> (car shift) index)
+           (ledger-navigate-comments-add index (car shift) (- (cdr shift)))))
+    (setcar shift index)))
+
+(defun ledger-navigate-comments-search (pos key)
+  "Return the index of the first comment block whose KEY is after POS.
+KEY is 0 for the start of the blocks and 1 for their end."
+  (let ((low 0)
+        (high (length ledger-navigate-comments)))
+    (while (< low high)
+      (let ((mid (/ (+ low high) 2)))
+        (if (<= (nth key (ledger-navigate-comment-block mid)) pos)
+            (setq low (1+ mid))
+          (setq high mid))))
+    low))
+
+(defun ledger-navigate-comments-after-change (beg end len)
+  "Update the comment index for the change of LEN chars into BEG to END.
+Only the blocks around the change are looked at and scanned again;
+those after it are shifted lazily, see `ledger-navigate-comments-shift'."
+  (when ledger-navigate-comments
+    (save-excursion
+      (save-match-data
+        (save-restriction
+          (widen)
+          (let* ((delta (- end beg len))
+                 (from (progn (goto-char beg) (line-beginning-position)))
+                 (to (progn (goto-char end) (forward-line) (point)))
+                 ;; Blocks ending before the changed lines are left
+                 ;; alone, those starting after the change are shifted.
+                 (first (ledger-navigate-comments-search (1- from) 1))
+                 (after (ledger-navigate-comments-search (+ beg len) 0))
+                 (count (length ledger-navigate-comments))
+                 (last after)
+                 (shift ledger-navigate-comments-shift)
+                 (pos nil)
+                 blocks)
+            (ledger-navigate-comments-move-shift after)
+            (setcdr shift (+ (cdr shift) delta))
+            ;; A block ending at the changed lines may now extend into
+            ;; them, and one starting right after them may be joined.
+            (let ((index first))
+              (while (< index after)
+                (let ((block (aref ledger-navigate-comments index)))
+                  (setq from (min from (car block))
+                        to (max to (car block) (+ (nth 1 block) delta))))
+                (setq index (1+ index))))
+            (while (and (< last count)
+                        (<= (car (ledger-navigate-comment-block last)) to))
+              (setq to (max to (nth 1 (ledger-navigate-comment-block last)))
+                    last (1+ last)))
+            (setq to (min to (point-max))
+                  pos from)
+            (while (< pos to)
+              (let ((block (ledger-navigate-next-comment pos to)))
+                (if (null block)
+                    (setq pos to)
+                  (push block blocks)
+                  (setq pos (nth 1 block))
+                  ;; A new block may swallow those following it.
+                  (while (and (< last count)
+                              (< (car (ledger-navigate-comment-block last)) pos))
+                    (setq to (max to (nth 1 (ledger-navigate-comment-block last)))
+                          last (1+ last))))))
+            (setq blocks (nreverse blocks))
+            (ledger-navigate-comments-move-shift last)
+            (if (= (length blocks) (- last first))
+                (let ((index first))
+                  (dolist (block blocks)
+                    (aset ledger-navigate-comments index block)
+                    (setq index (1+ index))))
+              (setq ledger-navigate-comments
+                    (vconcat (substring ledger-navigate-comments 0 first)
+                             blocks
+                             (substring ledger-navigate-comments last)))
+              (setcar shift (+ first (length blocks))))))))))
+
+(defun ledger-navigate-comment-at (pos)
+  "Return the comment block (BEG END KIND) containing POS, or nil.
+BEG and END are limited to the accessible part of the buffer."
+  (ledger-navigate-comments-enable)
+  (let* ((index (1- (ledger-navigate-comments-search pos 0)))
+         (block (and (>= index 0) (ledger-navigate-comment-block index))))
+    (when (and block
+               (or (< pos (nth 1 block))
+                   ;; The last line of the buffer, without a newline.
+                   (and (= pos (nth 1 block) (1+ (buffer-size)))
+                        (/= (char-before pos) ?\n))))
+      (list (max (car block) (point-min))
+            (min (nth 1 block) (point-max))
+            (nth 2 block)))))
+
+(defun ledger-navigate-comments-snapshot ()
+  "Return the blocks recorded in the comment index."
+  (if (null ledger-navigate-comments)
+      :inactive
+    (let (blocks)
+      (dotimes (index (length ledger-navigate-comments))
+        (push (ledger-navigate-comment-block index) blocks))
+      (nreverse blocks))))
+
+(defun ledger-navigate-comments-scan ()
+  "Return the comment blocks of the buffer, scanning it from scratch."
+  (save-restriction
+    (widen)
+    (car (ledger-navigate-scan-comments (point-min) (point-max)))))
+
+(ledger-verify-register 'ledger-navigate-comments
+                        'ledger-navigate-comments-snapshot
+                        'ledger-navigate-comments-scan)
 
 (defun ledger-navigate-find-xact-extents (pos)
   "Return list containing point for beginning and end of xact containing POS.
@@ -100,56 +473,23 @@ Requires empty line separating xacts."
 (defun ledger-navigate-find-directive-extents (pos)
   "Return the extents of the directive at POS."
   (goto-char pos)
-  (let ((begin (progn (beginning-of-line)
-                      (point)))
-        (end (progn (end-of-line)
-                    (+ 1 (point)))))
-    ;; handle block comments here
-    (beginning-of-line)
-    (if (looking-at " *;")
-        (progn
-          (while (and (looking-at " *;")
-                      (> (point) (point-min)))
-            (forward-line -1))
-          ;; We are either at the beginning of the buffer, or we found
-          ;; a line outside the comment.  If we are not at the
-          ;; beginning of the buffer then we need to move forward a
-          ;; line.
-          (if (> (point) (point-min))
-              (progn (forward-line 1)
-                     (beginning-of-line)))
-          (setq begin (point))
-          (goto-char pos)
-          (beginning-of-line)
-          (while (and (looking-at " *;")
-                      (< (point) (point-max)))
-            (forward-line 1))
-          (setq end (point))))
-    (list begin end)))
+  (let ((block (ledger-navigate-comment-at (line-beginning-position))))
+    (if block
+        (list (car block) (nth 1 block))
+      (list (line-beginning-position)
+            (1+ (line-end-position))))))
 
 (defun ledger-navigate-block-comment (pos)
   "Move past the block comment at POS, and return its extents."
   (interactive "d")
   (goto-char pos)
-  (let ((begin (progn (beginning-of-line)
-                      (point)))
-        (end (progn (end-of-line)
-                    (point))))
-    ;; handle block comments here
-    (beginning-of-line)
-    (if (looking-at " *;")
+  (beginning-of-line)
+  (let ((block (ledger-navigate-comment-at (point))))
+    (if block
         (progn
-          (while (and (looking-at " *;")
-                      (> (point) (point-min)))
-            (forward-line -1))
-          (setq begin (point))
-          (goto-char pos)
-          (beginning-of-line)
-          (while (and (looking-at " *;")
-                      (< (point) (point-max)))
-            (forward-line 1))
-          (setq end (point))))
-    (list begin end)))
+          (goto-char (nth 1 block))
+          (list (car block) (nth 1 block)))
+      (list (line-beginning-position) (line-end-position)))))
 
 
 (defun ledger-navigate-find-element-extents (pos)
@@ -158,9 +498,13 @@ Requires empty line separating xacts."
   (save-excursion
     (goto-char pos)
     (beginning-of-line)
-    (if (looking-at "[ =~0-9\\[]")
-        (ledger-navigate-find-xact-extents pos)
-      (ledger-navigate-find-directive-extents pos))))
+    (let ((block (ledger-navigate-comment-at (point))))
+      (cond ((and block (eq (nth 2 block) 'block))
+             (list (car block) (nth 1 block)))
+            ((looking-at "[ =~0-9\\[]")
+             (ledger-navigate-find-xact-extents pos))
+            (t
+             (ledger-navigate-find-directive-extents pos))))))
 
 
 (provide 'ledger-navigate)
@@ -0,0 +1,208 @@
+;;; ledger-prices.el --- Mode for price database files
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; A price database holds little more than P directives, often
+;; hundreds of thousands of them, for which the parsing of
+;; transactions done by `ledger-mode' is wasted.  `ledger-prices-mode'
+;; fontifies each run of P lines at once, and keeps an index mapping
+;; each commodity to the positions of its prices sorted by date, so
+;; the price of a commodity on a date is found by a binary search.
+;; Prices appended at the end of the file are added to the index;
+;; only an edit before them makes it rebuilt, when next needed.
+;;
+;; To use it for a price file, add an entry to `auto-mode-alist', as
+;; in (add-to-list 'auto-mode-alist '("prices\\.db\\'" . ledger-prices-mode)).
+
+;;; Code:
+
+(require 'ledger-fontify)
+(require 'ledger-regex)
+(require 'ledger-xact) ; for ledger-parse-iso-date
+
+(declare-function ledger-read-date "ledger-mode" (prompt))
+
+(defvar-local ledger-prices-index nil
+  "Hash table mapping each commodity to its prices, or nil if not built.
+The prices of a commodity are a pair (ENTRIES . COUNT): the first
+COUNT elements of the vector ENTRIES are the [DAY POSITION] of its
+P directives, sorted by day number and then by position.")
+
+(defvar-local ledger-prices-indexed-end nil
+  "Position up to which the P directives are in `ledger-prices-index'.")
+
+(defun ledger-prices-day (date)
+  "Return the day number of the string DATE, or nil."
+  (let ((time (ledger-parse-iso-date date)))
+    (when time
+      (time-to-days time))))
+
+(defun ledger-prices-commodity (commodity)
+  "Return COMMODITY without its quotes."
+  (if (eq (aref commodity 0) ?\")
+      (substring commodity 1 -1)
+    commodity))
+
+(defun ledger-prices-search (prices day)
+  "Return the index of the first of PRICES dated after DAY.
+PRICES are those of a commodity in `ledger-prices-index'."
+  (let ((entries (car prices))
+        (low 0)
+        (high (cdr prices)))
+    (while (< low high)
+      (let ((middle (/ (+ low high) 2)))
+        (if (> (aref (aref entries middle) 0) day)
+            (setq high middle)
+          (setq low (1+ middle)))))
+    low))
+
+(defun ledger-prices-add (commodity day position)
+  "Add the price of COMMODITY on DAY at POSITION to the index."
+  (let* ((prices (or (gethash commodity ledger-prices-index)
+                     (puthash commodity (cons (make-vector 16 nil) 0)
+                              ledger-prices-index)))
+         (count (cdr prices))
+         (slot (ledger-prices-search prices day)))
+    (when (= count (length (car prices)))
+      (setcar prices (vconcat (car prices) (make-vector count nil))))
+    ;; Prices mostly come in date order: nothing is shifted then.
+    (let ((entries (car prices))
+          (i count))
+      (while (> i slot)
+        (aset entries i (aref entries (1- i)))
+        (setq i (1- i)))
+      (aset entries slot (vector day position)))
+    (setcdr prices (1+ count))))
+
+(defun ledger-prices-update ()
+  "Bring the price index of the buffer up to date and return it.
+Only the complete lines after `ledger-prices-indexed-end' are read."
+  (save-excursion
+    (save-restriction
+      (save-match-data
+        (widen)
+        (unless ledger-prices-index
+          (setq ledger-prices-index (make-hash-table :test 'equal)
+                ledger-prices-indexed-end (point-min)))
+        (let ((limit (progn (goto-char (point-max))
+                            (line-beginning-position))))
+          (goto-char ledger-prices-indexed-end)
+          (while (re-search-forward ledger-price-directive-regex limit t)
+            (let ((day (ledger-prices-day (match-string-no-properties 1))))
+              (when day
+                (ledger-prices-add (ledger-prices-commodity (match-string-no-properties 2))
+                                   day
+                                   (match-beginning 0)))))
+          (setq ledger-prices-indexed-end (max limit ledger-prices-indexed-end))))))
+  ledger-prices-index)
+
+(defun ledger-prices-after-change (beg _end _len)
+  "Drop the price index if the change at BEG is not past it."
+  (when (and ledger-prices-indexed-end
+             (< beg ledger-prices-indexed-end))
+    (setq ledger-prices-index nil
+          ledger-prices-indexed-end nil)))
+
+(defun ledger-prices-find (commodity day)
+  "Return the position of the latest price of COMMODITY up to DAY, or nil."
+  (let ((prices (gethash commodity (ledger-prices-update))))
+    (when prices
+      (let ((slot (ledger-prices-search prices day)))
+        (when (> slot 0)
+          (aref (aref (car prices) (1- slot)) 1))))))
+
+(defun ledger-prices-read-commodity ()
+  "Read a commodity of the price index."
+  (let (commodities)
+    (maphash (lambda (commodity _prices) (push commodity commodities))
+             (ledger-prices-update))
+    (completing-read "Commodity: " commodities nil t)))
+
+(defun ledger-prices-read-args ()
+  "Read the arguments of `ledger-prices-lookup' and `ledger-prices-goto'."
+  ;; ledger-mode.el requires this file, so it cannot be required above.
+  (require 'ledger-mode)
+  (list (ledger-prices-read-commodity)
+        (ledger-read-date "Date: ")))
+
+(defun ledger-prices-lookup (commodity date)
+  "Show the latest price of COMMODITY on or before DATE, and return it.
+Return nil if there is none."
+  (interactive (ledger-prices-read-args))
+  (let ((position (ledger-prices-find commodity (ledger-prices-day date))))
+    (if (null position)
+        (progn
+          (message "No price of %s on %s" commodity date)
+          nil)
+      (save-excursion
+        (goto-char position)
+        (looking-at ledger-price-directive-regex)
+        (let ((price (match-string-no-properties 3)))
+          (message "%s on %s: %s, since %s" commodity date price
+                   (match-string-no-properties 1))
+          price)))))
+
+(defun ledger-prices-goto (commodity date)
+  "Move to the latest price of COMMODITY on or before DATE."
+  (interactive (ledger-prices-read-args))
+  (let ((position (ledger-prices-find commodity (ledger-prices-day date))))
+    (if (null position)
+        (message "No price of %s on %s" commodity date)
+      (push-mark)
+      (goto-char position))))
+
+(defun ledger-prices-fontify-region (beg end &optional _loudly)
+  "Fontify the price file from BEG to END."
+  (save-excursion
+    (save-match-data
+      (goto-char beg)
+      (beginning-of-line)
+      (while (< (point) end)
+        (if (looking-at "P[ \t]")
+            (ledger-fontify-price-run end)
+          (let ((start (point))
+                (face (when (looking-at "[;#%|*]")
+                        'ledger-font-comment-face)))
+            (forward-line)
+            (ledger-fontify-set-face (list start (point)) face)))))))
+
+(defvar ledger-prices-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [(control ?c) (control ?p)] 'ledger-prices-lookup)
+    (define-key map [(control ?c) (control ?j)] 'ledger-prices-goto)
+    map)
+  "Keymap for `ledger-prices-mode'.")
+
+;;;###autoload
+(define-derived-mode ledger-prices-mode text-mode "Ledger-Prices"
+  "A mode for editing price database files of P directives.
+
+\\[ledger-prices-lookup] shows the price of a commodity on a date,
+and \\[ledger-prices-goto] moves to it."
+  (setq font-lock-defaults
+        '(nil t nil nil nil
+              (font-lock-fontify-region-function . ledger-prices-fontify-region)))
+  (setq-local comment-start ";")
+  (add-hook 'after-change-functions 'ledger-prices-after-change nil t))
+
+(provide 'ledger-prices)
+
+;;; ledger-prices.el ends here
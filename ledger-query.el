@@ -0,0 +1,245 @@
+;;; ledger-query.el --- Query ledger for Lisp data
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Rather than reading the text of reports back, these functions ask
+;; ledger for the XML output of the `xml' command, parse it with
+;; `libxml-parse-xml-region' when Emacs is built with libxml2, or
+;; `xml-parse-region' otherwise, and return plists.
+;;
+;; The `xml' command prints every matching transaction along with the
+;; accounts.  When only totals are needed, `ledger-query-balances'
+;; runs the balance command with a `--format' printing one JSON object
+;; per account and commodity instead, read with `json-parse-buffer'
+;; when Emacs has native JSON support, or `json-read' otherwise.
+;;
+;; An amount is a list (VALUE COMMODITY), as in
+;; ledger-commodities.el, and a balance a list of amounts, one per
+;; commodity.  A transaction is a plist with the keys :date, :state,
+;; :code, :payee, :note and :postings, and a posting a plist with the
+;; keys :account, :amount, :state and :note.  An account is a plist
+;; with the keys :account, its full name, :amount, the balance of its
+;; own postings, and :total, including its subaccounts.
+
+;;; Code:
+
+(require 'json)
+(require 'xml)
+(require 'ledger-exec)
+(require 'ledger-xact) ; for ledger-parse-iso-date
+
+(defun ledger-query-parse-buffer ()
+  "Return the root element of the XML in the current buffer."
+  (if (fboundp 'libxml-parse-xml-region)
+      (libxml-parse-xml-region (point-min) (point-max))
+    (car (xml-parse-region (point-min) (point-max)))))
+
+(defun ledger-query (buffer &rest args)
+  "Return the root element of the XML output of ledger on BUFFER.
+ARGS are passed to the `xml' command of ledger."
+  (with-temp-buffer
+    (apply #'ledger-exec-ledger buffer (current-buffer) "xml" args)
+    (ledger-query-parse-buffer)))
+
+(defun ledger-query-children (node tag)
+  "Return the child elements of NODE named TAG."
+  (let (children)
+    (dolist (child (cddr node))
+      (when (and (consp child) (eq (car child) tag))
+        (push child children)))
+    (nreverse children)))
+
+(defun ledger-query-child (node tag)
+  "Return the first child element of NODE named TAG, or nil."
+  (car (ledger-query-children node tag)))
+
+(defun ledger-query-text (node)
+  "Return the text of NODE, or nil if NODE is nil or empty."
+  (when node
+    (let ((text (mapconcat (lambda (child) (if (stringp child) child ""))
+                           (cddr node) "")))
+      (when (string-match "[^ \t\n]" text)
+        (replace-regexp-in-string "\\`[ \t\n]+\\|[ \t\n]+\\'" "" text)))))
+
+(defun ledger-query-state (node)
+  "Return the state of NODE, `cleared', `pending' or nil."
+  (let ((state (cdr (assq 'state (nth 1 node)))))
+    (when state
+      (intern state))))
+
+(defun ledger-query-amount (node)
+  "Return the amount of the amount element NODE."
+  ;; Quantities are written without the style of their commodity.
+  (list (string-to-number (ledger-query-text (ledger-query-child node 'quantity)))
+        (ledger-query-text (ledger-query-child (ledger-query-child node 'commodity)
+                                               'symbol))))
+
+(defun ledger-query-value (node)
+  "Return the balance held by the value element NODE, as a list of amounts."
+  (let ((balance (ledger-query-child node 'balance)))
+    (mapcar #'ledger-query-amount
+            (ledger-query-children (or balance node) 'amount))))
+
+(defun ledger-query-posting (node)
+  "Return the plist of the posting element NODE."
+  (list :account (ledger-query-text
+                  (ledger-query-child (ledger-query-child node 'account) 'name))
+        :amount (car (ledger-query-value (ledger-query-child node 'post-amount)))
+        :state (ledger-query-state node)
+        :note (ledger-query-text (ledger-query-child node 'note))))
+
+(defun ledger-query-transaction (node)
+  "Return the plist of the transaction element NODE."
+  (list :date (ledger-parse-iso-date (ledger-query-text (ledger-query-child node 'date)))
+        :state (ledger-query-state node)
+        :code (ledger-query-text (ledger-query-child node 'code))
+        :payee (ledger-query-text (ledger-query-child node 'payee))
+        :note (ledger-query-text (ledger-query-child node 'note))
+        :postings (mapcar #'ledger-query-posting
+                          (ledger-query-children (ledger-query-child node 'postings)
+                                                 'posting))))
+
+(defun ledger-query-transactions (buffer &rest args)
+  "Return the transactions of BUFFER matching ARGS.
+ARGS are ledger options and a query; only the postings matching
+them are in the transactions."
+  (mapcar #'ledger-query-transaction
+          (ledger-query-children
+           (ledger-query-child (apply #'ledger-query buffer args) 'transactions)
+           'transaction)))
+
+(defun ledger-query-postings (buffer &rest args)
+  "Return the postings of BUFFER matching ARGS, see `ledger-query-transactions'."
+  (apply #'append
+         (mapcar (lambda (xact) (plist-get xact :postings))
+                 (apply #'ledger-query-transactions buffer args))))
+
+(defun ledger-query-collect-accounts (node)
+  "Return the plists of the account element NODE and its subaccounts."
+  (let ((name (ledger-query-text (ledger-query-child node 'fullname))))
+    (append (when name
+              (list (list :account name
+                          :amount (ledger-query-value (ledger-query-child node 'account-amount))
+                          :total (ledger-query-value (ledger-query-child node 'account-total)))))
+            (apply #'append
+                   (mapcar #'ledger-query-collect-accounts
+                           (ledger-query-children node 'account))))))
+
+(defun ledger-query-root-accounts (root)
+  "Return the accounts of ROOT, the root element of the XML output of ledger."
+  (apply #'append
+         (mapcar #'ledger-query-collect-accounts
+                 (ledger-query-children (ledger-query-child root 'accounts)
+                                        'account))))
+
+(defun ledger-query-accounts (buffer &rest args)
+  "Return the accounts of BUFFER with the balances of the postings matching ARGS."
+  (ledger-query-root-accounts (apply #'ledger-query buffer args)))
+
+(defconst ledger-query-balance-format
+  (concat "{\"account\": %(quoted(account)),"
+          " \"quantity\": %(quoted(quantity(scrub(display_total)))),"
+          " \"commodity\": %(quoted(commodity(scrub(display_total))))}\n")
+  "Format of the balance command printing an account as a JSON object.
+The postings are grouped by commodity, so that each total printed
+is a single amount.")
+
+(defun ledger-query-read-json ()
+  "Read the JSON object at point and return it as a plist."
+  (if (fboundp 'json-parse-buffer)
+      (json-parse-buffer :object-type 'plist)
+    (let ((json-object-type 'plist)
+          (json-key-type 'keyword))
+      (json-read))))
+
+(defconst ledger-query-balance-options
+  (list "--flat" "--no-total" "--no-titles" "--group-by" "commodity"
+        "--format" ledger-query-balance-format)
+  "Options of the balance command printing its accounts as JSON objects.")
+
+(defun ledger-query-read-records ()
+  "Return the JSON objects printed one per line in the current buffer, as plists."
+  (goto-char (point-min))
+  (let (records)
+    (while (progn
+             (skip-chars-forward " \t\n")
+             (not (eobp)))
+      (push (ledger-query-read-json) records))
+    (nreverse records)))
+
+(defun ledger-query-collect-balances (records)
+  "Return the accounts of the balance RECORDS, see `ledger-query-balances'."
+  (let (accounts)
+    (dolist (record records)
+      (let* ((name (plist-get record :account))
+             (account (assoc name accounts))
+             (commodity (plist-get record :commodity))
+             (amount (list (string-to-number (plist-get record :quantity))
+                           ;; As in the XML, no commodity is nil.
+                           (unless (string= commodity "")
+                             commodity))))
+        (if account
+            (setcdr account (append (cdr account) (list amount)))
+          (push (list name amount) accounts))))
+    (mapcar (lambda (account)
+              (list :account (car account) :total (cdr account)))
+            (nreverse accounts))))
+
+(defun ledger-query-balances (buffer &rest args)
+  "Return the accounts of BUFFER with the balances of the postings matching ARGS.
+Unlike `ledger-query-accounts', only the accounts with postings
+are returned, each as a plist with the keys :account and :total,
+and ledger prints their totals rather than every transaction."
+  (ledger-query-collect-balances
+   (with-temp-buffer
+     (apply #'ledger-exec-ledger buffer (current-buffer)
+            (append (list "balance") ledger-query-balance-options args))
+     (ledger-query-read-records))))
+
+(defun ledger-query-balance-amount (balance commodity)
+  "Return the amount of BALANCE in COMMODITY, or nil."
+  (while (and balance (not (equal (nth 1 (car balance)) commodity)))
+    (setq balance (cdr balance)))
+  (car balance))
+
+(defun ledger-query-sum (postings)
+  "Return the balance of the amounts of POSTINGS."
+  (let (balance)
+    (dolist (posting postings)
+      (let ((amount (plist-get posting :amount)))
+        (when amount
+          (let ((total (ledger-query-balance-amount balance (nth 1 amount))))
+            (if total
+                (setcar total (+ (car total) (car amount)))
+              (push (list (car amount) (nth 1 amount)) balance))))))
+    (nreverse balance)))
+
+(defun ledger-query-sum-accounts (accounts)
+  "Return the balance of the totals of ACCOUNTS, as from `ledger-query-balances'."
+  (ledger-query-sum
+   (mapcar (lambda (amount) (list :amount amount))
+           (apply #'append
+                  (mapcar (lambda (account) (plist-get account :total))
+                          accounts)))))
+
+(provide 'ledger-query)
+
+;;; ledger-query.el ends here
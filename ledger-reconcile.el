@@ -34,16 +34,29 @@
 (require 'ledger-occur)
 (require 'ledger-commodities)
 (require 'ledger-exec)
+(require 'ledger-query)
 (require 'ledger-navigate)
 (require 'ledger-state)
 (declare-function ledger-insert-effective-date "ledger-mode" (&optional date))
 (declare-function ledger-read-account-with-prompt "ledger-mode" (prompt))
+(declare-function org-read-date "org" (&optional with-time to-time from-string prompt
+                                                 default-time default-input inactive))
+(defvar org-read-date-prefer-future)
 
 (defvar ledger-buf nil)
 (defvar ledger-bufs nil)
 (defvar ledger-acct nil)
 (defvar ledger-target nil)
 
+(defvar ledger-reconcile-start nil
+  "First day of the statement being reconciled, or nil for all history.")
+(defvar ledger-reconcile-end nil
+  "Last day of the statement being reconciled, or nil for no cutoff.")
+(defvar ledger-reconcile-opening-balance nil
+  "Cached cleared or pending balance before `ledger-reconcile-start'.
+It is a cons of the start date and of the balance, a list of
+amounts, or nil when not computed yet.")
+
 (defgroup ledger-reconcile nil
   "Options for Ledger-mode reconciliation"
   :group 'ledger)
@@ -168,28 +181,72 @@ Possible values are '(date)', '(amount)', '(payee)' or '(0)' for no sorting, i.e
       (ledger-reconcile-s-pad-left len "…" (ledger-reconcile-s-right (- len 1) str))
     str))
 
-(defun ledger-reconcile-get-cleared-or-pending-balance (buffer account)
-  "Use BUFFER to Calculate the cleared or pending balance of the ACCOUNT."
-
-  ;; these vars are buffer local, need to hold them for use in the
-  ;; temp buffer below
-
-  (with-temp-buffer
-    ;; note that in the line below, the --format option is
-    ;; separated from the actual format string.  emacs does not
-    ;; split arguments like the shell does, so you need to
-    ;; specify the individual fields in the command line.
-    (ledger-exec-ledger buffer (current-buffer)
-                        "balance" "--limit" "cleared or pending" "--empty" "--collapse"
-                        "--format" "%(scrub(display_total))" account)
-    (ledger-split-commodity-string
-     (buffer-substring-no-properties (point-min) (point-max)))))
+(defun ledger-reconcile-date-args (begin end)
+  "Return the ledger arguments limiting postings to BEGIN up to END.
+END is excluded, and either date may be nil to leave that side open."
+  (append (when begin
+            (list "--begin" (format-time-string "%Y/%m/%d" begin)))
+          (when end
+            (list "--end" (format-time-string "%Y/%m/%d" end)))))
+
+(defun ledger-reconcile-cutoff ()
+  "Return the day after `ledger-reconcile-end', or nil if it is not set."
+  (when ledger-reconcile-end
+    (let ((date (decode-time ledger-reconcile-end)))
+      (encode-time 0 0 0 (1+ (nth 3 date)) (nth 4 date) (nth 5 date)))))
+
+(defun ledger-reconcile-cleared-or-pending-balances (buffer account &optional begin end)
+  "Return the cleared or pending balance of ACCOUNT in BUFFER.
+It is a list of amounts, one per commodity.  If BEGIN or END are
+given, only postings from BEGIN and before END are counted."
+  (ledger-query-sum-accounts
+   (apply #'ledger-query-balances buffer
+          (append (list "--limit" "cleared or pending")
+                  (ledger-reconcile-date-args begin end)
+                  (list account)))))
+
+(defun ledger-reconcile-balance-amount (balance)
+  "Return the amount of BALANCE in the default commodity.
+If BALANCE has no amount in it, return its first amount instead."
+  (or (ledger-query-balance-amount balance ledger-reconcile-default-commodity)
+      (car balance)
+      (list 0 ledger-reconcile-default-commodity)))
+
+(defun ledger-reconcile-get-cleared-or-pending-balance (buffer account &optional begin end)
+  "Use BUFFER to Calculate the cleared or pending balance of the ACCOUNT.
+If BEGIN or END are given, only postings from BEGIN and before END
+are counted.  The balance is returned in the default commodity if
+it has an amount in it, otherwise in its first commodity."
+  (ledger-reconcile-balance-amount
+   (ledger-reconcile-cleared-or-pending-balances buffer account begin end)))
+
+(defun ledger-reconcile-balance ()
+  "Return the cleared or pending balance of the account being reconciled.
+With a statement period, the balance before its start is computed
+once and cached, so that only the postings of the period are
+summed again after each toggle."
+  (if (null ledger-reconcile-start)
+      (ledger-reconcile-get-cleared-or-pending-balance
+       ledger-buf ledger-acct nil (ledger-reconcile-cutoff))
+    (unless (equal (car ledger-reconcile-opening-balance) ledger-reconcile-start)
+      (setq ledger-reconcile-opening-balance
+            (cons ledger-reconcile-start
+                  (ledger-reconcile-cleared-or-pending-balances
+                   ledger-buf ledger-acct nil ledger-reconcile-start))))
+    ;; Both balances are summed per commodity, so that an opening
+    ;; balance and a period in different commodities add up.
+    (ledger-reconcile-balance-amount
+     (ledger-query-sum-accounts
+      (list (list :total (cdr ledger-reconcile-opening-balance))
+            (list :total (ledger-reconcile-cleared-or-pending-balances
+                          ledger-buf ledger-acct ledger-reconcile-start
+                          (ledger-reconcile-cutoff))))))))
 
 (defun ledger-display-balance ()
   "Display the cleared-or-pending balance.
 And calculate the target-delta of the account being reconciled."
   (interactive)
-  (let* ((pending (ledger-reconcile-get-cleared-or-pending-balance ledger-buf ledger-acct)))
+  (let* ((pending (ledger-reconcile-balance)))
     (when pending
       (if ledger-target
           (message "Cleared and Pending balance: %s,   Difference from target: %s"
@@ -216,8 +273,13 @@ And calculate the target-delta of the account being reconciled."
   (interactive)
   (beginning-of-line)
   (let ((where (get-text-property (point) 'where))
+        (date (get-text-property (point) 'ledger-date))
         (inhibit-read-only t)
         status)
+    ;; The cached opening balance covers the postings before the start.
+    (when (and ledger-reconcile-start date
+               (time-less-p date ledger-reconcile-start))
+      (setq ledger-reconcile-opening-balance nil))
     (when (ledger-reconcile-get-buffer where)
       (with-current-buffer (ledger-reconcile-get-buffer where)
         (ledger-navigate-to-line (cdr where))
@@ -254,6 +316,9 @@ Return the number of uncleared xacts found."
   (interactive)
   (let ((inhibit-read-only t)
         (line (count-lines (point-min) (point))))
+    ;; The journal may have changed before the start too, whether by
+    ;; an edit saved in its buffer or outside of Emacs.
+    (setq ledger-reconcile-opening-balance nil)
     (erase-buffer)
     (prog1
         (ledger-do-reconcile ledger-reconcile-sort-key)
@@ -434,20 +499,26 @@ POSTING is used in `ledger-clear-whole-transactions' is nil."
                                        (ledger-reconcile-truncate-left
                                         (nth 1 posting)  ; account
                                         ledger-reconcile-buffer-account-max-chars)
-                                       (nth 2 posting)))))  ; amount
+                                       (nth 2 posting))  ; amount
+      (put-text-property beg (1- (point)) 'ledger-date (nth 2 xact)))))
 
 (defun ledger-do-reconcile (&optional sort)
   "SORT the uncleared transactions in the account and display them in the *Reconcile* buffer.
 Return a count of the uncleared transactions."
   (let* ((buf ledger-buf)
          (account ledger-acct)
+         ;; Uncleared postings from before the statement, such as
+         ;; outstanding checks, are listed too.
+         (dates (ledger-reconcile-date-args nil (ledger-reconcile-cutoff)))
          (sort-by (if sort
                       sort
                     "(date)"))
          (xacts
           (with-temp-buffer
-            (ledger-exec-ledger buf (current-buffer)
-                                "--uncleared" "--real" "emacs" "--sort" sort-by account)
+            (apply #'ledger-exec-ledger buf (current-buffer)
+                   (append (list "--uncleared" "--real" "emacs" "--sort" sort-by)
+                           dates
+                           (list account)))
             (goto-char (point-min))
             (unless (eobp)
               (if (looking-at "(")
@@ -457,6 +528,14 @@ Return a count of the uncleared transactions."
         (progn
           (if ledger-reconcile-buffer-header
               (insert (format ledger-reconcile-buffer-header account)))
+          (when (or ledger-reconcile-start ledger-reconcile-end)
+            (insert (format "Statement %s to %s\n\n"
+                            (if ledger-reconcile-start
+                                (ledger-format-date ledger-reconcile-start)
+                              "the beginning")
+                            (if ledger-reconcile-end
+                                (ledger-format-date ledger-reconcile-end)
+                              "the end"))))
           (dolist (xact xacts)
             (ledger-reconcile-format-xact xact fmt))
           (goto-char (point-max))
@@ -522,6 +601,7 @@ moved and recentered.  If they aren't strange things happen."
       (if rbuf ;; *Reconcile* already exists
           (with-current-buffer rbuf
             (set 'ledger-acct account) ;; already buffer local
+            (setq ledger-reconcile-opening-balance nil)
             (when (not (eq buf rbuf))
               ;; called from some other ledger-mode buffer
               (ledger-reconcile-quit-cleanup)
@@ -537,6 +617,9 @@ moved and recentered.  If they aren't strange things happen."
           (ledger-reconcile-open-windows buf rbuf)
           (ledger-reconcile-mode)
           (make-local-variable 'ledger-target)
+          (make-local-variable 'ledger-reconcile-start)
+          (make-local-variable 'ledger-reconcile-end)
+          (make-local-variable 'ledger-reconcile-opening-balance)
           (set (make-local-variable 'ledger-buf) buf)
           (set (make-local-variable 'ledger-acct) account)))
 
@@ -558,6 +641,27 @@ moved and recentered.  If they aren't strange things happen."
   (interactive)
   (setq ledger-target (or target (ledger-read-commodity-string ledger-reconcile-target-prompt-string))))
 
+(defun ledger-reconcile-change-period (start end)
+  "Reconcile the statement running from START to END.
+The uncleared postings up to END are listed, including those
+before START, and the balance before START is cached.
+Interactively, prompt for the dates; with a prefix argument, go
+back to reconciling all of the history."
+  (interactive
+   (if current-prefix-arg
+       (list nil nil)
+     (let ((org-read-date-prefer-future nil))
+       (list (org-read-date nil t nil "Statement start: ")
+             (org-read-date nil t nil "Statement end: ")))))
+  (when (and start end (time-less-p end start))
+    (error "Statement end %s is before its start %s"
+           (ledger-format-date end) (ledger-format-date start)))
+  (setq ledger-reconcile-start start
+        ledger-reconcile-end end
+        ledger-reconcile-opening-balance nil)
+  (ledger-reconcile-refresh)
+  (ledger-display-balance))
+
 (defmacro ledger-reconcile-change-sort-key-and-refresh (sort-by)
   "Set the sort-key to SORT-BY."
   `(lambda ()
@@ -580,6 +684,7 @@ moved and recentered.  If they aren't strange things happen."
     (define-key map [?n] 'next-line)
     (define-key map [?p] 'previous-line)
     (define-key map [?t] 'ledger-reconcile-change-target)
+    (define-key map [?P] 'ledger-reconcile-change-period)
     (define-key map [?s] 'ledger-reconcile-save)
     (define-key map [?q] 'ledger-reconcile-quit)
     (define-key map [?b] 'ledger-display-balance)
@@ -604,6 +709,7 @@ moved and recentered.  If they aren't strange things happen."
     ["Reconcile New Account" ledger-reconcile]
     "---"
     ["Change Target Balance" ledger-reconcile-change-target]
+    ["Change Statement Period" ledger-reconcile-change-period]
     ["Show Cleared Balance" ledger-display-balance]
     "---"
     ["Sort by payee" ,(ledger-reconcile-change-sort-key-and-refresh "(payee)")]
@@ -0,0 +1,301 @@
+;;; ledger-recur.el --- Propose schedule entries for recurring transactions
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; The journal already shows which payees come back every week, month
+;; or quarter.  `ledger-recur-propose' groups the transactions of the
+;; journal by payee, using the index of ledger-index.el, and looks at
+;; the intervals between their dates and at their amounts.  For each
+;; payee recurring at a regular period, it proposes an entry in the
+;; format of `ledger-schedule-file', modelled on the last transaction
+;; of the payee.  Payees already scheduled are left out.
+
+;;; Code:
+
+(require 'calendar)
+(require 'cl-lib)
+(require 'ledger-index)
+(require 'ledger-schedule)
+(require 'ledger-xact)
+
+(declare-function ledger-mode "ledger-mode")
+
+(defgroup ledger-recur nil
+  "Options for finding recurring transactions."
+  :group 'ledger)
+
+(defcustom ledger-recur-buffer-name "*Ledger Recurring*"
+  "Name of the buffer listing the proposed schedule entries."
+  :type 'string
+  :group 'ledger-recur)
+
+(defcustom ledger-recur-min-occurrences 4
+  "Number of transactions of a payee needed to detect a period."
+  :type 'integer
+  :group 'ledger-recur)
+
+(defcustom ledger-recur-regularity 0.75
+  "Fraction of the intervals between transactions that must match the period."
+  :type 'number
+  :group 'ledger-recur)
+
+(defcustom ledger-recur-amount-tolerance 0.05
+  "Spread of the amounts of a payee, relative to the largest, deemed stable."
+  :type 'number
+  :group 'ledger-recur)
+
+(defconst ledger-recur-periods
+  '((weekly 7 1)
+    (biweekly 14 2)
+    (monthly 30 3)
+    (quarterly 91 7)
+    (yearly 365 5))
+  "List of (NAME DAYS SLACK) of the periods detected.
+An interval between two transactions matches a period when it is
+within SLACK days of DAYS.")
+
+(defun ledger-recur-amount-posting (postings)
+  "Return the first of the indexed POSTINGS with a numeric amount."
+  (while (and postings (null (nth 2 (car postings))))
+    (setq postings (cdr postings)))
+  (car postings))
+
+(defun ledger-recur-series (buffers)
+  "Return the transactions of BUFFERS grouped by payee.
+The result is a list (SERIES . LAST-DAY): SERIES is a hash table
+mapping each payee to a list of [DAY POSTING MARKER], POSTING
+being the first posting with an amount of the xact at MARKER, and
+LAST-DAY is the day of the latest transaction."
+  (let ((series (make-hash-table :test 'equal))
+        (last-day 0))
+    (dolist (buffer buffers)
+      (maphash (lambda (marker record)
+                 (let ((payee (aref record 1)))
+                   (when payee
+                     (puthash payee
+                              (cons (vector (aref record 0)
+                                            (ledger-recur-amount-posting
+                                             (aref record 2))
+                                            marker)
+                                    (gethash payee series))
+                              series)
+                     (setq last-day (max last-day (aref record 0))))))
+               (buffer-local-value 'ledger-index-xacts buffer)))
+    (cons series last-day)))
+
+(defun ledger-recur-most-frequent (counts)
+  "Return the index of the largest element of the vector COUNTS."
+  (let ((best 0))
+    (dotimes (i (length counts))
+      (when (> (aref counts i) (aref counts best))
+        (setq best i)))
+    best))
+
+(defun ledger-recur-analyze (entries last-day)
+  "Return the recurrence of ENTRIES of a payee, or nil if they do not recur.
+ENTRIES are the [DAY POSTING MARKER] of the payee, LAST-DAY is
+the day of the latest transaction of the journal.  The result is
+a plist with the keys :period, :count, :days, :weekdays, :last,
+:marker, :stable, :min and :max.  :last and :marker are the day
+and the marker of the latest transaction, :days and :weekdays
+count the transactions falling on each day of the month and of
+the week, and :min and :max are the entries of the smallest and
+largest amount."
+  (let ((count (length entries)))
+    (when (>= count ledger-recur-min-occurrences)
+      (let ((periods (make-vector (length ledger-recur-periods) 0))
+            (days (make-vector 32 0))
+            (weekdays (make-vector 7 0))
+            (stable t)
+            previous marker commodity low high)
+        (dolist (entry (sort entries (lambda (a b) (< (aref a 0) (aref b 0)))))
+          (let* ((day (aref entry 0))
+                 (posting (aref entry 1))
+                 (value (nth 2 posting))
+                 (date (calendar-gregorian-from-absolute day)))
+            (when previous
+              (let ((interval (- day previous))
+                    (i 0))
+                (dolist (period ledger-recur-periods)
+                  (when (<= (abs (- interval (nth 1 period))) (nth 2 period))
+                    (aset periods i (1+ (aref periods i))))
+                  (setq i (1+ i)))))
+            (aset days (nth 1 date) (1+ (aref days (nth 1 date))))
+            (let ((weekday (calendar-day-of-week date)))
+              (aset weekdays weekday (1+ (aref weekdays weekday))))
+            (cond ((null value)
+                   (setq stable nil))
+                  ((null low)
+                   (setq commodity (nth 3 posting)
+                         low entry
+                         high entry))
+                  (t
+                   (unless (equal commodity (nth 3 posting))
+                     (setq stable nil))
+                   (when (< value (nth 2 (aref low 1)))
+                     (setq low entry))
+                   (when (> value (nth 2 (aref high 1)))
+                     (setq high entry))))
+            (setq previous day
+                  marker (aref entry 2))))
+        (let* ((best (ledger-recur-most-frequent periods))
+               (period (nth best ledger-recur-periods)))
+          (when (and (>= (aref periods best) (* ledger-recur-regularity (1- count)))
+                     ;; A payee that stopped recurring is not proposed.
+                     (<= (- last-day previous)
+                         (+ (* 2 (nth 1 period)) (nth 2 period))))
+            (when (and stable low)
+              (let ((small (nth 2 (aref low 1)))
+                    (large (nth 2 (aref high 1))))
+                (setq stable (<= (- large small)
+                                 (* ledger-recur-amount-tolerance
+                                    (max (abs small) (abs large)))))))
+            (list :period (car period)
+                  :count count
+                  :days days
+                  :weekdays weekdays
+                  :last previous
+                  :marker marker
+                  :stable stable
+                  :min low
+                  :max high)))))))
+
+(defun ledger-recur-weekday-name (weekday)
+  "Return the abbreviation of WEEKDAY in `ledger-schedule-week-days'."
+  (car (rassoc (list weekday) ledger-schedule-week-days)))
+
+(defun ledger-recur-descriptor (recurrence)
+  "Return the schedule date descriptor of RECURRENCE."
+  (let* ((last (plist-get recurrence :last))
+         (date (calendar-gregorian-from-absolute last))
+         (day (ledger-recur-most-frequent (plist-get recurrence :days))))
+    (cl-case (plist-get recurrence :period)
+      (weekly
+       (format "[*/*/0%s]"
+               (ledger-recur-weekday-name
+                (ledger-recur-most-frequent (plist-get recurrence :weekdays)))))
+      (biweekly
+       (format "[%d/%d/%d+2%s]" (nth 2 date) (nth 0 date) (nth 1 date)
+               (ledger-recur-weekday-name (calendar-day-of-week date))))
+      (monthly
+       (format "[*/*/%d]" day))
+      (quarterly
+       (format "[*/%s/%d]"
+               (mapconcat #'number-to-string
+                          (sort (mapcar (lambda (offset)
+                                          (1+ (% (+ (nth 0 date) offset -1) 12)))
+                                        '(0 3 6 9))
+                                #'<)
+                          ",")
+               day))
+      (yearly
+       (format "[*/%d/%d]" (nth 0 date) (nth 1 date))))))
+
+(defun ledger-recur-scheduled-payees (file)
+  "Return the payees of the entries of the schedule FILE."
+  (when (and file (file-readable-p file))
+    (with-temp-buffer
+      (insert-file-contents file)
+      (let (payees)
+        (while (re-search-forward
+                "^\\[[^]\n]*\\][ \t]+\\(?:[*!][ \t]+\\)?\\(.*\\)" nil t)
+          (push (ledger-xact-trim (match-string-no-properties 1)) payees))
+        payees))))
+
+(defun ledger-recur-candidates (buffers &optional scheduled)
+  "Return the recurring payees of BUFFERS, except those in SCHEDULED.
+Each candidate is a pair (PAYEE . RECURRENCE), see
+`ledger-recur-analyze'."
+  (let* ((result (ledger-recur-series buffers))
+         (last-day (cdr result))
+         candidates)
+    (maphash (lambda (payee entries)
+               (unless (member payee scheduled)
+                 (let ((recurrence (ledger-recur-analyze entries last-day)))
+                   (when recurrence
+                     (push (cons payee recurrence) candidates)))))
+             (car result))
+    (sort candidates (lambda (a b) (string< (car a) (car b))))))
+
+(defun ledger-recur-amount-string (entry)
+  "Return the amount text of the posting of ENTRY."
+  (nth 1 (aref entry 1)))
+
+(defun ledger-recur-insert (candidate)
+  "Insert the proposed schedule entry for CANDIDATE."
+  (let* ((payee (car candidate))
+         (recurrence (cdr candidate))
+         (marker (plist-get recurrence :marker))
+         (xact (with-current-buffer (marker-buffer marker)
+                 (save-restriction
+                   (widen)
+                   (ledger-xact-parse-at marker)))))
+    (insert (format "; %s: %s, %d times, last on %s"
+                    payee
+                    (plist-get recurrence :period)
+                    (plist-get recurrence :count)
+                    (ledger-format-date
+                     (ledger-index-day-date (plist-get recurrence :last)))))
+    (unless (plist-get recurrence :stable)
+      (let ((low (plist-get recurrence :min))
+            (high (plist-get recurrence :max)))
+        (insert (if low
+                    (format ", amount varies from %s to %s"
+                            (ledger-recur-amount-string low)
+                            (ledger-recur-amount-string high))
+                  ", amount varies"))))
+    (insert "\n" (ledger-recur-descriptor recurrence) " " payee "\n")
+    (dolist (posting (plist-get xact :postings))
+      (insert "    " (plist-get posting :account))
+      (when (plist-get posting :amount)
+        (insert "  " (plist-get posting :amount)))
+      (insert "\n"))
+    (insert "\n")))
+
+(defun ledger-recur-propose (&optional files)
+  "List schedule entries for the payees recurring in the journal.
+
+The transactions of each payee are checked for a weekly,
+biweekly, monthly, quarterly or yearly period, see
+`ledger-recur-regularity'.  An entry in the format of
+`ledger-schedule-file' is proposed for each recurring payee not
+already in that file, modelled on its last transaction.  FILES
+default to the files of the journal of the current buffer."
+  (interactive)
+  (let* ((start (float-time))
+         (buffers (ledger-index-buffers files))
+         (candidates (ledger-recur-candidates
+                      buffers
+                      (ledger-recur-scheduled-payees ledger-schedule-file)))
+         (elapsed (- (float-time) start)))
+    (with-current-buffer (get-buffer-create ledger-recur-buffer-name)
+      (erase-buffer)
+      (insert (format "; Proposed entries for %s\n\n" ledger-schedule-file))
+      (mapc #'ledger-recur-insert candidates)
+      (ledger-mode)
+      (goto-char (point-min))
+      (set-buffer-modified-p nil)
+      (display-buffer (current-buffer)))
+    (message "%d recurring payees found in %.2f s" (length candidates) elapsed)))
+
+(provide 'ledger-recur)
+
+;;; ledger-recur.el ends here
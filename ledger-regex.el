@@ -23,7 +23,11 @@
 (require 'cl-lib)
 
 (defconst ledger-amount-regex
-  (concat "\\(  \\|\t\\| \t\\)[ \t]*-?"
+  ;; Every part of this regexp can only end in one place, so that
+  ;; matching a long line does not backtrack over its length.  For
+  ;; the same reason, a search only skips one blank before the
+  ;; amount instead of a whole run of them.
+  (concat "\\(  \\|\t\\| \t\\)[ \t]?-?"
           "\\([A-Z$€£₹_(]+ *\\)?"
           ;; We either match just a number after the commodity with no
           ;; decimal or thousand separators or a number with thousand
@@ -33,9 +37,9 @@
           ;; group, which then finishes the decimal part.
           "\\(-?\\(?:[0-9]+\\|[0-9,.]+?\\)\\)"
           "\\([,.][0-9)]+\\)?"
-          "\\( *[[:word:]€£₹_\"]+\\)?"
-          "\\([ \t]*[@={]@?[^\n;]+?\\)?"
-          "\\([ \t]+;.+?\\|[ \t]*\\)?$"))
+          "\\( *[[:alpha:]€£₹_\"][[:word:]€£₹_\"]*\\)?"
+          "\\([ \t]*[@={]@?[^\n;]*[^\n; \t]\\)?"
+          "\\([ \t]+;.+\\|[ \t]*\\)$"))
 
 (defconst ledger-amount-decimal-comma-regex
   "-?[1-9][0-9.]*[,]?[0-9]*")
@@ -43,6 +47,14 @@
 (defconst ledger-amount-decimal-period-regex
   "-?[1-9][0-9,]*[.]?[0-9]*")
 
+;; Groups: sign, commodity before the number, sign, number and
+;; commodity after the number.
+(defconst ledger-amount-parse-regex
+  (concat "\\`[ \t]*\\(-\\)?[ \t]*"
+          "\\(\"[^\"\n]*\"\\|[^-0-9.,\"@={}();[:space:]]+\\)?[ \t]*"
+          "\\(-\\)?\\([0-9][0-9,.]*\\)[ \t]*"
+          "\\(\"[^\"\n]*\"\\|[^-0-9.,\"@={}();[:space:]]+\\)?"))
+
 (defconst ledger-other-entries-regex
   "\\(^[~=A-Za-z].+\\)+")
 
@@ -54,19 +66,31 @@
 (defconst ledger-multiline-comment-end-regex
   "^!end_comment$")
 (defconst ledger-multiline-comment-regex
-  "^!comment\n\\(.*\n\\)*?!end_comment$")
-
+  "^!comment\n\\(?:.*\n\\)*?!end_comment$")
+(defconst ledger-comment-directive-start-regex
+  "^\\(?:comment\\|test\\)\\b"
+  "Match the first line of the block of a comment or test directive.")
+(defconst ledger-comment-directive-end-regex
+  "^end[ \t]+\\(?:comment\\|test\\)\\b"
+  "Match the last line of the block of a comment or test directive.")
+(defconst ledger-include-directive-regex
+  "^!?include[ \t]+\\(.*[^ \t\n]\\)"
+  "Match an include directive, the file name is in group 1.")
+
+;; The payee starts and ends with a non-blank character, rather than
+;; being the shortest text followed by blanks and a note, so that a
+;; run of blanks in it is not rescanned from each of its positions.
 (defconst ledger-payee-any-status-regex
-  "^[0-9]+[-/][-/.=0-9]+\\(\\s-+\\*\\)?\\(\\s-+(.*?)\\)?\\s-+\\(.+?\\)\\s-*\\(;\\|$\\)")
+  "^[0-9]+[-/][-/.=0-9]+\\(\\s-+\\*\\)?\\(\\s-+([^)\n]*)\\)?\\s-+\\([^;\n[:space:]]\\(?:[^;\n]*[^;\n[:space:]]\\)?\\)\\s-*\\(;\\|$\\)")
 
 (defconst ledger-payee-pending-regex
-  "^[0-9]+[-/][-/.=0-9]+\\s-\\!\\s-+\\(([^)]+)\\s-+\\)?\\([^*].+?\\)\\s-*\\(;\\|$\\)")
+  "^[0-9]+[-/][-/.=0-9]+\\s-\\!\\s-+\\(([^)\n]+)\\s-+\\)?\\([^*;\n[:space:]][^;\n]*[^;\n[:space:]]\\)\\s-*\\(;\\|$\\)")
 
 (defconst ledger-payee-cleared-regex
-  "^[0-9]+[-/][-/.=0-9]+\\s-\\*\\s-+\\(([^)]+)\\s-+\\)?\\([^*].+?\\)\\s-*\\(;\\|$\\)")
+  "^[0-9]+[-/][-/.=0-9]+\\s-\\*\\s-+\\(([^)\n]+)\\s-+\\)?\\([^*;\n[:space:]][^;\n]*[^;\n[:space:]]\\)\\s-*\\(;\\|$\\)")
 
 (defconst ledger-payee-uncleared-regex
-  "^[0-9]+[-/][-/.=0-9]+\\s-+\\(([^)]+)\\s-+\\)?\\([^*].+?\\)\\s-*\\(;\\|$\\)")
+  "^[0-9]+[-/][-/.=0-9]+\\s-+\\(([^)\n]+)\\s-+\\)?\\([^*;\n[:space:]][^;\n]*[^;\n[:space:]]\\)\\s-*\\(;\\|$\\)")
 
 (defconst ledger-init-string-regex
   "^--.+?\\($\\|[ ]\\)")
@@ -202,7 +226,7 @@
                       "Match a transaction or posting's \"state\" character.")
 
 (ledger-define-regexp code
-                      (rx (and ?\( (group (+? (not (any ?\))))) ?\)))
+                      (rx (and ?\( (group (+? (not (any ?\) ?\n)))) ?\)))
                       "Match the transaction code.")
 
 (ledger-define-regexp long-space
@@ -214,6 +238,16 @@
                       (rx (group (+ nonl)))
                       "")
 
+(ledger-define-regexp field
+                      (rx (* (or (not (any blank ?\n))
+                                 (and (+ blank) (not (any blank ?\n ?\;)))
+                                 (and (or ?\s (and (* blank) ?\t ?\s)) ?\;)
+                                 (and (+ blank) (? ?\;) line-end))))
+                      "Match the rest of a payee or amount, up to an end note.
+A run of blanks is only consumed with what follows it, so the
+blanks before a note are never rescanned from each of their
+positions.")
+
 (ledger-define-regexp end-note
                       (macroexpand
                        `(rx (and (regexp ,ledger-long-space-regexp) ?\;
@@ -232,7 +266,8 @@
                                  (regexp ,ledger-full-date-regexp)
                                  (? (and (+ blank) (regexp ,ledger-state-regexp)))
                                  (? (and (+ blank) (regexp ,ledger-code-regexp)))
-                                 (+ blank) (+? nonl)
+                                 (+ blank) (not (any blank ?\n))
+                                 (regexp ,ledger-field-regexp)
                                  (? (regexp ,ledger-end-note-regexp))
                                  line-end)))
                       "Match a transaction's first line (and optional notes)."
@@ -248,7 +283,8 @@
                                  (regexp "\\[.+/.+/.+\\]")
                                  (? (and (+ blank) (regexp ,ledger-state-regexp)))
                                  (? (and (+ blank) (regexp ,ledger-code-regexp)))
-                                 (+ blank) (+? nonl)
+                                 (+ blank) (not (any blank ?\n))
+                                 (regexp ,ledger-field-regexp)
                                  (? (regexp ,ledger-end-note-regexp))
                                  line-end)))
                       "Match a transaction's first line (and optional notes)."
@@ -277,7 +313,7 @@
 
 (ledger-define-regexp commodity
                       (rx (group
-                           (or (and ?\" (+ (not (any ?\"))) ?\")
+                           (or (and ?\" (+ (not (any ?\" ?\n))) ?\")
                                (not (any blank ?\n
                                          digit
                                          ?- ?\[ ?\]
@@ -325,7 +361,9 @@
                       "")
 
 (ledger-define-regexp full-amount
-                      (macroexpand `(rx (group (+? (not (any ?\;))))))
+                      (macroexpand
+                       `(rx (group (not (any blank ?\n ?\;))
+                                   (regexp ,ledger-field-regexp))))
                       "")
 
 (ledger-define-regexp post-line
@@ -335,7 +373,11 @@
                                  (regexp ,ledger-full-account-regexp)
                                  (? (and (regexp ,ledger-long-space-regexp)
                                          (regexp ,ledger-full-amount-regexp)))
-                                 (? (regexp ,ledger-end-note-regexp))
+                                 ;; An empty note ends the posting too, or
+                                 ;; the account would be retried from each
+                                 ;; of the blanks before it.
+                                 (? (or (regexp ,ledger-end-note-regexp)
+                                        (and (regexp ,ledger-long-space-regexp) ?\;)))
                                  line-end)))
                       ""
                       state
@@ -377,5 +419,10 @@
 (defconst ledger-directive-start-regex
   "[=~;#%|\\*[A-Za-z]")
 
+(defconst ledger-price-directive-regex
+  (concat "^P[ \t]+\\([^ \t\n]+\\)\\(?:[ \t]+[0-9]+:[0-9:]+\\)?[ \t]+"
+          "\\(\"[^\"\n]*\"\\|[^ \t\n]+\\)[ \t]+\\(.*\\)")
+  "Match a P directive: date, commodity and price in groups 1 to 3.")
+
 
 (provide 'ledger-regex)
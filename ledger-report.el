@@ -114,6 +114,11 @@ in the `header-line'."
 (defvar ledger-report-is-reversed nil)
 (defvar ledger-report-cursor-line-number nil)
 
+(defvar ledger-report-functions nil
+  "Abnormal hook run after a report ran.
+Each function is called in the report buffer with the command
+line of the report, once its output was inserted.")
+
 (defun ledger-report-reverse-report ()
   "Reverse the order of the report."
   (interactive)
@@ -294,6 +299,39 @@ used to generate the buffer, navigating the buffer, etc."
       (expand-file-name ledger-master-file)
     (buffer-file-name)))
 
+(defun ledger-journal-files (&optional file)
+  "Return the files making up the journal rooted at FILE.
+
+FILE defaults to the master file, nil is returned when there is
+neither.  Include directives are
+followed recursively, relative to the including file, and may
+use wildcards.  The result starts with FILE and lists every file
+once."
+  (let ((pending (let ((root (or file (ledger-master-file))))
+                   (when root
+                     (list (expand-file-name root)))))
+        files)
+    (while pending
+      (let ((current (pop pending)))
+        (unless (or (member current files)
+                    (not (file-readable-p current)))
+          (push current files)
+          (let ((buffer (get-file-buffer current))
+                (dir (file-name-directory current))
+                includes)
+            (with-temp-buffer
+              (if buffer
+                  (insert-buffer-substring buffer)
+                (insert-file-contents current))
+              (goto-char (point-min))
+              (while (re-search-forward ledger-include-directive-regex nil t)
+                (let ((name (expand-file-name (match-string-no-properties 1) dir)))
+                  (setq includes (append includes
+                                         (or (file-expand-wildcards name t)
+                                             (list name)))))))
+            (setq pending (append includes pending))))))
+    (nreverse files)))
+
 (defun ledger-report-payee-format-specifier ()
   "Substitute a payee name.
 
@@ -390,7 +428,8 @@ Optional EDIT the command."
             (add-text-properties (line-beginning-position) (line-end-position)
                                  (list 'font-lock-face 'ledger-font-report-clickable-face))
             (end-of-line)))))
-    (goto-char data-pos)))
+    (goto-char data-pos)
+    (run-hook-with-args 'ledger-report-functions cmd)))
 
 
 (defun ledger-report-visit-source ()
@@ -404,8 +443,7 @@ Optional EDIT the command."
       (widen)
       (if (markerp line-or-marker)
           (goto-char line-or-marker)
-        (goto-char (point-min))
-        (forward-line (1- line-or-marker))
+        (ledger-navigate-to-line line-or-marker)
         (re-search-backward "^[0-9]+")
         (beginning-of-line)
         (let ((start-of-txn (point)))
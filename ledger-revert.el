@@ -0,0 +1,149 @@
+;;; ledger-revert.el --- Merge changes made on disk into ledger buffers
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Reverting a ledger buffer, by hand or through `auto-revert-mode',
+;; normally replaces all of its text.  When the file was only changed
+;; on disk, typically by a program appending transactions to it, the
+;; buffer is instead brought up to date by changing just the text
+;; that differs.  Fontification, markers and indexes then only see
+;; the transactions that actually changed.
+
+;;; Code:
+
+(defgroup ledger-revert nil
+  "Options for reverting ledger buffers."
+  :group 'ledger)
+
+(defcustom ledger-revert-incrementally t
+  "If non-nil, reverting an unmodified buffer only changes the text that differs."
+  :type 'boolean
+  :group 'ledger-revert)
+
+(defvar ledger-revert-functions nil
+  "Abnormal hook run after a buffer has been reverted incrementally.
+Each function is called with the beginning and end of the text
+that changed.")
+
+(defun ledger-revert-common-prefix (buffer)
+  "Return the length of the text common to the start of both buffers.
+The current buffer is compared to BUFFER."
+  (let* ((case-fold-search nil)
+         (result (compare-buffer-substrings nil (point-min) (point-max)
+                                            buffer nil nil)))
+    (if (zerop result)
+        (min (buffer-size) (buffer-size buffer))
+      (1- (abs result)))))
+
+(defun ledger-revert-common-suffix (buffer limit)
+  "Return the length of the text common to the end of both buffers.
+The current buffer is compared to BUFFER, over at most LIMIT
+characters.  The text is compared by chunks from the end, one
+character at a time only within the chunk that differs."
+  (let ((case-fold-search nil)
+        (end (point-max))
+        (other-end (with-current-buffer buffer (point-max)))
+        (suffix 0)
+        done)
+    (while (and (not done) (< suffix limit))
+      (let ((step (min 4096 (- limit suffix))))
+        (if (zerop (compare-buffer-substrings
+                    nil (- end suffix step) (- end suffix)
+                    buffer (- other-end suffix step) (- other-end suffix)))
+            (setq suffix (+ suffix step))
+          (while (eq (char-before (- end suffix))
+                     (with-current-buffer buffer
+                       (char-before (- other-end suffix))))
+            (setq suffix (1+ suffix)))
+          (setq done t))))
+    suffix))
+
+(defun ledger-revert-replace (beg end buffer other-beg other-end)
+  "Replace the text from BEG to END with that of BUFFER from OTHER-BEG to OTHER-END."
+  (save-excursion
+    (cond ((= beg end)
+           (goto-char beg)
+           (insert-buffer-substring buffer other-beg other-end))
+          ((fboundp 'replace-buffer-contents)
+           (save-restriction
+             (narrow-to-region beg end)
+             (with-current-buffer buffer
+               (narrow-to-region other-beg other-end))
+             (replace-buffer-contents buffer)))
+          (t
+           (delete-region beg end)
+           (goto-char beg)
+           (insert-buffer-substring buffer other-beg other-end)))))
+
+(defun ledger-revert-incremental ()
+  "Bring the current buffer up to date with its file, changing only what differs.
+Return the bounds (BEG . END) of the text that changed, or nil if
+the buffer already matched its file."
+  (let ((file buffer-file-name)
+        (coding buffer-file-coding-system)
+        (buffer (current-buffer))
+        (inhibit-read-only t))
+    (with-temp-buffer
+      (let ((coding-system-for-read coding)
+            (disk (current-buffer)))
+        (insert-file-contents file)
+        (with-current-buffer buffer
+          (save-restriction
+            (widen)
+            (let* ((prefix (ledger-revert-common-prefix disk))
+                   (suffix (ledger-revert-common-suffix
+                            disk (- (min (buffer-size) (buffer-size disk)) prefix)))
+                   (beg (+ (point-min) prefix))
+                   (end (- (point-max) suffix))
+                   (disk-end (- (with-current-buffer disk (point-max)) suffix)))
+              (unless (and (= beg end) (= (+ 1 prefix) disk-end))
+                (ledger-revert-replace beg end disk (+ 1 prefix) disk-end)
+                (cons beg (- (point-max) suffix))))))))))
+
+(defun ledger-revert-buffer (&optional ignore-auto noconfirm preserve-modes)
+  "Revert the current buffer from its file.
+An unmodified buffer is brought up to date by replacing only the
+text that differs from the file, see `ledger-revert-incrementally'.
+Other buffers are reverted as usual.  IGNORE-AUTO, NOCONFIRM and
+PRESERVE-MODES are as for `revert-buffer'."
+  (if (not (and ledger-revert-incrementally
+                buffer-file-name
+                (file-readable-p buffer-file-name)
+                (not (buffer-modified-p))))
+      (if (fboundp 'revert-buffer--default)
+          (revert-buffer--default ignore-auto noconfirm)
+        (let ((revert-buffer-function nil))
+          (revert-buffer ignore-auto noconfirm preserve-modes)))
+    (when (or noconfirm
+              (yes-or-no-p (format "Revert buffer from file %s? "
+                                   buffer-file-name)))
+      (run-hooks 'before-revert-hook)
+      (let ((changed (ledger-revert-incremental)))
+        (set-visited-file-modtime)
+        (set-buffer-modified-p nil)
+        (when changed
+          (run-hook-with-args 'ledger-revert-functions (car changed) (cdr changed))))
+      (run-hooks 'after-revert-hook)
+      t)))
+
+(provide 'ledger-revert)
+
+;;; ledger-revert.el ends here
@@ -0,0 +1,351 @@
+;;; ledger-search.el --- Full-text search over ledger transactions
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; An inverted index over the payees, notes and tags of every
+;; transaction in the journal.  A buffer is indexed the first time it
+;; is searched; after that the change events of ledger-track.el tell
+;; which transactions to index again, so a query costs little more
+;; than the lookup of its terms.
+
+;;; Code:
+
+(require 'ledger-xact)
+(require 'ledger-track)
+(require 'ledger-verify)
+(require 'ledger-report) ; for ledger-journal-files
+
+(defgroup ledger-search nil
+  "Options for searching transactions."
+  :group 'ledger)
+
+(defcustom ledger-search-buffer-name "*Ledger Search*"
+  "Name of the buffer listing search results."
+  :type 'string
+  :group 'ledger-search)
+
+(defcustom ledger-search-max-results 100
+  "Maximum number of transactions listed for a query."
+  :type 'integer
+  :group 'ledger-search)
+
+(defcustom ledger-search-field-weights
+  '((payee . 3)
+    (tag . 2)
+    (note . 1))
+  "Weight of a token according to the field it was found in."
+  :type '(alist :key-type symbol :value-type number)
+  :group 'ledger-search)
+
+(defvar-local ledger-search-index nil
+  "Hash table mapping each token to a hash table of xact markers.
+The inner table maps the marker of an xact to the weight of the
+token in that xact.")
+
+(defvar-local ledger-search-xacts nil
+  "Hash table mapping the marker of each indexed xact to its entry.
+An entry is a list (DATE PAYEE TOKENS), TOKENS being an alist of
+the tokens of the xact and their weight.")
+
+(defvar-local ledger-search-files nil
+  "Journal files searched by the query shown in the search buffer.")
+
+(defvar-local ledger-search-query nil
+  "Query shown in the search buffer.")
+
+(defvar ledger-search-history nil
+  "History of search queries.")
+
+(defun ledger-search-tokenize (text)
+  "Return the list of lower case tokens in TEXT."
+  (when text
+    (split-string (downcase text) "[^[:alnum:]]+" t)))
+
+(defun ledger-search-add-tokens (tokens text field)
+  "Add the tokens of TEXT found in FIELD to the alist TOKENS."
+  (let ((weight (or (cdr (assq field ledger-search-field-weights)) 1)))
+    (dolist (token (ledger-search-tokenize text))
+      (let ((cell (assoc token tokens)))
+        (if cell
+            (setcdr cell (+ (cdr cell) weight))
+          (push (cons token weight) tokens))))
+    tokens))
+
+(defun ledger-search-xact-tokens (xact)
+  "Return an alist of the tokens of the parsed XACT and their weight."
+  (let ((tokens (ledger-search-add-tokens nil (plist-get xact :payee) 'payee)))
+    (dolist (note (apply #'append
+                         (plist-get xact :notes)
+                         (mapcar (lambda (posting)
+                                   (plist-get posting :notes))
+                                 (plist-get xact :postings))))
+      (setq tokens (ledger-search-add-tokens tokens note 'note))
+      (dolist (tag (ledger-xact-note-tags note))
+        (setq tokens (ledger-search-add-tokens
+                      tokens (concat (car tag) " " (cdr tag)) 'tag))))
+    tokens))
+
+(defun ledger-search-add-xact (marker xact)
+  "Index the parsed XACT under MARKER."
+  (let ((tokens (ledger-search-xact-tokens xact)))
+    (puthash marker
+             (list (plist-get xact :date) (plist-get xact :payee) tokens)
+             ledger-search-xacts)
+    (dolist (token tokens)
+      (let ((postings (gethash (car token) ledger-search-index)))
+        (unless postings
+          (setq postings (make-hash-table :test 'eq))
+          (puthash (car token) postings ledger-search-index))
+        (puthash marker (cdr token) postings)))))
+
+(defun ledger-search-remove-xact (marker)
+  "Remove the xact indexed under MARKER."
+  (let ((entry (gethash marker ledger-search-xacts)))
+    (when entry
+      (dolist (token (nth 2 entry))
+        (let ((postings (gethash (car token) ledger-search-index)))
+          (when postings
+            (remhash marker postings)
+            (when (zerop (hash-table-count postings))
+              (remhash (car token) ledger-search-index)))))
+      (remhash marker ledger-search-xacts))))
+
+(defun ledger-search-index-xact (marker)
+  "Index the xact starting at MARKER."
+  (let ((xact (ledger-xact-parse-at marker)))
+    (when xact
+      (ledger-search-add-xact marker xact))))
+
+(defun ledger-search-track (events)
+  "Update the index for the structural change EVENTS."
+  (save-restriction
+    (widen)
+    (dolist (event events)
+      (let ((marker (plist-get event :marker)))
+        (ledger-search-remove-xact marker)
+        (when (and (not (eq (plist-get event :op) 'removed))
+                   (eq (plist-get event :kind) 'xact))
+          (ledger-search-index-xact marker))))))
+
+(defun ledger-search-build ()
+  "Index every transaction of the current buffer."
+  (setq ledger-search-index (make-hash-table :test 'equal)
+        ledger-search-xacts (make-hash-table :test 'eq))
+  (save-restriction
+    (widen)
+    (mapc #'ledger-search-index-xact (ledger-track-markers 'xact)))
+  (ledger-track-subscribe 'ledger-search-track))
+
+(defun ledger-search-update ()
+  "Bring the index of the current buffer up to date."
+  (if ledger-search-xacts
+      (ledger-track-flush)
+    (ledger-search-build)))
+
+(defun ledger-search-entries (entries)
+  "Return ENTRIES, (POSITION PAYEE TOKENS) lists, in a canonical order."
+  (sort (mapcar (lambda (entry)
+                  (list (nth 0 entry) (nth 1 entry)
+                        (sort (copy-sequence (nth 2 entry))
+                              (lambda (a b) (string< (car a) (car b))))))
+                entries)
+        (lambda (a b) (< (car a) (car b)))))
+
+(defun ledger-search-snapshot ()
+  "Return the index of the buffer as (POSITION PAYEE TOKENS) lists."
+  (if (null ledger-search-xacts)
+      :inactive
+    (ledger-track-flush)
+    (let (entries)
+      (maphash (lambda (marker entry)
+                 (push (list (marker-position marker) (nth 1 entry) (nth 2 entry))
+                       entries))
+               ledger-search-xacts)
+      (ledger-search-entries entries))))
+
+(defun ledger-search-rescan ()
+  "Return the index of the buffer computed from scratch, as for `ledger-search-snapshot'."
+  (save-restriction
+    (widen)
+    (let (entries)
+      (dolist (element (ledger-track-scan))
+        (when (eq (nth 1 element) 'xact)
+          (let ((xact (ledger-xact-parse-at (car element))))
+            (push (list (car element) (plist-get xact :payee)
+                        (ledger-search-xact-tokens xact))
+                  entries))))
+      (ledger-search-entries entries))))
+
+(ledger-verify-register 'ledger-search 'ledger-search-snapshot 'ledger-search-rescan)
+
+(defun ledger-search-term-postings (term)
+  "Return the hash tables of xacts of the current buffer matching TERM.
+TERM is matched as a prefix when it ends with `*'."
+  (if (string-match "\\*\\'" term)
+      (let ((prefix (substring term 0 -1))
+            tables)
+        (maphash (lambda (token postings)
+                   (when (string-prefix-p prefix token)
+                     (push postings tables)))
+                 ledger-search-index)
+        tables)
+    (let ((postings (gethash term ledger-search-index)))
+      (when postings
+        (list postings)))))
+
+(defun ledger-search-term-weight (marker tables)
+  "Return the weight of the xact at MARKER in TABLES, nil if absent."
+  (let (weight)
+    (dolist (table tables)
+      (let ((w (gethash marker table)))
+        (when (and w (or (null weight) (> w weight)))
+          (setq weight w))))
+    weight))
+
+(defun ledger-search-journal (terms files)
+  "Return the xacts of FILES containing all TERMS, best matches first.
+Each match is a list (SCORE MARKER DATE PAYEE).  Scores weigh
+the field a term was found in by the rarity of the term over the
+whole journal."
+  (let ((df (make-vector (length terms) 0))
+        (total 0)
+        candidates
+        matches)
+    (dolist (file files)
+      (with-current-buffer (find-file-noselect file)
+        (ledger-search-update)
+        (setq total (+ total (hash-table-count ledger-search-xacts)))
+        (let ((term-tables (mapcar #'ledger-search-term-postings terms))
+              (i 0))
+          (dolist (tables term-tables)
+            (dolist (table tables)
+              (aset df i (+ (aref df i) (hash-table-count table))))
+            (setq i (1+ i)))
+          (unless (memq nil term-tables)
+            (push (cons (current-buffer) term-tables) candidates)))))
+    (let ((idf (mapcar (lambda (n)
+                         (log (1+ (/ (float total) (max n 1)))))
+                       df)))
+      (dolist (candidate candidates)
+        (with-current-buffer (car candidate)
+          (let* ((term-tables (cdr candidate))
+                 (rarest (car (sort (copy-sequence term-tables)
+                                    (lambda (a b)
+                                      (< (apply #'+ (mapcar #'hash-table-count a))
+                                         (apply #'+ (mapcar #'hash-table-count b)))))))
+                 (seen (make-hash-table :test 'eq)))
+            (dolist (table rarest)
+              (maphash
+               (lambda (marker _weight)
+                 (unless (gethash marker seen)
+                   (puthash marker t seen)
+                   (let ((score 0)
+                         (weights idf)
+                         (tables term-tables))
+                     (while (and score tables)
+                       (let ((weight (ledger-search-term-weight marker (car tables))))
+                         (setq score (and weight (+ score (* weight (car weights))))
+                               weights (cdr weights)
+                               tables (cdr tables))))
+                     (when score
+                       (let ((entry (gethash marker ledger-search-xacts)))
+                         (push (list score marker (nth 0 entry) (nth 1 entry))
+                               matches))))))
+               table))))))
+    (sort matches
+          (lambda (a b)
+            (or (> (car a) (car b))
+                (and (= (car a) (car b))
+                     (nth 2 a) (nth 2 b)
+                     (ledger-time-less-p (nth 2 b) (nth 2 a))))))))
+
+(defvar ledger-search-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [return] 'ledger-report-visit-source)
+    (define-key map [?g] 'ledger-search-redo)
+    (define-key map [?s] 'ledger-search)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-search-mode'.")
+
+(define-derived-mode ledger-search-mode text-mode "Ledger-Search"
+  "A mode for listing the transactions matching a search.")
+
+(defun ledger-search-display (query files)
+  "Run QUERY over FILES and list the matches in the search buffer."
+  (let* ((start (float-time))
+         (matches (ledger-search-journal (ledger-search-tokenize-query query)
+                                         files))
+         (elapsed (* 1000 (- (float-time) start)))
+         (count (length matches)))
+    (with-current-buffer (get-buffer-create ledger-search-buffer-name)
+      (let ((inhibit-read-only t))
+        (erase-buffer)
+        (ledger-search-mode)
+        (setq ledger-search-query query
+              ledger-search-files files)
+        (insert (format "Search: %s\n%d matching transactions\n\n" query count))
+        (dolist (match (if (> count ledger-search-max-results)
+                           (butlast matches (- count ledger-search-max-results))
+                         matches))
+          (let ((beg (point))
+                (marker (nth 1 match)))
+            (insert (format "%7.2f  %s  %s\n"
+                            (nth 0 match)
+                            (if (nth 2 match) (ledger-format-date (nth 2 match)) "")
+                            (or (nth 3 match) "")))
+            (set-text-properties beg (1- (point))
+                                 (list 'ledger-source
+                                       (cons (buffer-file-name (marker-buffer marker))
+                                             marker)
+                                       'font-lock-face
+                                       'ledger-font-report-clickable-face))))
+        (goto-char (point-min))
+        (set-buffer-modified-p nil)
+        (setq buffer-read-only t))
+      (display-buffer (current-buffer)))
+    (message "%d matches in %.1f ms" count elapsed)))
+
+(defun ledger-search-tokenize-query (query)
+  "Return the terms of QUERY, keeping a trailing `*' on prefix terms."
+  (split-string (downcase query) "[^[:alnum:]*]+" t))
+
+(defun ledger-search (query)
+  "List the transactions of the journal containing every word of QUERY.
+
+Payees, transaction and posting notes, and tag names and values
+are searched.  A word ending with `*' matches as a prefix.
+Matches are ranked by the fields the words were found in and by
+how rare the words are in the journal."
+  (interactive
+   (list (read-string "Search transactions: " nil 'ledger-search-history)))
+  (ledger-search-display query (or ledger-search-files
+                                   (ledger-journal-files))))
+
+(defun ledger-search-redo ()
+  "Run the query of the search buffer again."
+  (interactive)
+  (when ledger-search-query
+    (ledger-search-display ledger-search-query ledger-search-files)))
+
+(provide 'ledger-search)
+
+;;; ledger-search.el ends here
@@ -0,0 +1,351 @@
+;;; ledger-snapshot.el --- History of the results of named reports
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; To see how the balances of a report changed since last week, one
+;; would otherwise run it again on an old revision of the journal.
+;; Instead, each time a named report of `ledger-snapshot-reports' runs,
+;; the account totals of its query are read from a balance query of
+;; ledger, see `ledger-query-balances', in the background, and saved as
+;; a snapshot in `ledger-snapshot-directory', together with the time
+;; and a stamp of the journal files.  `ledger-snapshot-compare' lists
+;; the accounts whose total differs between two snapshots of a report.
+;; Snapshots keep their accounts sorted by name, so that comparing them
+;; is a single walk over both lists.
+
+;;; Code:
+
+(require 'ledger-commodities)
+(require 'ledger-compare) ; for ledger-compare-balance-string
+(require 'ledger-exec)
+(require 'ledger-query)
+(require 'ledger-report)
+
+(defvar ledger-buf)
+
+(defgroup ledger-snapshot nil
+  "Options for the history of the results of reports."
+  :group 'ledger)
+
+(defcustom ledger-snapshot-directory (locate-user-emacs-file "ledger-snapshots/")
+  "Directory keeping the snapshots of reports, one file each."
+  :type 'directory
+  :group 'ledger-snapshot)
+
+(defcustom ledger-snapshot-reports nil
+  "Names of the reports of `ledger-reports' whose results are kept.
+t stands for every named report and nil for none.  Each kept
+report runs ledger a second time, in the background."
+  :type '(choice (const :tag "All reports" t)
+                 (const :tag "None" nil)
+                 (repeat (string :tag "Report Name")))
+  :group 'ledger-snapshot)
+
+(defcustom ledger-snapshot-keep 50
+  "Number of snapshots kept for each report, or nil to keep them all.
+The oldest snapshots of a report are deleted as new ones are saved."
+  :type '(choice (const :tag "All" nil) integer)
+  :group 'ledger-snapshot)
+
+(defcustom ledger-snapshot-buffer-name "*Ledger Snapshots*"
+  "Name of the buffer listing the differences between two snapshots."
+  :type 'string
+  :group 'ledger-snapshot)
+
+(defconst ledger-snapshot-command-regexp
+  "\\(?:^\\|[ \t]\\)\\(b\\(?:al\\(?:ance\\)?\\)?\\|r\\(?:eg\\(?:ister\\)?\\)?\\)\\(?:[ \t]\\|$\\)"
+  "Regexp matching the balance or register command of a report command line.
+Group 1 is the command, replaced by a balance query to take a snapshot.")
+
+(defvar-local ledger-snapshot-compared nil
+  "Snapshot files compared in the buffer, a list (OLD NEW).")
+
+(defun ledger-snapshot-prefix (name)
+  "Return the prefix of the file names of the snapshots of the report NAME.
+Bytes of NAME other than ASCII letters and digits are written as
+%XX, so that the prefix is a valid file name and no other report
+gets the same one."
+  (concat (mapconcat (lambda (byte)
+                       (if (or (and (>= byte ?a) (<= byte ?z))
+                               (and (>= byte ?A) (<= byte ?Z))
+                               (and (>= byte ?0) (<= byte ?9)))
+                           (string byte)
+                         (format "%%%02X" byte)))
+                     (encode-coding-string name 'utf-8)
+                     "")
+          "."))
+
+(defun ledger-snapshot-file-regexp (name)
+  "Return a regexp matching the file names of the snapshots of the report NAME.
+Group 1 matches the time of the snapshot and group 2 the start of
+the stamp of the journal."
+  (concat "\\`" (regexp-quote (ledger-snapshot-prefix name))
+          "\\([0-9]\\{8\\}T[0-9]\\{6\\}\\)\\.\\([0-9a-f]+\\)\\.eld\\'"))
+
+(defun ledger-snapshot-files (name)
+  "Return the snapshot files of the report NAME, oldest first."
+  (when (file-directory-p ledger-snapshot-directory)
+    (directory-files ledger-snapshot-directory t
+                     (ledger-snapshot-file-regexp name))))
+
+(defun ledger-snapshot-journal-hash (files)
+  "Return a stamp of the saved contents of FILES.
+It is a checksum of their names, modification times and sizes,
+rather than of their contents, which would be read for each report."
+  (secure-hash 'sha1
+               (mapconcat (lambda (file)
+                            (let ((attributes (file-attributes file)))
+                              (format "%s %S %S" file
+                                      (nth 5 attributes) (nth 7 attributes))))
+                          files "\n")))
+
+(defun ledger-snapshot-accounts (accounts)
+  "Return the totals of ACCOUNTS as kept in snapshots.
+ACCOUNTS are plists as returned by `ledger-query-balances'.  The
+result is a list of (ACCOUNT . TOTAL) sorted by account."
+  (sort (mapcar (lambda (account)
+                  (cons (plist-get account :account) (plist-get account :total)))
+                accounts)
+        (lambda (a b) (string< (car a) (car b)))))
+
+(defun ledger-snapshot-save (snapshot)
+  "Write SNAPSHOT to `ledger-snapshot-directory' and return its file name.
+SNAPSHOT is a list (NAME TIME HASH COMMAND ACCOUNTS): the report
+NAME was run by the shell COMMAND at TIME, as returned by
+`float-time', on a journal whose files have the stamp HASH, see
+`ledger-snapshot-journal-hash'.  ACCOUNTS are the account totals,
+see `ledger-snapshot-accounts'.  The oldest snapshots of the report
+beyond `ledger-snapshot-keep' are deleted."
+  (let ((file (expand-file-name
+               (concat (ledger-snapshot-prefix (nth 0 snapshot))
+                       (format-time-string "%Y%m%dT%H%M%S"
+                                           (seconds-to-time (nth 1 snapshot)))
+                       "." (substring (nth 2 snapshot) 0 12) ".eld")
+               ledger-snapshot-directory))
+        (coding-system-for-write 'utf-8)
+        (print-length nil)
+        (print-level nil))
+    (make-directory ledger-snapshot-directory t)
+    (with-temp-file file
+      (insert ";; Snapshot of a ledger report, see ledger-snapshot.el\n")
+      (prin1 snapshot (current-buffer))
+      (insert "\n"))
+    (when ledger-snapshot-keep
+      (dolist (old (butlast (ledger-snapshot-files (nth 0 snapshot))
+                            ledger-snapshot-keep))
+        (delete-file old)))
+    file))
+
+(defun ledger-snapshot-read (file)
+  "Return the snapshot saved in FILE, see `ledger-snapshot-save'."
+  (with-temp-buffer
+    (let ((coding-system-for-read 'utf-8))
+      (insert-file-contents file))
+    (read (current-buffer))))
+
+(defun ledger-snapshot-receive (snapshot output)
+  "Save SNAPSHOT with the accounts of the balance query in the buffer OUTPUT."
+  (setcar (nthcdr 4 snapshot)
+          (ledger-snapshot-accounts
+           (with-current-buffer output
+             (ledger-query-collect-balances (ledger-query-read-records)))))
+  (ledger-snapshot-save snapshot))
+
+(defun ledger-snapshot-query (cmd)
+  "Return the report command line CMD with its command made a balance query.
+The query prints the records read by `ledger-query-read-records'.
+Return nil if CMD runs neither the balance nor the register command."
+  (when (string-match ledger-snapshot-command-regexp cmd)
+    (replace-match (mapconcat #'shell-quote-argument
+                              (cons "balance" ledger-query-balance-options)
+                              " ")
+                   t t cmd 1)))
+
+(defun ledger-snapshot-start (command snapshot)
+  "Run the shell COMMAND in the background and save SNAPSHOT with its output.
+COMMAND must print the output of a balance query, see
+`ledger-snapshot-query'.  Return the process."
+  (ledger-exec-start (list shell-file-name shell-command-switch command)
+                     (apply-partially #'ledger-snapshot-receive snapshot)))
+
+(defun ledger-snapshot-wanted-p (name)
+  "Return non-nil if the results of the report NAME are to be kept."
+  (and name
+       (ledger-report-name-exists name)
+       (or (eq ledger-snapshot-reports t)
+           (member name ledger-snapshot-reports))))
+
+(defun ledger-snapshot-record (cmd)
+  "Take a snapshot of the report of the current report buffer, run by CMD.
+The same command line runs again in the background with its
+balance or register command replaced by a balance query, see
+`ledger-snapshot-query'.  Reports of other commands are not
+recorded."
+  (let* ((name ledger-report-name)
+         (command (and (ledger-snapshot-wanted-p name)
+                       (ledger-snapshot-query cmd))))
+    (when command
+      (let ((files (with-current-buffer ledger-buf
+                     (ledger-journal-files))))
+        (ledger-snapshot-start command
+                               (list name (float-time)
+                                     (ledger-snapshot-journal-hash files)
+                                     cmd nil))))))
+
+(add-hook 'ledger-report-functions #'ledger-snapshot-record)
+
+(defun ledger-snapshot-difference (old new)
+  "Return the balance NEW minus OLD, without the amounts that did not change."
+  (let (difference)
+    (dolist (amount new)
+      (let* ((other (ledger-query-balance-amount old (nth 1 amount)))
+             (delta (- (car amount) (if other (car other) 0))))
+        (unless (zerop delta)
+          (push (list delta (nth 1 amount)) difference))))
+    (dolist (amount old)
+      (unless (or (zerop (car amount))
+                  (ledger-query-balance-amount new (nth 1 amount)))
+        (push (list (- (car amount)) (nth 1 amount)) difference)))
+    (nreverse difference)))
+
+(defun ledger-snapshot-diff (old new)
+  "Return the accounts whose total differs between OLD and NEW.
+OLD and NEW are the accounts of two snapshots, sorted by account,
+see `ledger-snapshot-accounts'; they are walked once side by side.
+The result is a list of (ACCOUNT OLD-TOTAL NEW-TOTAL DIFFERENCE)
+sorted by account, a total being nil for an account missing on its
+side."
+  (let (changes)
+    (while (or old new)
+      (let* ((a (car old))
+             (b (car new))
+             (name (if (and a (or (null b) (not (string< (car b) (car a)))))
+                       (car a)
+                     (car b)))
+             (old-total (when (and a (string= (car a) name))
+                          (setq old (cdr old))
+                          (cdr a)))
+             (new-total (when (and b (string= (car b) name))
+                          (setq new (cdr new))
+                          (cdr b)))
+             (difference (ledger-snapshot-difference old-total new-total)))
+        (when difference
+          (push (list name old-total new-total difference) changes))))
+    (nreverse changes)))
+
+(defvar ledger-snapshot-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [?g] 'ledger-snapshot-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-snapshot-mode'.")
+
+(define-derived-mode ledger-snapshot-mode text-mode "Ledger-Snapshot"
+  "A mode for listing the accounts whose total changed between two snapshots.")
+
+(defun ledger-snapshot-label (file)
+  "Return the time and journal stamp of the snapshot FILE, for display."
+  (let ((base (file-name-nondirectory file)))
+    (if (string-match "\\.\\([0-9]\\{8\\}\\)T\\([0-9]\\{6\\}\\)\\.\\([0-9a-f]+\\)\\.eld\\'"
+                      base)
+        (let ((date (match-string 1 base))
+              (time (match-string 2 base)))
+          (format "%s-%s-%s %s:%s:%s  %s"
+                  (substring date 0 4) (substring date 4 6) (substring date 6 8)
+                  (substring time 0 2) (substring time 2 4) (substring time 4 6)
+                  (match-string 3 base)))
+      base)))
+
+(defun ledger-snapshot-display (old-file new-file)
+  "List the accounts whose total differs between OLD-FILE and NEW-FILE."
+  (let* ((old (ledger-snapshot-read old-file))
+         (new (ledger-snapshot-read new-file))
+         (start (float-time))
+         (changes (ledger-snapshot-diff (nth 4 old) (nth 4 new)))
+         (elapsed (- (float-time) start)))
+    (with-current-buffer (get-buffer-create ledger-snapshot-buffer-name)
+      (let ((inhibit-read-only t))
+        (erase-buffer)
+        (ledger-snapshot-mode)
+        (setq ledger-snapshot-compared (list old-file new-file))
+        (insert (format "Report %s from %s to %s: %d accounts changed\n"
+                        (car new)
+                        (ledger-snapshot-label old-file)
+                        (ledger-snapshot-label new-file)
+                        (length changes)))
+        (when (equal (nth 2 old) (nth 2 new))
+          (insert "The journal did not change\n"))
+        (unless (equal (nth 3 old) (nth 3 new))
+          (insert (format "The command changed from %s\n" (nth 3 old))))
+        (insert "\n")
+        (dolist (change changes)
+          (insert (format "%-40s %20s -> %-20s (%s)\n"
+                          (car change)
+                          (ledger-compare-balance-string (nth 1 change))
+                          (ledger-compare-balance-string (nth 2 change))
+                          (ledger-compare-balance-string (nth 3 change)))))
+        (goto-char (point-min))
+        (set-buffer-modified-p nil)
+        (setq buffer-read-only t))
+      (display-buffer (current-buffer)))
+    (message "%d accounts changed, compared in %.3f s" (length changes) elapsed)))
+
+(defun ledger-snapshot-read-file (prompt files default)
+  "Read one of the snapshot FILES with PROMPT, DEFAULT being the default."
+  (let ((labels (mapcar (lambda (file) (cons (ledger-snapshot-label file) file))
+                        files)))
+    (cdr (assoc (completing-read prompt labels nil t nil nil
+                                 (ledger-snapshot-label default))
+                labels))))
+
+(defun ledger-snapshot-compare (old new)
+  "List the accounts whose total differs between the snapshot files OLD and NEW.
+
+Snapshots of a named report of `ledger-reports' are taken each
+time it runs, see `ledger-snapshot-reports'.  Interactively, read
+the name of the report, then the new and old snapshots, which
+default to the last two.  Each account is listed with its total
+in both snapshots and the difference."
+  (interactive
+   (let* ((name (completing-read "Report name: " ledger-reports nil t nil
+                                 'ledger-report-name-prompt-history
+                                 ledger-report-name))
+          (files (ledger-snapshot-files name)))
+     (unless files
+       (error "No snapshot of the report %s" name))
+     (let ((new (ledger-snapshot-read-file "New snapshot: " files
+                                           (car (last files)))))
+       (list (ledger-snapshot-read-file "Old snapshot: " files
+                                        (car (last files 2)))
+             new))))
+  (ledger-snapshot-display old new))
+
+(defun ledger-snapshot-redo ()
+  "Compare the old snapshot of the buffer with the latest one of its report."
+  (interactive)
+  (let ((old (car ledger-snapshot-compared)))
+    (ledger-snapshot-display
+     old
+     (car (last (ledger-snapshot-files (car (ledger-snapshot-read old))))))))
+
+(provide 'ledger-snapshot)
+
+;;; ledger-snapshot.el ends here
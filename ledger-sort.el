@@ -27,6 +27,8 @@
 ;;; Code:
 (require 'ledger-regex)
 (require 'ledger-navigate)
+(require 'ledger-track)
+(require 'ledger-xact) ; for ledger-parse-iso-date
 
 (defun ledger-sort-find-start ()
   "Find the beginning of a sort region."
@@ -112,6 +114,230 @@
     (ledger-sort-region (or sort-start (point-min))
                         (or sort-end (point-max)))))
 
+;; `ledger-sort-keep-mode' moves a transaction whose date was edited
+;; to its place once point leaves it.  The buffer is assumed sorted
+;; otherwise, so the place is found by a binary search over the
+;; records of ledger-track.el, rather than by sorting the buffer again.
+
+(defvar-local ledger-sort-edited nil
+  "Markers at the start of the xacts whose date was edited.
+A marker may appear several times.")
+
+(defvar-local ledger-sort-moving nil
+  "Non-nil while `ledger-sort-keep-mode' moves an xact.")
+
+(defun ledger-sort-xact-day (pos)
+  "Return the day number of the date of the xact starting at POS, or nil."
+  (save-excursion
+    (goto-char pos)
+    (when (looking-at ledger-iso-date-regexp)
+      (let ((date (ledger-parse-iso-date (match-string-no-properties 0))))
+        (when date
+          (time-to-days date))))))
+
+(defun ledger-sort-after-change (beg _end _len)
+  "Note an edit of the date of the xact at BEG."
+  (unless (or ledger-sort-moving undo-in-progress)
+    (save-excursion
+      (save-match-data
+        (goto-char beg)
+        (beginning-of-line)
+        (when (and (looking-at ledger-iso-date-regexp)
+                   (<= beg (match-end 0))
+                   ;; Edits often repeat in the same xact.
+                   (not (eql (point) (and ledger-sort-edited
+                                          (marker-position (car ledger-sort-edited))))))
+          (push (copy-marker (point)) ledger-sort-edited))))))
+
+(defun ledger-sort-region-bounds (pos)
+  "Return the (BEG . END) bounds of the sort region holding POS.
+See `ledger-sort-buffer'."
+  (let ((beg (point-min))
+        (end (point-max)))
+    (save-excursion
+      (goto-char (point-min))
+      (let ((start (ledger-sort-find-start))
+            (stop (ledger-sort-find-end)))
+        (when (and start (< start pos))
+          (setq beg start))
+        (when (and stop (< pos stop))
+          (setq end stop))))
+    (cons beg end)))
+
+(defun ledger-sort-next-xact (index limit skip)
+  "Return the index of the first xact record from INDEX on, or LIMIT.
+Records are those of `ledger-track-records' before index LIMIT,
+leaving out the xacts whose start is a key of the hash table SKIP."
+  (let ((records ledger-track-records))
+    (while (and (< index limit)
+                (let ((record (aref records index)))
+                  (or (not (eq (aref record 1) 'xact))
+                      (gethash (marker-position (aref record 0)) skip))))
+      (setq index (1+ index)))
+    index))
+
+(defun ledger-sort-previous-xact (index low skip)
+  "Return the start of the last xact record before INDEX, or nil.
+Records are those of `ledger-track-records' from index LOW on,
+leaving out the xacts whose start is a key of the hash table SKIP."
+  (let ((records ledger-track-records)
+        start)
+    (while (and (null start) (> index low))
+      (setq index (1- index))
+      (let ((record (aref records index)))
+        (when (and (eq (aref record 1) 'xact)
+                   (not (gethash (marker-position (aref record 0)) skip)))
+          (setq start (marker-position (aref record 0))))))
+    start))
+
+(defun ledger-sort-search (low limit skip after-p)
+  "Return the index of the first xact record satisfying AFTER-P, or LIMIT.
+Records are those of `ledger-track-records' from index LOW up to
+LIMIT, leaving out the xacts starting at the keys of the hash
+table SKIP.  AFTER-P is called
+with the start of an xact and must hold for all the xacts
+following one for which it holds.  Other records take the value
+of the next xact, so the search stays a binary one."
+  (let ((high limit))
+    (while (< low high)
+      (let* ((middle (/ (+ low high) 2))
+             (xact (ledger-sort-next-xact middle high skip)))
+        (if (or (= xact high)
+                (funcall after-p (aref (aref ledger-track-records xact) 0)))
+            (setq high middle)
+          (setq low (1+ xact)))))
+    (ledger-sort-next-xact low limit skip)))
+
+(defun ledger-sort-dated-after-p (day start)
+  "Return non-nil if the xact at START is dated after DAY."
+  (> (or (ledger-sort-xact-day start) day) day))
+
+(defun ledger-sort-move-xact (pos &optional pending)
+  "Move the xact starting at POS to the place of its date among the others.
+PENDING are the markers of other edited xacts still to be moved,
+which are left out as they may not be in place."
+  (ledger-track-enable)
+  (ledger-track-flush)
+  (let* ((skip (let ((table (make-hash-table)))
+                 (puthash pos t table)
+                 (dolist (marker pending)
+                   (puthash (marker-position marker) t table))
+                 table))
+         (day (ledger-sort-xact-day pos))
+         (bounds (and day (ledger-sort-region-bounds pos)))
+         (low (and day (ledger-track-index (car bounds))))
+         (limit (and day (ledger-track-index (cdr bounds))))
+         (here (and day (ledger-sort-next-xact (ledger-track-index (1+ pos)) limit skip)))
+         (slot (and day (ledger-sort-search low limit skip
+                                            (apply-partially 'ledger-sort-dated-after-p
+                                                             day))))
+         (following (and slot (< slot limit)
+                         (marker-position (aref (aref ledger-track-records slot) 0))))
+         (preceding (and slot (ledger-sort-previous-xact slot low skip))))
+    (unless (or (null day)
+                ;; Already in place between its neighbours.
+                (and (let ((previous (ledger-sort-previous-xact here low skip)))
+                       (or (null previous)
+                           (not (ledger-sort-dated-after-p day previous))))
+                     (or (= here limit)
+                         (>= (or (ledger-sort-xact-day
+                                  (aref (aref ledger-track-records here) 0))
+                                 day)
+                             day))))
+      (let* ((extents (ledger-navigate-find-xact-extents pos))
+             (text (buffer-substring (car extents) (cadr extents)))
+             (point (copy-marker (point) t))
+             (target (copy-marker (if following
+                                      following
+                                    (nth 1 (ledger-navigate-find-xact-extents preceding)))))
+             (ledger-sort-moving t)
+             beg end)
+        (save-excursion
+          (goto-char (cadr extents))
+          (skip-chars-forward " \t\n")
+          (if (< (point) (point-max))
+              (setq beg (car extents)
+                    end (point))
+            ;; The last xact takes the blank lines before it along.
+            (goto-char (car extents))
+            (skip-chars-backward " \t\n")
+            (setq beg (point)
+                  end (cadr extents)))
+          ;; Deleting and inserting within one command makes one undo step.
+          (delete-region beg end)
+          (goto-char target)
+          (if following
+              (let ((edited (delq nil (mapcar (lambda (marker)
+                                                (and (= marker target) marker))
+                                              ledger-sort-edited))))
+                (insert text "\n\n")
+                ;; Edited xacts stay with their text.
+                (dolist (marker edited)
+                  (set-marker marker (point))))
+            (insert "\n\n" text)))
+        (goto-char point)
+        (set-marker point nil)
+        (set-marker target nil)))))
+
+(defun ledger-sort-forget-edited ()
+  "Forget the xacts whose date was edited."
+  (dolist (marker ledger-sort-edited)
+    (set-marker marker nil))
+  (setq ledger-sort-edited nil))
+
+(defun ledger-sort-keep ()
+  "Move the xacts whose date was edited once point left them."
+  (when ledger-sort-edited
+    (let (leaving)
+      (save-match-data
+        (dolist (marker ledger-sort-edited)
+          (let ((pos (marker-position marker)))
+            (when (or (null pos)
+                      (let ((extents (save-excursion
+                                       (ledger-navigate-find-xact-extents pos))))
+                        (not (and (>= (point) (car extents))
+                                  (<= (point) (cadr extents))))))
+              (push marker leaving))))
+        ;; Each xact is moved once, in buffer order.
+        (let (previous moving)
+          (dolist (marker (sort leaving (lambda (a b)
+                                          (< (or (marker-position a) 0)
+                                             (or (marker-position b) 0)))))
+            (if (and (marker-position marker)
+                     (not (eql (marker-position marker) previous)))
+                (progn
+                  (setq previous (marker-position marker))
+                  (push marker moving))
+              (setq ledger-sort-edited (delq marker ledger-sort-edited))
+              (set-marker marker nil)))
+          (setq moving (nreverse moving))
+          (while moving
+            (let* ((marker (pop moving))
+                   (pos (marker-position marker)))
+              (setq ledger-sort-edited (delq marker ledger-sort-edited))
+              (set-marker marker nil)
+              (save-restriction
+                (widen)
+                (ledger-sort-move-xact pos moving)))))))))
+
+(define-minor-mode ledger-sort-keep-mode
+  "Keep the transactions of the buffer sorted by date as they are edited.
+When the date of a transaction is changed, the transaction is
+moved to the place of its new date once point leaves it.  The
+move is undone by one undo."
+  nil
+  " Sorted"
+  nil
+  (if ledger-sort-keep-mode
+      (progn
+        ;; Scan the buffer now rather than on the first move.
+        (ledger-track-enable)
+        (add-hook 'after-change-functions 'ledger-sort-after-change nil t)
+        (add-hook 'post-command-hook 'ledger-sort-keep nil t))
+    (remove-hook 'after-change-functions 'ledger-sort-after-change t)
+    (remove-hook 'post-command-hook 'ledger-sort-keep t)
+    (ledger-sort-forget-edited)))
+
 (provide 'ledger-sort)
 
 ;;; ledger-sort.el ends here
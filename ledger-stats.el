@@ -0,0 +1,207 @@
+;;; ledger-stats.el --- Statistics of the journal from its index
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; `ledger-stats' shows where the size of the journal and the time
+;; spent parsing it go: the size and number of transactions of each
+;; file, the transactions per year, the number of accounts and
+;; payees, the transactions with the most postings, and how long the
+;; last scan and index build of each file took.  Everything comes
+;; from the index of ledger-index.el, without running ledger.
+
+;;; Code:
+
+(require 'calendar)
+(require 'ledger-index)
+(require 'ledger-report) ; for ledger-report-visit-source
+
+(defgroup ledger-stats nil
+  "Options for the statistics of the journal."
+  :group 'ledger)
+
+(defcustom ledger-stats-buffer-name "*Ledger Statistics*"
+  "Name of the buffer showing the statistics of the journal."
+  :type 'string
+  :group 'ledger-stats)
+
+(defcustom ledger-stats-largest 10
+  "Number of transactions listed as the largest of the journal."
+  :type 'integer
+  :group 'ledger-stats)
+
+(defvar-local ledger-stats-files nil
+  "Journal files whose statistics are shown in the buffer.")
+
+(defun ledger-stats-file (buffer)
+  "Return the statistics of the indexed BUFFER of a journal file.
+The result is a plist with the keys :file, :size, :xacts,
+:postings, :years, :scan-time and :build-time.  :years is an
+alist of (YEAR . COUNT) sorted by year."
+  (with-current-buffer buffer
+    (let ((years (make-hash-table))
+          (postings 0)
+          alist)
+      (maphash (lambda (_marker record)
+                 (let ((year (nth 2 (calendar-gregorian-from-absolute (aref record 0)))))
+                   (puthash year (1+ (gethash year years 0)) years))
+                 (setq postings (+ postings (length (aref record 2)))))
+               ledger-index-xacts)
+      (maphash (lambda (year count) (push (cons year count) alist)) years)
+      (list :file (buffer-file-name)
+            :size (or (nth 7 (file-attributes (buffer-file-name)))
+                      (buffer-size))
+            :xacts (hash-table-count ledger-index-xacts)
+            :postings postings
+            :years (sort alist (lambda (a b) (< (car a) (car b))))
+            :scan-time ledger-track-scan-time
+            :build-time ledger-index-build-time))))
+
+(defun ledger-stats-largest-p (a b)
+  "Return non-nil if the (MARKER . RECORD) A has more postings than B."
+  (> (length (aref (cdr a) 2)) (length (aref (cdr b) 2))))
+
+(defun ledger-stats-journal (buffers)
+  "Return the statistics of the indexed BUFFERS of a journal.
+The result is a plist with the keys :files, a list of the
+statistics of each file as returned by `ledger-stats-file',
+:accounts and :payees, the number of distinct accounts and
+payees, and :largest, the (MARKER . RECORD) of the
+`ledger-stats-largest' transactions with the most postings."
+  (let ((accounts (make-hash-table :test 'equal))
+        (payees (make-hash-table :test 'equal))
+        largest)
+    (dolist (buffer buffers)
+      (maphash (lambda (marker record)
+                 (when (aref record 1)
+                   (puthash (aref record 1) t payees))
+                 (dolist (posting (aref record 2))
+                   (puthash (car posting) t accounts))
+                 ;; Keep the largest sorted, dropping the smallest.
+                 (when (and (> ledger-stats-largest 0)
+                            (or (< (length largest) ledger-stats-largest)
+                                (ledger-stats-largest-p (cons marker record)
+                                                        (car (last largest)))))
+                   (setq largest (sort (cons (cons marker record) largest)
+                                       'ledger-stats-largest-p))
+                   (when (> (length largest) ledger-stats-largest)
+                     (setcdr (nthcdr (1- ledger-stats-largest) largest) nil))))
+               (buffer-local-value 'ledger-index-xacts buffer)))
+    (list :files (mapcar #'ledger-stats-file buffers)
+          :accounts (hash-table-count accounts)
+          :payees (hash-table-count payees)
+          :largest largest)))
+
+(defvar ledger-stats-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [return] 'ledger-report-visit-source)
+    (define-key map [?g] 'ledger-stats-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-stats-mode'.")
+
+(define-derived-mode ledger-stats-mode text-mode "Ledger-Stats"
+  "A mode for showing the statistics of a journal.")
+
+(defun ledger-stats-seconds (seconds)
+  "Return SECONDS as a string, or \"-\" if nil."
+  (if seconds (format "%.3f s" seconds) "-"))
+
+(defun ledger-stats-insert (stats)
+  "Insert the statistics STATS of a journal."
+  (let ((files (plist-get stats :files))
+        (years (make-hash-table)))
+    (insert "Files\n\n")
+    (insert (format "  %-40s %10s %8s %8s %10s %10s\n"
+                    "File" "Bytes" "Xacts" "Postings" "Scan" "Index"))
+    (dolist (file files)
+      (insert (format "  %-40s %10d %8d %8d %10s %10s\n"
+                      (file-name-nondirectory (plist-get file :file))
+                      (plist-get file :size)
+                      (plist-get file :xacts)
+                      (plist-get file :postings)
+                      (ledger-stats-seconds (plist-get file :scan-time))
+                      (ledger-stats-seconds (plist-get file :build-time))))
+      (dolist (year (plist-get file :years))
+        (puthash (car year) t years)))
+    (insert "\nTransactions per year\n\n")
+    (let (sorted)
+      (maphash (lambda (year _) (push year sorted)) years)
+      (dolist (year (sort sorted #'<))
+        (insert (format "  %d\n" year))
+        (dolist (file files)
+          (let ((count (cdr (assq year (plist-get file :years)))))
+            (when count
+              (insert (format "    %-38s %8d\n"
+                              (file-name-nondirectory (plist-get file :file))
+                              count)))))))
+    (insert (format "\n%d accounts, %d payees\n"
+                    (plist-get stats :accounts)
+                    (plist-get stats :payees)))
+    (insert "\nLargest transactions\n\n")
+    (dolist (entry (plist-get stats :largest))
+      (let ((beg (point))
+            (marker (car entry))
+            (record (cdr entry)))
+        (insert (format "  %s  %-40s %4d postings\n"
+                        (ledger-format-date (ledger-index-day-date (aref record 0)))
+                        (or (aref record 1) "")
+                        (length (aref record 2))))
+        (set-text-properties beg (1- (point))
+                             (list 'ledger-source
+                                   (cons (buffer-file-name (marker-buffer marker))
+                                         marker)
+                                   'font-lock-face
+                                   'ledger-font-report-clickable-face))))))
+
+(defun ledger-stats-display (files)
+  "Show the statistics of FILES in the statistics buffer."
+  (let ((stats (ledger-stats-journal (ledger-index-buffers files))))
+    (with-current-buffer (get-buffer-create ledger-stats-buffer-name)
+      (let ((inhibit-read-only t))
+        (erase-buffer)
+        (ledger-stats-mode)
+        (setq ledger-stats-files files)
+        (ledger-stats-insert stats)
+        (goto-char (point-min))
+        (set-buffer-modified-p nil)
+        (setq buffer-read-only t))
+      (display-buffer (current-buffer)))))
+
+(defun ledger-stats (&optional files)
+  "Show statistics of the journal taken from its index.
+
+The size, number of transactions and postings of each file are
+listed with the time taken by the last scan and index build of the
+file, followed by the transactions per year and file, the number of
+accounts and payees, and the `ledger-stats-largest' transactions
+with the most postings; RET visits the transaction at point.
+FILES default to the files of the journal of the current buffer."
+  (interactive)
+  (ledger-stats-display (or files (ledger-journal-files))))
+
+(defun ledger-stats-redo ()
+  "Show the statistics of the files of the statistics buffer again."
+  (interactive)
+  (ledger-stats-display ledger-stats-files))
+
+(provide 'ledger-stats)
+
+;;; ledger-stats.el ends here
@@ -0,0 +1,131 @@
+;;; ledger-sum.el --- Totals of the amounts in the region
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; `ledger-sum-mode' shows in the mode line how many posting amounts
+;; the active region holds and their totals per commodity.  The
+;; region counts the whole lines it touches.  As the region grows or
+;; shrinks, only the lines entering or leaving it are parsed, with
+;; `ledger-parse-amount', and their amounts added to or subtracted
+;; from the totals.
+
+;;; Code:
+
+(require 'ledger-commodities)
+(require 'ledger-regex)
+
+(defvar-local ledger-sum-range nil
+  "List (BEG END TICK) of the lines summed, or nil.
+BEG is the start of the first line, END the start of the line
+after the last one, and TICK the modification tick of the buffer
+when they were summed.")
+
+(defvar-local ledger-sum-count 0
+  "Number of amounts in `ledger-sum-range'.")
+
+(defvar-local ledger-sum-totals nil
+  "List of the (VALUE COMMODITY) totals of the amounts in `ledger-sum-range'.")
+
+(defun ledger-sum-total (commodity)
+  "Return the total of COMMODITY in `ledger-sum-totals', adding it if missing."
+  (let ((totals ledger-sum-totals))
+    (while (and totals (not (equal (nth 1 (car totals)) commodity)))
+      (setq totals (cdr totals)))
+    (or (car totals)
+        (let ((total (list 0 commodity)))
+          (setq ledger-sum-totals (append ledger-sum-totals (list total)))
+          total))))
+
+(defun ledger-sum-add (beg end sign)
+  "Add the amounts of the lines from BEG up to END, multiplied by SIGN."
+  (save-excursion
+    (save-match-data
+      (goto-char beg)
+      (while (< (point) end)
+        (when (looking-at ledger-post-line-regexp)
+          (let ((amount (ledger-parse-amount
+                         (match-string-no-properties ledger-regex-post-line-group-amount))))
+            (when amount
+              (let ((total (ledger-sum-total (nth 1 amount))))
+                (setcar total (+ (car total) (* sign (car amount))))
+                (setq ledger-sum-count (+ ledger-sum-count sign))))))
+        (forward-line)))))
+
+(defun ledger-sum-lines (beg end)
+  "Return the (BEG END) range of the whole lines touched by BEG to END."
+  (save-excursion
+    (list (progn (goto-char beg) (line-beginning-position))
+          (progn (goto-char end)
+                 (if (and (bolp) (> end beg))
+                     (point)
+                   (forward-line)
+                   (point))))))
+
+(defun ledger-sum-update ()
+  "Bring the totals up to date with the active region."
+  (if (not (use-region-p))
+      (setq ledger-sum-range nil)
+    (let* ((lines (ledger-sum-lines (region-beginning) (region-end)))
+           (beg (car lines))
+           (end (nth 1 lines))
+           (old ledger-sum-range))
+      (if (and old
+               (eq (nth 2 old) (buffer-chars-modified-tick))
+               (< beg (nth 1 old))
+               (< (car old) end))
+          ;; The ranges overlap: only move their edges.
+          (progn
+            (if (< beg (car old))
+                (ledger-sum-add beg (car old) 1)
+              (ledger-sum-add (car old) beg -1))
+            (if (< (nth 1 old) end)
+                (ledger-sum-add (nth 1 old) end 1)
+              (ledger-sum-add end (nth 1 old) -1)))
+        (setq ledger-sum-count 0
+              ledger-sum-totals nil)
+        (ledger-sum-add beg end 1))
+      (setq ledger-sum-range (list beg end (buffer-chars-modified-tick))))))
+
+(defun ledger-sum-lighter ()
+  "Return the mode line text of `ledger-sum-mode'."
+  (if (null ledger-sum-range)
+      ""
+    (format " Sum(%d: %s)"
+            ledger-sum-count
+            (mapconcat (lambda (total) (ledger-format-amount (car total) (nth 1 total)))
+                       ledger-sum-totals
+                       ", "))))
+
+(define-minor-mode ledger-sum-mode
+  "Show the number and totals of the amounts in the region in the mode line."
+  nil
+  (:eval (ledger-sum-lighter))
+  nil
+  (if ledger-sum-mode
+      (progn
+        (add-hook 'post-command-hook 'ledger-sum-update nil t)
+        (ledger-sum-update))
+    (remove-hook 'post-command-hook 'ledger-sum-update t)
+    (setq ledger-sum-range nil)))
+
+(provide 'ledger-sum)
+
+;;; ledger-sum.el ends here
@@ -0,0 +1,366 @@
+;;; ledger-track.el --- Structural change events for ledger buffers
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Caches and indexes over a ledger buffer need to know which
+;; transactions an edit touched.  Rather than each of them watching
+;; raw buffer changes, the tracker keeps the list of elements of the
+;; buffer (transactions, directives and comments) and turns the
+;; changes made by a command into events such as "the xact at marker
+;; M was modified".  Events are delivered in one batch at the end of
+;; the command to the functions registered by `ledger-track-subscribe'.
+;;
+;; Each event is a plist (:op OP :kind KIND :marker MARKER) where OP
+;; is `added', `removed' or `modified', KIND is `xact', `directive' or
+;; `comment', and MARKER is the start of the element.  The marker of
+;; an element stays the same while it is modified, so it can serve as
+;; its identity; markers of removed elements are detached once the
+;; events have been delivered.
+
+;;; Code:
+
+(require 'ledger-regex)
+(require 'ledger-verify)
+
+(defvar ledger-track-functions nil
+  "Abnormal hook run with the list of events of a command.
+Use `ledger-track-subscribe' to add functions to it.")
+
+(defvar ledger-track-restore-functions nil
+  "Abnormal hook run when the elements of a buffer are first scanned.
+Each function is called in the widened buffer with no argument and
+may return a pair (END . ELEMENTS): ELEMENTS are the (POSITION KIND
+HASH) of the elements before the position END, known to be current,
+and only the text from END on is scanned.  See ledger-closed.el.")
+
+(defvar-local ledger-track-records nil
+  "Vector of the elements of the buffer, in buffer order.
+Each element is a vector [MARKER KIND HASH], HASH being the MD5
+hash of its text.")
+
+(defvar-local ledger-track-scan-time nil
+  "Seconds taken by the last scan of the whole buffer.")
+
+(defvar-local ledger-track-dirty nil
+  "List of (BEG . END) marker pairs changed since the last flush.")
+
+(defvar ledger-track-max-ranges 32
+  "Maximum number of separate changed ranges kept until the next flush.
+Beyond it, the ranges are merged into one spanning all of them, which
+is rescanned as a whole.")
+
+(defun ledger-track-skip-blank ()
+  "Move point past blank lines."
+  (while (and (not (eobp))
+              (looking-at "[ \t]*$"))
+    (forward-line)))
+
+(defun ledger-track-scan-element ()
+  "Move point past the element starting at point and return its kind.
+An element is a line that is not indented followed by its indented
+lines.  Consecutive comment lines and comment blocks each make one
+element."
+  (cond ((looking-at ledger-multiline-comment-start-regex)
+         (forward-line)
+         (if (re-search-forward ledger-multiline-comment-end-regex nil 'move)
+             (forward-line))
+         'comment)
+        ((looking-at ledger-comment-directive-start-regex)
+         (forward-line)
+         (if (re-search-forward ledger-comment-directive-end-regex nil 'move)
+             (forward-line))
+         'comment)
+        ((looking-at "[;#%|*]")
+         (forward-line)
+         (while (looking-at "[;#%|*]\\|[ \t]+[^ \t\n]")
+           (forward-line))
+         'comment)
+        (t
+         (let ((kind (if (looking-at ledger-xact-start-regex) 'xact 'directive)))
+           (forward-line)
+           (while (looking-at "[ \t]+[^ \t\n]")
+             (forward-line))
+           kind))))
+
+(defun ledger-track-element-end (marker)
+  "Return the end of the element starting at MARKER."
+  (save-excursion
+    (save-match-data
+      (goto-char marker)
+      (ledger-track-scan-element)
+      (point))))
+
+(defun ledger-track-marker (pos)
+  "Return a new marker for the element starting at POS."
+  (let ((marker (copy-marker pos)))
+    ;; Text inserted at the start of an element goes before it.
+    (set-marker-insertion-type marker t)
+    marker))
+
+(defun ledger-track-make-record (beg marker)
+  "Scan the element at BEG and return its record, using MARKER if non-nil."
+  (let ((kind (ledger-track-scan-element)))
+    (vector (or marker (ledger-track-marker beg))
+            kind
+            (md5 (current-buffer) beg (point) 'utf-8-emacs))))
+
+(defun ledger-track-rescan ()
+  "Record the elements of the whole buffer.
+Elements restored by `ledger-track-restore-functions' are not scanned."
+  (save-excursion
+    (save-restriction
+      (save-match-data
+        (widen)
+        (let* ((start (float-time))
+               (restored (run-hook-with-args-until-success
+                          'ledger-track-restore-functions))
+               records)
+          (dolist (element (cdr restored))
+            (push (vector (ledger-track-marker (car element))
+                          (nth 1 element) (nth 2 element))
+                  records))
+          (goto-char (if restored (car restored) (point-min)))
+          (ledger-track-skip-blank)
+          (while (not (eobp))
+            (push (ledger-track-make-record (point) nil) records)
+            (ledger-track-skip-blank))
+          (setq ledger-track-records (vconcat (nreverse records))
+                ledger-track-scan-time (- (float-time) start)))))))
+
+(defun ledger-track-scan ()
+  "Return the elements of the buffer as (POSITION KIND HASH) lists.
+The buffer is scanned from scratch, leaving the records alone."
+  (save-excursion
+    (save-restriction
+      (save-match-data
+        (widen)
+        (goto-char (point-min))
+        (let (elements)
+          (ledger-track-skip-blank)
+          (while (not (eobp))
+            (let* ((beg (point))
+                   (kind (ledger-track-scan-element)))
+              (push (list beg kind (md5 (current-buffer) beg (point) 'utf-8-emacs))
+                    elements))
+            (ledger-track-skip-blank))
+          (nreverse elements))))))
+
+(defun ledger-track-snapshot ()
+  "Return the records of the buffer as (POSITION KIND HASH) lists."
+  (if (null ledger-track-records)
+      :inactive
+    (ledger-track-flush)
+    (mapcar (lambda (record)
+              (list (marker-position (aref record 0)) (aref record 1) (aref record 2)))
+            ledger-track-records)))
+
+(ledger-verify-register 'ledger-track 'ledger-track-snapshot 'ledger-track-scan)
+
+(defun ledger-track-index (pos)
+  "Return the index of the first record at or after POS."
+  (let ((low 0)
+        (high (length ledger-track-records)))
+    (while (< low high)
+      (let ((mid (/ (+ low high) 2)))
+        (if (< (aref (aref ledger-track-records mid) 0) pos)
+            (setq low (1+ mid))
+          (setq high mid))))
+    low))
+
+(defun ledger-track-record-at (pos)
+  "Return the record of the last element starting at or before POS, or nil."
+  (let ((index (1- (ledger-track-index (1+ pos)))))
+    (when (>= index 0)
+      (aref ledger-track-records index))))
+
+(defun ledger-track-update-range (beg end &optional resume)
+  "Rescan the elements changed between BEG and END.
+Return a list (FIRST OLD STOP NEW-RECORDS EVENTS): the records from
+index FIRST up to index OLD are replaced by the list NEW-RECORDS,
+scanning stopped at position STOP, and EVENTS is the list of events.
+Scanning starts one element before the change, since an edit can
+join a line to the previous element, and stops at the first element
+after the change whose record is still at its start.  RESUME is the
+pair (OLD . STOP) returned for a previous range of the same flush;
+the records and text before it are not scanned again."
+  (let* ((records ledger-track-records)
+         (count (length records))
+         (end (save-excursion (goto-char end) (forward-line) (point)))
+         (last (1- (ledger-track-index (1+ beg))))
+         (previous (if (< last 0)
+                       -1
+                     (1- (ledger-track-index (aref (aref records last) 0)))))
+         ;; Records collapsed by a deletion share a position, so the
+         ;; element before the change is the last one at a lower
+         ;; position, and rescanning starts at its first record.
+         (first (max (if (< previous 0)
+                         0
+                       (ledger-track-index (aref (aref records previous) 0)))
+                     (if resume (car resume) 0)))
+         (old first)
+         new-records
+         events
+         done)
+    (goto-char (if (< first count)
+                   (min beg (aref (aref records first) 0))
+                 beg))
+    (beginning-of-line)
+    (when (and resume (< (point) (cdr resume)))
+      (goto-char (cdr resume)))
+    (ledger-track-skip-blank)
+    (while (not done)
+      (let ((pos (point)))
+        (while (and (< old count)
+                    (or (eobp)
+                        (< (aref (aref records old) 0) pos)))
+          (let ((record (aref records old)))
+            (push (list :op 'removed :kind (aref record 1) :marker (aref record 0))
+                  events))
+          (setq old (1+ old)))
+        (cond ((eobp)
+               (setq done t))
+              ((and (< old count)
+                    (>= pos end)
+                    (= (aref (aref records old) 0) pos)
+                    (not (and (< (1+ old) count)
+                              (= (aref (aref records (1+ old)) 0) pos))))
+               (setq done t))
+              ((and (< old count)
+                    (= (aref (aref records old) 0) pos))
+               (let* ((record (aref records old))
+                      (new (ledger-track-make-record pos (aref record 0))))
+                 (unless (and (eq (aref new 1) (aref record 1))
+                              (equal (aref new 2) (aref record 2)))
+                   (push (list :op 'modified :kind (aref new 1) :marker (aref new 0))
+                         events))
+                 (push new new-records)
+                 (setq old (1+ old))))
+              (t
+               (let ((new (ledger-track-make-record pos nil)))
+                 (push (list :op 'added :kind (aref new 1) :marker (aref new 0))
+                       events)
+                 (push new new-records))))
+        (unless done
+          (ledger-track-skip-blank))))
+    (list first old (point) (nreverse new-records) (nreverse events))))
+
+(defun ledger-track-after-change (beg end _len)
+  "Remember that the text between BEG and END has changed."
+  (let ((ranges ledger-track-dirty))
+    (while (and ranges
+                (not (and (<= beg (1+ (cdar ranges)))
+                          (>= end (1- (caar ranges))))))
+      (setq ranges (cdr ranges)))
+    (cond (ranges
+           (let ((range (car ranges)))
+             (when (< beg (car range))
+               (set-marker (car range) beg))
+             (when (> end (cdr range))
+               (set-marker (cdr range) end))))
+          ((< (length ledger-track-dirty) ledger-track-max-ranges)
+           (push (cons (copy-marker beg) (copy-marker end t))
+                 ledger-track-dirty))
+          (t
+           ;; Too many scattered changes: rescan everything between them.
+           (let ((range (cons (copy-marker beg) (copy-marker end t))))
+             (dolist (old ledger-track-dirty)
+               (when (< (car old) (car range))
+                 (set-marker (car range) (car old)))
+               (when (> (cdr old) (cdr range))
+                 (set-marker (cdr range) (cdr old)))
+               (set-marker (car old) nil)
+               (set-marker (cdr old) nil))
+             (setq ledger-track-dirty (list range)))))))
+
+(defun ledger-track-flush ()
+  "Deliver the events for the changes made since the last flush.
+This runs at the end of each command; call it to see the effect
+of changes made within the current command."
+  (when ledger-track-dirty
+    (let ((ranges (sort ledger-track-dirty
+                        (lambda (a b) (< (car a) (car b)))))
+          (records ledger-track-records)
+          resume
+          pieces
+          events)
+      (setq ledger-track-dirty nil)
+      (save-excursion
+        (save-restriction
+          (save-match-data
+            (widen)
+            ;; The records are spliced once, from the unchanged runs
+            ;; between the ranges and the records rescanned in them.
+            (dolist (range ranges)
+              (unless (and resume (< (cdr range) (cdr resume)))
+                (let ((update (ledger-track-update-range
+                               (car range) (cdr range) resume)))
+                  (push (substring records (if resume (car resume) 0) (nth 0 update))
+                        pieces)
+                  (push (nth 3 update) pieces)
+                  (push (nth 4 update) events)
+                  (setq resume (cons (nth 1 update) (nth 2 update)))))
+              (set-marker (car range) nil)
+              (set-marker (cdr range) nil)))))
+      (when resume
+        (push (substring records (car resume)) pieces)
+        (setq ledger-track-records (apply #'vconcat (nreverse pieces))
+              events (apply #'nconc (nreverse events))))
+      (when events
+        (with-demoted-errors "Error in ledger-track subscriber: %S"
+          (run-hook-with-args 'ledger-track-functions events))
+        (dolist (event events)
+          (when (eq (plist-get event :op) 'removed)
+            (set-marker (plist-get event :marker) nil)))))))
+
+(defun ledger-track-enable ()
+  "Start tracking the elements of the current buffer."
+  (unless ledger-track-records
+    (ledger-track-rescan)
+    (add-hook 'after-change-functions 'ledger-track-after-change nil t)
+    (add-hook 'post-command-hook 'ledger-track-flush nil t)))
+
+(defun ledger-track-subscribe (function)
+  "Call FUNCTION with the events of each command changing the current buffer.
+FUNCTION is called with a list of events, see the commentary of
+ledger-track.el.  The elements present when subscribing are
+listed by `ledger-track-markers'."
+  (ledger-track-enable)
+  (add-hook 'ledger-track-functions function nil t))
+
+(defun ledger-track-unsubscribe (function)
+  "Stop calling FUNCTION with the events of the current buffer."
+  (remove-hook 'ledger-track-functions function t))
+
+(defun ledger-track-markers (&optional kind)
+  "Return the start markers of the elements of the buffer, in order.
+If KIND is non-nil, only return those of elements of that kind."
+  (ledger-track-enable)
+  (ledger-track-flush)
+  (let (markers)
+    (mapc (lambda (record)
+            (when (or (null kind) (eq kind (aref record 1)))
+              (push (aref record 0) markers)))
+          ledger-track-records)
+    (nreverse markers)))
+
+(provide 'ledger-track)
+
+;;; ledger-track.el ends here
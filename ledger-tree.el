@@ -0,0 +1,401 @@
+;;; ledger-tree.el --- Browse the account tree with rolled up balances
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; `ledger-tree' shows the accounts of the journal as a tree whose
+;; nodes are expanded on demand, each with the total of its postings
+;; and those of its subaccounts.  The tree and its totals are built
+;; once from the index of ledger-index.el and kept in memory: a change
+;; to a transaction only moves its postings in and out of the totals
+;; of their accounts and the parents of these.  Only the lines of
+;; expanded nodes are inserted, and the lines of the nodes whose
+;; totals changed are redrawn when a file of the journal is saved.
+;;
+;; Totals are in the commodities of the postings, as `ledger balance'
+;; shows them without --market.  An elided amount balances the other
+;; postings of its transaction, at their cost when they have one.
+
+;;; Code:
+
+(require 'ledger-commodities)
+(require 'ledger-index)
+(require 'ledger-query) ; for ledger-query-balance-amount
+
+(defgroup ledger-tree nil
+  "Options for browsing the account tree."
+  :group 'ledger)
+
+(defcustom ledger-tree-buffer-name "*Ledger Accounts*"
+  "Name of the buffer showing the account tree."
+  :type 'string
+  :group 'ledger-tree)
+
+(defcustom ledger-tree-column 48
+  "Column at which the totals of the accounts start."
+  :type 'integer
+  :group 'ledger-tree)
+
+(defvar ledger-tree-root nil
+  "Root node of the account tree, or nil when it is not shown.
+Each node is a vector [NAME CHILDREN TOTAL COUNT EXPANDED]:
+CHILDREN is a hash table mapping the names of the subaccounts to
+their nodes, TOTAL a list of (VALUE COMMODITY) amounts, COUNT the
+number of postings below the node and EXPANDED non-nil when its
+children are shown.")
+
+(defvar ledger-tree-buffers nil
+  "Indexed buffers of the journal shown in the account tree.")
+
+(defvar ledger-tree-changed nil
+  "Hash table of the nodes whose totals changed since the tree was drawn.
+A node maps to `children' if its children changed too, else to t.")
+
+(defvar ledger-tree-emptied nil
+  "List of (PARENT . NODE) pairs of the nodes left without postings.
+They are only removed when the tree is redrawn, so that a node
+whose postings move out and back in keeps its state.")
+
+(defvar ledger-tree-lines nil
+  "Hash table mapping the nodes shown to the marker of their line.")
+
+(defun ledger-tree-make-node (name)
+  "Return an empty node named NAME."
+  (vector name (make-hash-table :test 'equal) nil 0 nil))
+
+(defun ledger-tree-cost (text value commodity)
+  "Return the amount balancing the posting amount TEXT of VALUE and COMMODITY.
+This is its cost when TEXT has a price, else the amount itself."
+  (let* ((prices (ledger-parse-amount-prices text value))
+         (unit (or (cdr prices) (car prices))))
+    (if unit
+        (list (* value (car unit)) (nth 1 unit))
+      (list value commodity))))
+
+(defun ledger-tree-add-amount (total value commodity)
+  "Add VALUE in COMMODITY to the amounts of TOTAL and return it."
+  (let ((amount (ledger-query-balance-amount total commodity)))
+    (if amount
+        (progn (setcar amount (+ (car amount) value)) total)
+      (append total (list (list value commodity))))))
+
+(defun ledger-tree-postings (record)
+  "Return the (ACCOUNT VALUE COMMODITY) of the postings of the index RECORD.
+The amount of the one posting without an amount, if any, is
+computed to balance the others."
+  (let (postings sum elided (known t))
+    (dolist (posting (aref record 2))
+      (let ((account (car posting)))
+        (cond ((nth 2 posting)
+               (push (list account (nth 2 posting) (nth 3 posting)) postings)
+               (unless (string-match-p "\\`(" account)
+                 (let ((cost (ledger-tree-cost (nth 1 posting) (nth 2 posting)
+                                               (nth 3 posting))))
+                   (setq sum (ledger-tree-add-amount sum (car cost) (nth 1 cost))))))
+              ((nth 1 posting)
+               ;; An expression: its value is unknown.
+               (setq known nil))
+              (elided
+               (setq known nil))
+              (t
+               (setq elided account)))))
+    (when (and elided known)
+      (dolist (amount sum)
+        (unless (zerop (car amount))
+          (push (list elided (- (car amount)) (nth 1 amount)) postings))))
+    (nreverse postings)))
+
+(defun ledger-tree-account-path (account)
+  "Return the names of the nodes leading to ACCOUNT."
+  (when (string-match "\\`[[(]\\(.*\\)[])]\\'" account)
+    (setq account (match-string 1 account)))
+  (split-string account ":"))
+
+(defun ledger-tree-mark (node children)
+  "Record that the total of NODE changed, and its children if CHILDREN is non-nil."
+  (when (and ledger-tree-changed
+             (not (eq (gethash node ledger-tree-changed) 'children)))
+    (puthash node (if children 'children t) ledger-tree-changed)))
+
+(defun ledger-tree-add (root posting sign)
+  "Add POSTING, an (ACCOUNT VALUE COMMODITY), multiplied by SIGN below ROOT.
+The amount goes to the total of the account of POSTING and of its
+parents.  Nodes left without postings are recorded in
+`ledger-tree-emptied'."
+  (let ((node root)
+        (value (* sign (nth 1 posting)))
+        (commodity (nth 2 posting))
+        parent)
+    (dolist (name (cons nil (ledger-tree-account-path (car posting))))
+      (when name
+        (setq parent node
+              node (gethash name (aref parent 1)))
+        (unless node
+          (setq node (puthash name (ledger-tree-make-node name) (aref parent 1)))
+          (ledger-tree-mark parent t)))
+      (aset node 2 (ledger-tree-add-amount (aref node 2) value commodity))
+      (aset node 3 (+ (aref node 3) sign))
+      (ledger-tree-mark node nil)
+      (when (and parent (zerop (aref node 3)))
+        (push (cons parent node) ledger-tree-emptied)))))
+
+(defun ledger-tree-add-record (root record sign)
+  "Add the postings of the index RECORD, multiplied by SIGN, below ROOT."
+  (dolist (posting (ledger-tree-postings record))
+    (ledger-tree-add root posting sign)))
+
+(defun ledger-tree-prune ()
+  "Remove the nodes still left without postings."
+  (dolist (pair ledger-tree-emptied)
+    (let ((parent (car pair))
+          (node (cdr pair)))
+      (when (and (zerop (aref node 3))
+                 (eq (gethash (aref node 0) (aref parent 1)) node))
+        (remhash (aref node 0) (aref parent 1))
+        (ledger-tree-mark parent t))))
+  (setq ledger-tree-emptied nil))
+
+(defun ledger-tree-build (buffers)
+  "Return the root of the account tree of the indexed BUFFERS."
+  (let ((root (ledger-tree-make-node nil))
+        (ledger-tree-changed nil)
+        (ledger-tree-emptied nil))
+    (dolist (buffer buffers)
+      (maphash (lambda (_marker record)
+                 (ledger-tree-add-record root record 1))
+               (buffer-local-value 'ledger-index-xacts buffer)))
+    (aset root 4 t)
+    root))
+
+(defun ledger-tree-index-changed (_marker old new)
+  "Move the postings of the index record OLD out of the tree, and those of NEW in."
+  (when (and ledger-tree-root
+             (memq (current-buffer) ledger-tree-buffers))
+    (when old
+      (ledger-tree-add-record ledger-tree-root old -1))
+    (when new
+      (ledger-tree-add-record ledger-tree-root new 1))))
+
+(add-hook 'ledger-index-functions #'ledger-tree-index-changed)
+
+(defun ledger-tree-total-string (total)
+  "Return the nonzero amounts of TOTAL as a string."
+  (let (amounts)
+    (dolist (amount total)
+      (unless (ledger-amount-zerop (car amount))
+        (push (ledger-format-amount (car amount) (nth 1 amount)) amounts)))
+    (if amounts
+        (mapconcat #'identity (nreverse amounts) ", ")
+      "0")))
+
+(defun ledger-tree-children (node)
+  "Return the child nodes of NODE with postings, sorted by name."
+  (let (children)
+    (maphash (lambda (_name child)
+               (when (/= (aref child 3) 0)
+                 (push child children)))
+             (aref node 1))
+    (sort children (lambda (a b) (string< (aref a 0) (aref b 0))))))
+
+(defun ledger-tree-insert-node (node path depth &optional alone)
+  "Insert the line of NODE, the account PATH at DEPTH, and of its expanded children.
+With ALONE non-nil, only insert the line of NODE."
+  (let ((beg (point))
+        (children (ledger-tree-children node)))
+    (insert (format (format "%%-%ds %%s\n" ledger-tree-column)
+                    (concat (make-string (* 2 depth) ?\s)
+                            (cond ((null children) "  ")
+                                  ((aref node 4) "- ")
+                                  (t "+ "))
+                            (aref node 0))
+                    (ledger-tree-total-string (aref node 2))))
+    (put-text-property beg (point) 'ledger-tree-node (list node path depth))
+    (puthash node (copy-marker beg) ledger-tree-lines)
+    (when (and (aref node 4) (not alone))
+      (dolist (child children)
+        (ledger-tree-insert-node child (concat path ":" (aref child 0)) (1+ depth))))))
+
+(defun ledger-tree-insert-total ()
+  "Insert the line of the total of the tree."
+  (insert (format (format "%%-%ds %%s\n" ledger-tree-column)
+                  "Total" (ledger-tree-total-string (aref ledger-tree-root 2)))))
+
+(defun ledger-tree-forget-lines (beg end)
+  "Forget the markers of the lines of the nodes between BEG and END."
+  (save-excursion
+    (goto-char beg)
+    (while (< (point) end)
+      (let* ((node (car (get-text-property (point) 'ledger-tree-node)))
+             (marker (and node (gethash node ledger-tree-lines))))
+        (when marker
+          (set-marker marker nil)
+          (remhash node ledger-tree-lines)))
+      (forward-line))))
+
+(defun ledger-tree-draw ()
+  "Insert the expanded nodes of the tree in the current buffer."
+  (let ((inhibit-read-only t)
+        (line (line-number-at-pos)))
+    (when ledger-tree-lines
+      (maphash (lambda (_node marker) (set-marker marker nil)) ledger-tree-lines))
+    (setq ledger-tree-lines (make-hash-table :test 'eq)
+          ledger-tree-changed (make-hash-table :test 'eq))
+    (erase-buffer)
+    (dolist (child (ledger-tree-children ledger-tree-root))
+      (ledger-tree-insert-node child (aref child 0) 0))
+    (ledger-tree-insert-total)
+    (goto-char (point-min))
+    (forward-line (1- line))))
+
+(defun ledger-tree-redraw-node (node subtree)
+  "Redraw the line of NODE if it is shown, and those of its subtree if SUBTREE.
+Point stays on the same line of the redrawn lines."
+  (let ((marker (gethash node ledger-tree-lines))
+        (inhibit-read-only t))
+    (when marker
+      (let* ((origin (point))
+             (beg (marker-position marker))
+             (info (get-text-property beg 'ledger-tree-node))
+             end
+             line)
+        (goto-char beg)
+        (forward-line)
+        (when subtree
+          (while (let ((other (get-text-property (point) 'ledger-tree-node)))
+                   (and other (> (nth 2 other) (nth 2 info))))
+            (forward-line)))
+        (setq end (point))
+        (when (and (>= origin beg) (< origin end))
+          (goto-char origin)
+          (setq line (count-lines beg (line-beginning-position))))
+        (ledger-tree-forget-lines beg end)
+        ;; Inserting before deleting keeps the markers of the following
+        ;; lines at their start.
+        (goto-char beg)
+        (ledger-tree-insert-node node (nth 1 info) (nth 2 info) (not subtree))
+        (delete-region (point) (+ (point) (- end beg)))
+        (cond (line
+               (goto-char beg)
+               (forward-line line))
+              ((< origin beg)
+               (goto-char origin))
+              (t
+               (goto-char (+ origin (- (point) end)))))))))
+
+(defun ledger-tree-toggle ()
+  "Expand the node at point, or collapse it if it is expanded."
+  (interactive)
+  (let ((node (car (get-text-property (point) 'ledger-tree-node))))
+    (when (and node (ledger-tree-children node))
+      (aset node 4 (not (aref node 4)))
+      ;; Only the lines of the node and of its subtree are redrawn.
+      (ledger-tree-redraw-node node t))))
+
+(defun ledger-tree-redraw ()
+  "Redraw the lines of the nodes whose totals changed."
+  (ledger-tree-prune)
+  (if (eq (gethash ledger-tree-root ledger-tree-changed) 'children)
+      (ledger-tree-draw)
+    (maphash (lambda (node children)
+               (unless (eq node ledger-tree-root)
+                 (ledger-tree-redraw-node node (and (eq children 'children)
+                                                    (aref node 4)))))
+             ledger-tree-changed)
+    (when (gethash ledger-tree-root ledger-tree-changed)
+      (let ((inhibit-read-only t)
+            (origin (point)))
+        (goto-char (point-max))
+        (forward-line -1)
+        (let ((beg (point)))
+          (ledger-tree-insert-total)
+          (delete-region (point) (point-max))
+          (goto-char (min origin beg)))))
+    (clrhash ledger-tree-changed)))
+
+(defun ledger-tree-after-save ()
+  "Redraw the lines of the account tree whose totals changed."
+  (ledger-index-update)
+  (let ((buffer (get-buffer ledger-tree-buffer-name)))
+    (when (and buffer ledger-tree-root ledger-tree-changed
+               (> (hash-table-count ledger-tree-changed) 0))
+      (with-current-buffer buffer
+        (ledger-tree-redraw)))))
+
+(defvar ledger-tree-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [tab] 'ledger-tree-toggle)
+    (define-key map [return] 'ledger-tree-toggle)
+    (define-key map [?g] 'ledger-tree-redo)
+    (define-key map [?q] 'quit-window)
+    map)
+  "Keymap for `ledger-tree-mode'.")
+
+(define-derived-mode ledger-tree-mode text-mode "Ledger-Tree"
+  "A mode for browsing the account tree."
+  (setq buffer-read-only t)
+  (setq truncate-lines t))
+
+(defun ledger-tree-show (buffers)
+  "Show the account tree of the indexed BUFFERS."
+  (dolist (buffer ledger-tree-buffers)
+    (when (buffer-live-p buffer)
+      (with-current-buffer buffer
+        (remove-hook 'after-save-hook 'ledger-tree-after-save t))))
+  (setq ledger-tree-buffers buffers
+        ledger-tree-root (ledger-tree-build buffers)
+        ledger-tree-emptied nil)
+  (dolist (buffer buffers)
+    (with-current-buffer buffer
+      (add-hook 'after-save-hook 'ledger-tree-after-save nil t)))
+  (with-current-buffer (get-buffer-create ledger-tree-buffer-name)
+    (unless (eq major-mode 'ledger-tree-mode)
+      (ledger-tree-mode))
+    (ledger-tree-draw)
+    (add-hook 'kill-buffer-hook 'ledger-tree-forget nil t)
+    (display-buffer (current-buffer))))
+
+(defun ledger-tree-forget ()
+  "Stop keeping the account tree up to date."
+  (setq ledger-tree-root nil
+        ledger-tree-buffers nil
+        ledger-tree-changed nil
+        ledger-tree-emptied nil
+        ledger-tree-lines nil))
+
+(defun ledger-tree (&optional files)
+  "Browse the accounts of the journal as a tree with their totals.
+
+Each account shows the total of its postings and those of its
+subaccounts.  TAB or RET on an account expands or collapses it.
+The totals follow the edits of the journal and the tree is
+redrawn when one of its files is saved.  FILES default to the
+files of the journal of the current buffer."
+  (interactive)
+  (ledger-tree-show (ledger-index-buffers files)))
+
+(defun ledger-tree-redo ()
+  "Build the account tree again from the journal files it shows."
+  (interactive)
+  (ledger-tree-show (ledger-index-buffers
+                     (delq nil (mapcar #'buffer-file-name ledger-tree-buffers)))))
+
+(provide 'ledger-tree)
+
+;;; ledger-tree.el ends here
@@ -0,0 +1,173 @@
+;;; ledger-verify.el --- Check incremental structures against rebuilds
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Several structures of ledger-mode are kept up to date incrementally
+;; as a buffer is edited.  Each registers here a function returning
+;; its current state and one computing the same state from scratch.
+;; `ledger-verify-mode' compares the two periodically while a buffer
+;; is edited and reports any divergence, together with the last edits
+;; made to the buffer, in the *Ledger Verify* buffer.
+
+;;; Code:
+
+(defgroup ledger-verify nil
+  "Options for checking incremental structures."
+  :group 'ledger)
+
+(defcustom ledger-verify-interval 5
+  "Seconds of idle time between two checks of `ledger-verify-mode'."
+  :type 'number
+  :group 'ledger-verify)
+
+(defcustom ledger-verify-history-size 50
+  "Number of edits reported with a divergence."
+  :type 'integer
+  :group 'ledger-verify)
+
+(defvar ledger-verify-structures nil
+  "List of (NAME SNAPSHOT REBUILD) of the structures to check.
+SNAPSHOT returns the state of the structure in the current buffer,
+or :inactive if it is not in use there.  REBUILD computes the same
+state from scratch.  States are compared with `equal'.")
+
+(defvar ledger-verify-timer nil
+  "Idle timer running the checks of `ledger-verify-mode'.")
+
+(defvar-local ledger-verify-history nil
+  "List of the last edits of the buffer, most recent first.
+Each edit is a list (BEG END LENGTH TEXT): the changed region, the
+length of the text it replaced and the text inserted.")
+
+(defun ledger-verify-register (name snapshot rebuild)
+  "Register the structure NAME to be checked.
+SNAPSHOT returns its current state in the current buffer, or
+:inactive if it is not in use there; REBUILD computes that state
+from scratch."
+  (setq ledger-verify-structures
+        (cons (list name snapshot rebuild)
+              (assq-delete-all name ledger-verify-structures))))
+
+(defun ledger-verify-first-difference (state rebuilt)
+  "Return a description of the first difference between STATE and REBUILT."
+  (if (and (listp state) (listp rebuilt))
+      (let ((index 0))
+        (while (and state rebuilt (equal (car state) (car rebuilt)))
+          (setq state (cdr state)
+                rebuilt (cdr rebuilt)
+                index (1+ index)))
+        (format "at item %d: incremental %S, rebuilt %S"
+                index (car state) (car rebuilt)))
+    (format "incremental %S, rebuilt %S" state rebuilt)))
+
+(defun ledger-verify-buffer ()
+  "Compare the incremental structures of the current buffer with rebuilds.
+Return the list of divergences, each a list (NAME DESCRIPTION).
+Interactively, report them."
+  (interactive)
+  (let (divergences)
+    (dolist (structure ledger-verify-structures)
+      (let ((state (funcall (nth 1 structure))))
+        (unless (eq state :inactive)
+          (let ((rebuilt (funcall (nth 2 structure))))
+            (unless (equal state rebuilt)
+              (push (list (nth 0 structure)
+                          (ledger-verify-first-difference state rebuilt))
+                    divergences))))))
+    (setq divergences (nreverse divergences))
+    (when (called-interactively-p 'interactive)
+      (if divergences
+          (ledger-verify-report divergences)
+        (message "No divergence found")))
+    divergences))
+
+(defun ledger-verify-report (divergences)
+  "Show DIVERGENCES of the current buffer with its edit history."
+  (let ((buffer (current-buffer))
+        (history ledger-verify-history))
+    (with-current-buffer (get-buffer-create "*Ledger Verify*")
+      (let ((inhibit-read-only t))
+        (goto-char (point-max))
+        (insert (format "%s in %s\n"
+                        (format-time-string "%Y-%m-%d %H:%M:%S")
+                        (buffer-name buffer)))
+        (dolist (divergence divergences)
+          (insert (format "  %s diverged %s\n" (car divergence) (cadr divergence))))
+        (insert "  Last edits, most recent first:\n")
+        (dolist (edit history)
+          (insert (format "    %d-%d replaced %d chars with %S\n"
+                          (nth 0 edit) (nth 1 edit) (nth 2 edit) (nth 3 edit))))
+        (insert "\n"))
+      (display-buffer (current-buffer)))
+    (message "Ledger incremental structures diverged, see *Ledger Verify*")))
+
+(defun ledger-verify-after-change (beg end len)
+  "Record the edit of BEG to END replacing LEN chars in the history."
+  (push (list beg end len
+              (let ((text (buffer-substring-no-properties beg end)))
+                (if (> (length text) 40)
+                    (concat (substring text 0 40) "...")
+                  text)))
+        ledger-verify-history)
+  (let ((tail (nthcdr (1- ledger-verify-history-size) ledger-verify-history)))
+    (when tail
+      (setcdr tail nil))))
+
+(defun ledger-verify-check-buffers ()
+  "Check the buffers where `ledger-verify-mode' is on."
+  (let ((found nil))
+    (dolist (buffer (buffer-list))
+      (when (buffer-local-value 'ledger-verify-mode buffer)
+        (setq found t)
+        (with-current-buffer buffer
+          (let ((divergences (ledger-verify-buffer)))
+            (when divergences
+              (ledger-verify-report divergences)
+              ;; Report each divergence once.
+              (ledger-verify-mode -1))))))
+    (unless found
+      (cancel-timer ledger-verify-timer)
+      (setq ledger-verify-timer nil))))
+
+(define-minor-mode ledger-verify-mode
+  "Periodically check the incremental structures of the buffer.
+Each structure registered with `ledger-verify-register' is compared
+with a rebuild from scratch after `ledger-verify-interval' seconds
+of idle time.  Divergences are reported in the *Ledger Verify*
+buffer together with the edits that preceded them.  This is a
+debugging aid: rebuilding is as slow as it is without the
+incremental structures."
+  nil
+  " Verify"
+  nil
+  (if ledger-verify-mode
+      (progn
+        (setq ledger-verify-history nil)
+        (add-hook 'after-change-functions 'ledger-verify-after-change nil t)
+        (unless ledger-verify-timer
+          (setq ledger-verify-timer
+                (run-with-idle-timer ledger-verify-interval t
+                                     'ledger-verify-check-buffers))))
+    (remove-hook 'after-change-functions 'ledger-verify-after-change t)))
+
+(provide 'ledger-verify)
+
+;;; ledger-verify.el ends here
@@ -0,0 +1,459 @@
+;;; ledger-window.el --- Edit the tail of a large journal
+
+;; Copyright (C) 2003-2016 John Wiegley (johnw AT gnu DOT org)
+
+;; This file is not part of GNU Emacs.
+
+;; This is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free
+;; Software Foundation; either version 2, or (at your option) any later
+;; version.
+;;
+;; This is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+;; FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+;; for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs; see the file COPYING.  If not, write to the
+;; Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+;; MA 02110-1301 USA.
+
+;;; Commentary:
+;; Journals of hundreds of megabytes are slow to visit and slow to
+;; edit.  `ledger-window-find-file' loads only the transactions of the
+;; last few months into a buffer.  The start of that window is found
+;; by a binary search over the dates in the file, so only a few chunks
+;; of the file are read.  Saving, whether with `save-buffer',
+;; `save-some-buffers' or when exiting Emacs, writes back only the
+;; bytes following the first change, and the text before the window
+;; is read in the background to offer its payees and accounts for
+;; completion.
+
+;;; Code:
+
+(require 'ledger-regex)
+(require 'ledger-xact)
+(require 'ledger-complete)
+
+(declare-function ledger-mode "ledger-mode")
+
+(defgroup ledger-window nil
+  "Options for editing the tail of large journals."
+  :group 'ledger)
+
+(defcustom ledger-window-months 3
+  "Number of trailing months of a journal loaded for editing."
+  :type 'integer
+  :group 'ledger-window)
+
+(defcustom ledger-window-chunk-size (* 1024 1024)
+  "Number of bytes read at a time from a windowed journal."
+  :type 'integer
+  :group 'ledger-window)
+
+(defcustom ledger-window-parse-idle-delay 1
+  "Seconds of idle time before the text before the window is parsed."
+  :type 'number
+  :group 'ledger-window)
+
+(defcustom ledger-window-parse-time-slice 0.05
+  "Seconds spent parsing the text before the window at a time.
+Parsing goes on by slices as long as Emacs stays idle."
+  :type 'number
+  :group 'ledger-window)
+
+(defvar-local ledger-window-file nil
+  "Journal file edited through the current buffer.")
+
+(defvar-local ledger-window-months-shown nil
+  "Number of months loaded in the current buffer.")
+
+(defvar-local ledger-window-offset 0
+  "Byte offset in `ledger-window-file' where the window starts.")
+
+(defvar-local ledger-window-length 0
+  "Length in bytes of the window in `ledger-window-file'.")
+
+(defvar-local ledger-window-modtime nil
+  "Modification time of `ledger-window-file' when last read or written.")
+
+(defvar-local ledger-window-changed nil
+  "Marker at the lowest position changed since the window was saved, or nil.")
+
+(defvar-local ledger-window-parse-position 0
+  "Byte offset up to which the text before the window has been parsed.")
+
+(defvar-local ledger-window-parse-timer nil
+  "Idle timer parsing the text before the window.")
+
+(defvar-local ledger-window-parse-resume-timer nil
+  "Timer parsing the next slice of the text before the window, or nil.")
+
+(defvar-local ledger-window-payees nil
+  "Hash table of the payees found before the window.")
+
+(defvar-local ledger-window-accounts nil
+  "Hash table of the accounts found before the window.")
+
+(defun ledger-window-cutoff (months)
+  "Return the first day of the month MONTHS months back, this month included."
+  (let ((now (decode-time)))
+    (encode-time 0 0 0 1 (- (nth 4 now) (1- months)) (nth 5 now))))
+
+(defun ledger-window-next-xact (file offset)
+  "Return the first xact of FILE starting after byte OFFSET.
+The result is (POSITION . DATE), POSITION being a byte offset.
+Only one chunk is read; return nil if it contains no xact."
+  (with-temp-buffer
+    (set-buffer-multibyte nil)
+    (insert-file-contents-literally
+     file nil (max 0 (1- offset)) (+ offset ledger-window-chunk-size))
+    (goto-char (point-min))
+    (when (> offset 0)
+      (forward-line))
+    (when (re-search-forward ledger-xact-start-regex nil t)
+      (cons (+ (max 0 (1- offset)) (1- (match-beginning 0)))
+            (ledger-parse-iso-date (match-string 1))))))
+
+(defun ledger-window-scan (file offset cutoff)
+  "Return the byte offset of the first xact of FILE dated on or after CUTOFF.
+Scanning starts at OFFSET, which must be the start of a line.
+Return the size of the file if there is no such xact."
+  (let ((size (nth 7 (file-attributes file)))
+        result)
+    (with-temp-buffer
+      (set-buffer-multibyte nil)
+      (while (and (null result) (< offset size))
+        (erase-buffer)
+        (insert-file-contents-literally
+         file nil offset (min size (+ offset ledger-window-chunk-size)))
+        (let ((limit (if (>= (+ offset (buffer-size)) size)
+                         (point-max)
+                       (goto-char (point-max))
+                       (if (search-backward "\n" nil t)
+                           (1+ (point))
+                         (point-max)))))
+          (goto-char (point-min))
+          (while (and (null result)
+                      (re-search-forward ledger-xact-start-regex limit t))
+            (let ((date (ledger-parse-iso-date (match-string 1))))
+              (when (and date (not (ledger-time-less-p date cutoff)))
+                (setq result (+ offset (1- (match-beginning 0)))))))
+          (setq offset (+ offset (1- limit))))))
+    (or result size)))
+
+(defun ledger-window-start-offset (file cutoff)
+  "Return the byte offset of the first xact of FILE dated on or after CUTOFF.
+Xacts are assumed to be in date order, as `ledger-sort-buffer'
+leaves them, so that a binary search narrows the scan to a few
+chunks of the file."
+  (let ((low 0)
+        (high (nth 7 (file-attributes file))))
+    ;; Every xact starting before LOW predates CUTOFF.
+    (while (> (- high low) ledger-window-chunk-size)
+      (let* ((mid (/ (+ low high) 2))
+             (found (ledger-window-next-xact file mid)))
+        (cond ((or (null found) (>= (car found) high))
+               (setq high mid))
+              ((and (cdr found) (ledger-time-less-p (cdr found) cutoff))
+               (setq low (car found)))
+              (t
+               (setq high (car found))))))
+    (ledger-window-scan file low cutoff)))
+
+(defun ledger-window-parse-chunk (file beg end coding payees accounts)
+  "Collect the payees and accounts of FILE between bytes BEG and END.
+The text is decoded with CODING and its payees and accounts are
+added to the hash tables PAYEES and ACCOUNTS.  Only whole lines
+are parsed; return the byte offset where parsing stopped."
+  (with-temp-buffer
+    (set-buffer-multibyte nil)
+    (insert-file-contents-literally
+     file nil beg (min end (+ beg ledger-window-chunk-size)))
+    (let* ((limit (if (>= (+ beg (buffer-size)) end)
+                      (point-max)
+                    (goto-char (point-max))
+                    (if (search-backward "\n" nil t)
+                        (1+ (point))
+                      (point-max))))
+           (bytes (buffer-substring-no-properties (point-min) limit)))
+      (erase-buffer)
+      (set-buffer-multibyte t)
+      (insert (decode-coding-string bytes coding))
+      (goto-char (point-min))
+      (while (re-search-forward ledger-payee-any-status-regex nil t)
+        (puthash (match-string-no-properties 3) t payees))
+      (goto-char (point-min))
+      (while (re-search-forward ledger-account-any-status-regex nil t)
+        (let ((account (match-string-no-properties 2)))
+          (unless (string-prefix-p ";" account)
+            (puthash account t accounts))))
+      (+ beg (length bytes)))))
+
+(defun ledger-window-parse-step (buffer)
+  "Parse a slice of the text before the window of BUFFER.
+At least one chunk is parsed.  While Emacs stays idle, the next
+slice is parsed right after, since the idle timer fires only
+once per idle period."
+  (when (buffer-live-p buffer)
+    (with-current-buffer buffer
+      (let ((deadline (+ (float-time) ledger-window-parse-time-slice)))
+        (setq ledger-window-parse-resume-timer nil)
+        (while (and (< ledger-window-parse-position ledger-window-offset)
+                    (not (input-pending-p))
+                    (progn
+                      (setq ledger-window-parse-position
+                            (ledger-window-parse-chunk ledger-window-file
+                                                       ledger-window-parse-position
+                                                       ledger-window-offset
+                                                       buffer-file-coding-system
+                                                       ledger-window-payees
+                                                       ledger-window-accounts))
+                      (< (float-time) deadline))))
+        (cond ((>= ledger-window-parse-position ledger-window-offset)
+               (ledger-window-cancel-parse))
+              ((current-idle-time)
+               (setq ledger-window-parse-resume-timer
+                     (run-at-time 0 nil 'ledger-window-parse-step buffer))))))))
+
+(defun ledger-window-cancel-parse ()
+  "Stop parsing the text before the window."
+  (when ledger-window-parse-timer
+    (cancel-timer ledger-window-parse-timer)
+    (setq ledger-window-parse-timer nil))
+  (when ledger-window-parse-resume-timer
+    (cancel-timer ledger-window-parse-resume-timer)
+    (setq ledger-window-parse-resume-timer nil)))
+
+(defun ledger-window-hash-keys (table)
+  "Return the keys of the hash table TABLE."
+  (let (keys)
+    (when table
+      (maphash (lambda (key _value)
+                 (push key keys))
+               table))
+    keys))
+
+(defun ledger-window-known-payees ()
+  "Return the payees found before the window."
+  (ledger-window-hash-keys ledger-window-payees))
+
+(defun ledger-window-known-accounts ()
+  "Return the accounts found before the window."
+  (ledger-window-hash-keys ledger-window-accounts))
+
+(defun ledger-window-after-change (beg _end _len)
+  "Remember BEG if it is the lowest position changed so far."
+  (cond ((null ledger-window-changed)
+         (setq ledger-window-changed (copy-marker beg)))
+        ((< beg ledger-window-changed)
+         (set-marker ledger-window-changed beg))))
+
+(defun ledger-window-forget-changes ()
+  "Forget the changes of the window, as it matches its journal."
+  (when ledger-window-changed
+    (set-marker ledger-window-changed nil)
+    (setq ledger-window-changed nil)))
+
+(defun ledger-window-check-file ()
+  "Signal an error if the journal has changed since it was read."
+  (let ((attributes (file-attributes ledger-window-file)))
+    (unless (and attributes
+                 (equal (nth 5 attributes) ledger-window-modtime)
+                 (= (nth 7 attributes)
+                    (+ ledger-window-offset ledger-window-length)))
+      (error "%s has changed on disk, revert the window first"
+             ledger-window-file))))
+
+(defun ledger-window-write (bytes file offset)
+  "Write the unibyte string BYTES into FILE at byte OFFSET."
+  (let ((coding-system-for-write 'no-conversion))
+    (write-region bytes nil file offset 'nomessage)))
+
+(defun ledger-window-rewrite (bytes file offset)
+  "Replace the bytes of FILE from byte OFFSET to its end with BYTES.
+The file is copied chunk by chunk to a temporary file which then
+replaces it, as a file cannot be shortened in place."
+  (let ((temp (make-temp-file
+               (expand-file-name ".ledger-window" (file-name-directory file))))
+        (coding-system-for-write 'no-conversion)
+        (pos 0))
+    (unwind-protect
+        (progn
+          (with-temp-buffer
+            (set-buffer-multibyte nil)
+            (while (< pos offset)
+              (erase-buffer)
+              (insert-file-contents-literally
+               file nil pos (min offset (+ pos ledger-window-chunk-size)))
+              (when (zerop (buffer-size))
+                (error "%s is shorter than expected" file))
+              (write-region nil nil temp t 'nomessage)
+              (setq pos (+ pos (buffer-size)))))
+          (write-region bytes nil temp t 'nomessage)
+          (set-file-modes temp (file-modes file))
+          (rename-file temp file t))
+      (when (file-exists-p temp)
+        (delete-file temp)))))
+
+(defun ledger-window-save ()
+  "Write the changes of the current window back into its journal.
+Only the bytes following the first change are written.  They are
+written in place unless the window got shorter, in which case
+the journal is rewritten."
+  (interactive)
+  (if (not (and ledger-window-changed (buffer-modified-p)))
+      (progn
+        (set-buffer-modified-p nil)
+        (message "(No changes need to be saved)"))
+    (ledger-window-check-file)
+    (save-restriction
+      (widen)
+      (let* ((coding buffer-file-coding-system)
+             (head (encode-coding-string
+                    (buffer-substring-no-properties (point-min) ledger-window-changed)
+                    coding))
+             (tail (encode-coding-string
+                    (buffer-substring-no-properties ledger-window-changed (point-max))
+                    coding))
+             (start (+ ledger-window-offset (length head)))
+             (size (+ (length head) (length tail))))
+        (if (>= size ledger-window-length)
+            (ledger-window-write tail ledger-window-file start)
+          (ledger-window-rewrite tail ledger-window-file start))
+        (ledger-window-forget-changes)
+        (setq ledger-window-length size
+              ledger-window-modtime (nth 5 (file-attributes ledger-window-file)))
+        (set-buffer-modified-p nil)
+        (message "Wrote %d bytes to %s" (length tail) ledger-window-file)))))
+
+(defun ledger-window-write-contents ()
+  "Save the window into its journal, for `write-contents-functions'.
+Every save of the buffer goes through `ledger-window-save', which
+also spares `basic-save-buffer' asking for a file to save in."
+  (when buffer-file-name
+    (user-error "A window is saved into %s only" ledger-window-file))
+  (ledger-window-save)
+  t)
+
+(defun ledger-window-unsaved-p ()
+  "Return non-nil if the current window has changes not saved to its journal."
+  (and ledger-window-mode ledger-window-changed (buffer-modified-p)))
+
+(defun ledger-window-kill-buffer-query ()
+  "Offer to save the changes of the window before it is killed."
+  (cond ((not (ledger-window-unsaved-p)) t)
+        ((y-or-n-p (format "Save the changes of %s into %s? "
+                           (buffer-name) ledger-window-file))
+         (ledger-window-save)
+         t)
+        (t (yes-or-no-p "The changes will be lost; kill the window anyway? "))))
+
+(defun ledger-window-kill-emacs-query ()
+  "Confirm exiting Emacs while windows have changes not saved to their journal."
+  (let ((unsaved (delq nil (mapcar (lambda (buffer)
+                                     (with-current-buffer buffer
+                                       (when (ledger-window-unsaved-p)
+                                         buffer)))
+                                   (buffer-list)))))
+    (or (null unsaved)
+        (yes-or-no-p (format "%d windows of journals have unsaved changes; exit anyway? "
+                             (length unsaved))))))
+
+(defun ledger-window-write-file ()
+  "Refuse to write the window to a file of its own."
+  (interactive)
+  (user-error "A window is saved into %s only, with %s"
+              ledger-window-file
+              (substitute-command-keys "\\[save-buffer]")))
+
+(defun ledger-window-revert (&rest _args)
+  "Load the window of the current buffer again from its journal."
+  (ledger-window-load ledger-window-file ledger-window-months-shown))
+
+(defvar ledger-window-mode-map
+  (let ((map (make-sparse-keymap)))
+    (define-key map [remap write-file] 'ledger-window-write-file)
+    map)
+  "Keymap for `ledger-window-mode'.")
+
+(define-minor-mode ledger-window-mode
+  "Minor mode for a buffer holding the last months of a large journal.
+\\[save-buffer] writes the changes back into the journal; the window
+cannot be written to another file."
+  nil
+  " Window"
+  ledger-window-mode-map
+  (if ledger-window-mode
+      (progn
+        (add-hook 'after-change-functions 'ledger-window-after-change nil t)
+        (add-hook 'write-contents-functions 'ledger-window-write-contents nil t)
+        (add-hook 'kill-buffer-query-functions 'ledger-window-kill-buffer-query nil t)
+        (add-hook 'kill-emacs-query-functions 'ledger-window-kill-emacs-query)
+        (add-hook 'kill-buffer-hook 'ledger-window-cancel-parse nil t)
+        (add-hook 'ledger-complete-payee-functions 'ledger-window-known-payees nil t)
+        (add-hook 'ledger-complete-account-functions 'ledger-window-known-accounts nil t))
+    (remove-hook 'after-change-functions 'ledger-window-after-change t)
+    (remove-hook 'write-contents-functions 'ledger-window-write-contents t)
+    (remove-hook 'kill-buffer-query-functions 'ledger-window-kill-buffer-query t)
+    (remove-hook 'kill-buffer-hook 'ledger-window-cancel-parse t)
+    (remove-hook 'ledger-complete-payee-functions 'ledger-window-known-payees t)
+    (remove-hook 'ledger-complete-account-functions 'ledger-window-known-accounts t)
+    (ledger-window-cancel-parse)))
+
+(defun ledger-window-load (file months)
+  "Load the last MONTHS months of FILE into the current buffer."
+  (ledger-window-cancel-parse)
+  (let* ((attributes (file-attributes file))
+         (size (nth 7 attributes))
+         (offset (ledger-window-start-offset file (ledger-window-cutoff months)))
+         (inhibit-read-only t)
+         coding)
+    (widen)
+    (erase-buffer)
+    (insert-file-contents file nil offset size)
+    (setq coding last-coding-system-used)
+    (ledger-mode)
+    (setq buffer-file-coding-system coding
+          default-directory (file-name-directory file)
+          buffer-offer-save t
+          ledger-window-file file
+          ledger-window-months-shown months
+          ledger-window-offset offset
+          ledger-window-length (- size offset)
+          ledger-window-modtime (nth 5 attributes)
+          ledger-window-parse-position 0
+          ledger-window-payees (make-hash-table :test 'equal)
+          ledger-window-accounts (make-hash-table :test 'equal))
+    (setq-local revert-buffer-function 'ledger-window-revert)
+    (ledger-window-mode 1)
+    (ledger-window-forget-changes)
+    (setq buffer-undo-list nil)
+    (set-buffer-modified-p nil)
+    (goto-char (point-max))
+    (when (> offset 0)
+      (setq ledger-window-parse-timer
+            (run-with-idle-timer ledger-window-parse-idle-delay t
+                                 'ledger-window-parse-step (current-buffer))))))
+
+(defun ledger-window-find-file (file &optional months)
+  "Edit the transactions of the last MONTHS months of FILE.
+MONTHS defaults to `ledger-window-months'; a numeric prefix
+argument gives it interactively.  The rest of the file is left
+on disk: \\[save-buffer] in the window splices the changes back
+into FILE."
+  (interactive
+   (list (read-file-name "Ledger file: " nil nil t)
+         (when current-prefix-arg
+           (prefix-numeric-value current-prefix-arg))))
+  (let* ((file (expand-file-name file))
+         (buffer (generate-new-buffer
+                  (format "%s<window>" (file-name-nondirectory file)))))
+    (with-current-buffer buffer
+      (ledger-window-load file (or months ledger-window-months)))
+    (switch-to-buffer buffer)))
+
+(provide 'ledger-window)
+
+;;; ledger-window.el ends here
@@ -30,6 +30,7 @@
 (require 'ledger-navigate)
 (require 'ledger-exec)
 (require 'ledger-post)
+(require 'ledger-state)
 (declare-function ledger-read-date "ledger-mode")
 
 ;; TODO: This file depends on code in ledger-mode.el, which depends on this.
@@ -195,6 +196,88 @@ correct chronological place in the buffer."
         (insert (car args) " \n\n")
         (end-of-line -1)))))
 
+(defun ledger-xact-trim (str)
+  "Return STR without leading and trailing white space."
+  (when str
+    (replace-regexp-in-string "\\`[ \t]+\\|[ \t]+\\'" "" str)))
+
+(defun ledger-xact-note-tags (note)
+  "Return the metadata tags found in NOTE as an alist.
+Plain tags, written \":tag1:tag2:\", map to nil.  A value tag,
+written \"Key: value\", maps Key to its value."
+  (let ((start 0)
+        tags)
+    (save-match-data
+      (if (string-match "\\`[ \t]*\\([^ \t:]+\\):[ \t]+\\(.*[^ \t]\\)" note)
+          (push (cons (match-string 1 note) (match-string 2 note)) tags)
+        (while (string-match ":\\(\\(?:[^ \t:]+:\\)+\\)" note start)
+          (setq start (match-end 0))
+          (dolist (tag (split-string (match-string 1 note) ":" t))
+            (push (cons tag nil) tags)))))
+    (nreverse tags)))
+
+(defun ledger-xact-parse-at (pos)
+  "Parse the transaction whose first line contains POS.
+Return nil if that line does not start a transaction, otherwise a
+plist with the keys :beg, :end, :date, :state, :code, :payee,
+:notes and :postings.  Each posting is a plist with the keys
+:account, :amount, :state and :notes.  Notes are comment texts
+without their semicolon; comment lines following a posting belong
+to that posting."
+  (save-excursion
+    (save-match-data
+      (goto-char pos)
+      (beginning-of-line)
+      (when (looking-at ledger-xact-start-regex)
+        (let ((beg (point))
+              (date (ledger-parse-iso-date (match-string-no-properties 1)))
+              state code payee notes postings)
+          (goto-char (match-end 0))
+          (when (looking-at ledger-xact-after-date-regex)
+            (setq state (ledger-state-from-string (match-string-no-properties 1))
+                  code (when (match-beginning 2)
+                         (ledger-xact-trim
+                          (replace-regexp-in-string
+                           "[()]" "" (match-string-no-properties 2))))
+                  payee (ledger-xact-trim (match-string-no-properties 3)))
+            (when (match-beginning 4)
+              (push (ledger-xact-trim (substring (match-string-no-properties 4) 1))
+                    notes)))
+          (forward-line)
+          (while (and (not (eobp))
+                      (looking-at "[ \t]+[^ \t\n]"))
+            (cond ((looking-at "[ \t]+;[ \t]*\\(.*\\)")
+                   (let ((note (ledger-xact-trim (match-string-no-properties 1))))
+                     (if postings
+                         (plist-put (car postings) :notes
+                                    (append (plist-get (car postings) :notes)
+                                            (list note)))
+                       (push note notes))))
+                  ((looking-at ledger-post-line-regexp)
+                   (let ((post-note (match-string-no-properties
+                                     ledger-regex-post-line-group-note)))
+                     (push (list :account (match-string-no-properties
+                                           ledger-regex-post-line-group-account)
+                                 :amount (let ((amount (ledger-xact-trim
+                                                        (match-string-no-properties
+                                                         ledger-regex-post-line-group-amount))))
+                                           (unless (equal amount "") amount))
+                                 :state (ledger-state-from-string
+                                         (match-string-no-properties
+                                          ledger-regex-post-line-group-state))
+                                 :notes (when post-note
+                                          (list (ledger-xact-trim post-note))))
+                           postings))))
+            (forward-line))
+          (list :beg beg
+                :end (point)
+                :date date
+                :state state
+                :code code
+                :payee payee
+                :notes (nreverse notes)
+                :postings (nreverse postings)))))))
+
 (provide 'ledger-xact)
 
 ;;; ledger-xact.el ends here
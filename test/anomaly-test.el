@@ -0,0 +1,107 @@
+;;; anomaly-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-anomaly
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-anomaly-test-journal ()
+  "Return a journal with one month of abnormal food spending."
+  (let (xacts)
+    (dotimes (i 10)
+      (push (format "2016/%02d/03 Grocery Store\n    Expenses:Food  $%d.00\n    Assets:Checking\n"
+                    (1+ i) (nth (% i 3) '(300 310 290)))
+            xacts))
+    (dotimes (i 11)
+      (push (format "2016/%02d/01 Landlord\n    Expenses:Rent  $1,200.00\n    Assets:Checking\n"
+                    (1+ i))
+            xacts))
+    (push "2016/11/05 Grocery Store\n    Expenses:Food  $500.00\n    Assets:Checking\n" xacts)
+    (push "2016/11/20 Caterer\n    Expenses:Food  $400.00\n    Assets:Checking\n" xacts)
+    (mapconcat #'identity (nreverse xacts) "\n")))
+
+
+(ert-deftest ledger-anomaly/test-001 ()
+  "Baseline test for finding abnormal months."
+  :tags '(anomaly baseline)
+
+  (ledger-tests-with-temp-file
+   (ledger-anomaly-test-journal)
+   (ledger-index-update)
+   (let ((anomalies (ledger-anomaly-journal (list (current-buffer)))))
+     (should (equal (length anomalies) 1))
+     (let ((anomaly (car anomalies)))
+       (should (equal (nth 0 anomaly) "Expenses:Food"))
+       (should (equal (nth 1 anomaly) "$"))
+       (should (equal (nth 2 anomaly) (+ (* 12 2016) 10)))
+       (should (= (nth 3 anomaly) 900))
+       (should (= (nth 4 anomaly) 300))
+       (should (equal (mapcar (lambda (posting) (nth 1 posting)) (nth 6 anomaly))
+                      '("Grocery Store" "Caterer")))))))
+
+
+(ert-deftest ledger-anomaly/test-002 ()
+  "Baseline test for the links to the postings of an anomaly."
+  :tags '(anomaly baseline)
+
+  (ledger-tests-with-temp-file
+   (ledger-anomaly-test-journal)
+   (let ((journal (current-buffer)))
+     (ledger-anomaly-display (list (buffer-file-name)))
+     (with-current-buffer ledger-anomaly-buffer-name
+       (goto-char (point-min))
+       (should (search-forward "2016/11  Expenses:Food  $900.00" nil t))
+       (should (search-forward "Caterer" nil t))
+       (let ((source (get-text-property (point) 'ledger-source)))
+         (should (eq (marker-buffer (cdr source)) journal))
+         (with-current-buffer journal
+           (goto-char (cdr source))
+           (should (looking-at "2016/11/20 Caterer"))))))))
+
+
+(ert-deftest ledger-anomaly/test-003 ()
+  "Regress test for counting the postings left without an amount."
+  :tags '(anomaly regress)
+
+  (ledger-tests-with-temp-file
+   (replace-regexp-in-string
+    "    Expenses:Food  \\(\\$[0-9,.]+\\)\n    Assets:Checking\n"
+    "    Expenses:Food\n    Assets:Checking  -\\1\n"
+    (ledger-anomaly-test-journal))
+   (ledger-index-update)
+   (let ((anomalies (ledger-anomaly-journal (list (current-buffer)))))
+     (should (equal (length anomalies) 1))
+     (let ((anomaly (car anomalies)))
+       (should (equal (nth 0 anomaly) "Expenses:Food"))
+       (should (= (nth 3 anomaly) 900))
+       (should (equal (mapcar (lambda (posting) (nth 2 posting)) (nth 6 anomaly))
+                      '("$500.00" "$400.00")))))))
+
+
+(provide 'anomaly-test)
+
+;;; anomaly-test.el ends here
@@ -0,0 +1,114 @@
+;;; closed-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-closed
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-closed/test-001 ()
+  "Baseline test for reusing the index of a closed period."
+  :tags '(closed baseline)
+
+  (let ((ledger-closed-file (make-temp-file "ledger-closed-"))
+        (ledger-closed-periods nil))
+    (unwind-protect
+        (ledger-tests-with-temp-file
+         demo-ledger
+         (ledger-closed-record "2011/01/01" (list buffer-file-name))
+         (let ((period (ledger-closed-period)))
+           (should period)
+           ;; Only the xacts of 2010 are closed.
+           (should (= (length (nth 4 period)) 3))
+           (setq ledger-closed-periods 'unloaded)
+           (should (equal (nth 4 (ledger-closed-period)) (nth 4 period)))
+           (should (= (hash-table-count (ledger-closed-records)) 3)))
+         (setq ledger-index-xacts nil)
+         (ledger-index-update)
+         (should (null (ledger-verify-buffer))))
+      (delete-file ledger-closed-file))))
+
+
+(ert-deftest ledger-closed/test-002 ()
+  "Baseline test for warning about changes to a closed period."
+  :tags '(closed baseline)
+
+  (let ((ledger-closed-file (make-temp-file "ledger-closed-"))
+        (ledger-closed-periods nil)
+        warnings)
+    (unwind-protect
+        (cl-letf (((symbol-function 'display-warning)
+                   (lambda (_type message &rest _)
+                     (push message warnings))))
+          (ledger-tests-with-temp-file
+           demo-ledger
+           (ledger-closed-record "2011/01/01" (list buffer-file-name))
+           (goto-char (point-max))
+           (insert "\n2011/12/31 Open\n  Assets:Cash  $1\n  Equity\n")
+           (should (null warnings))
+           (goto-char (point-min))
+           (search-forward "Organic Co-op")
+           (insert " Market")
+           (should (= (length warnings) 1))
+           (insert " Street")
+           (should (= (length warnings) 1))
+           (should (null (ledger-closed-records)))
+           (should (= (length warnings) 2))))
+      (delete-file ledger-closed-file))))
+
+
+(ert-deftest ledger-closed/test-003 ()
+  "Baseline test for restoring the elements of a closed period."
+  :tags '(closed baseline)
+
+  (let ((ledger-closed-file (make-temp-file "ledger-closed-"))
+        (ledger-closed-periods nil)
+        (hashed 0))
+    (unwind-protect
+        (ledger-tests-with-temp-file
+         demo-ledger
+         (ledger-closed-record "2011/01/01" (list buffer-file-name))
+         (setq ledger-closed-periods 'unloaded)
+         (let* ((closed (length (nth 5 (ledger-closed-period))))
+                (open (- (length (ledger-track-scan)) closed))
+                (md5 (symbol-function 'md5)))
+           (should (> closed 0))
+           (setq ledger-track-records nil
+                 ledger-index-xacts nil)
+           ;; Only the elements after the closed text are hashed.
+           (cl-letf (((symbol-function 'md5)
+                      (lambda (&rest args)
+                        (setq hashed (1+ hashed))
+                        (apply md5 args))))
+             (ledger-index-update))
+           (should (= hashed open)))
+         (should (null (ledger-verify-buffer))))
+      (delete-file ledger-closed-file))))
+
+
+(provide 'closed-test)
+
+;;; closed-test.el ends here
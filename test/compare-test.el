@@ -0,0 +1,124 @@
+;;; compare-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-compare
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-compare/test-001 ()
+  "Baseline test for comparing account totals."
+  :tags '(compare baseline)
+
+  (let ((old '((:account "Assets" :total ((100 "$")))
+               (:account "Expenses" :total ((40 "$") (2 "EUR")))
+               (:account "Income" :total ((-50 "$")))))
+        (new '((:account "Assets" :total ((100 "$")))
+               (:account "Expenses" :total ((40 "$") (3 "EUR")))
+               (:account "Liabilities" :total ((-20 "$"))))))
+    (should (equal (ledger-compare-balances old new)
+                   '(("Expenses" ((40 "$") (2 "EUR")) ((40 "$") (3 "EUR")))
+                     ("Income" ((-50 "$")) nil)
+                     ("Liabilities" nil ((-20 "$"))))))
+    (should (null (ledger-compare-balances old old)))))
+
+
+(ert-deftest ledger-compare/test-002 ()
+  "Baseline test for copying the files of a journal."
+  :tags '(compare baseline)
+
+  (let ((top (file-name-as-directory (make-temp-file "ledger-compare-top-" t)))
+        (dir (make-temp-file "ledger-compare-copy-" t)))
+    (unwind-protect
+        (progn
+          (make-directory (expand-file-name "years" top))
+          (with-temp-file (expand-file-name "main.ledger" top)
+            (insert "include years/*.ledger\n"))
+          (with-temp-file (expand-file-name "years/2011.ledger" top)
+            (insert demo-ledger))
+          (should (equal (ledger-compare-materialize top nil "main.ledger" dir)
+                         '("main.ledger" "years/2011.ledger")))
+          (with-temp-buffer
+            (insert-file-contents (expand-file-name "years/2011.ledger" dir))
+            (should (equal (buffer-string) demo-ledger))))
+      (delete-directory top t)
+      (delete-directory dir t))))
+
+
+(defun ledger-compare-test-commit (top message)
+  "Commit every file of the git repository TOP with MESSAGE."
+  (ledger-compare-git top "add" "-A")
+  (ledger-compare-git top "-c" "user.name=Test" "-c" "user.email=test@example.com"
+                      "-c" "commit.gpgsign=false" "commit" "-q" "-m" message))
+
+
+(ert-deftest ledger-compare/test-003 ()
+  "Baseline test for copying the files of a journal from git revisions."
+  :tags '(compare baseline)
+
+  (let ((top (file-name-as-directory
+              (file-truename (make-temp-file "ledger-compare-top-" t))))
+        (old (make-temp-file "ledger-compare-old-" t))
+        (new (make-temp-file "ledger-compare-new-" t)))
+    (unwind-protect
+        (progn
+          (ledger-compare-git top "init" "-q")
+          (with-temp-file (expand-file-name "main.ledger" top)
+            (insert "include " (expand-file-name "sub.ledger" top) "\n"))
+          (with-temp-file (expand-file-name "sub.ledger" top)
+            (insert "; old\n"))
+          (ledger-compare-test-commit top "old")
+          (with-temp-file (expand-file-name "sub.ledger" top)
+            (insert "; new\n"))
+          (ledger-compare-test-commit top "new")
+          (should (equal (ledger-compare-materialize top "HEAD~1" "main.ledger" old)
+                         '("main.ledger" "sub.ledger")))
+          (should (equal (ledger-compare-materialize top "HEAD" "main.ledger" new)
+                         '("main.ledger" "sub.ledger")))
+          (with-temp-buffer
+            (insert-file-contents (expand-file-name "sub.ledger" old))
+            (should (equal (buffer-string) "; old\n")))
+          (with-temp-buffer
+            (insert-file-contents (expand-file-name "sub.ledger" new))
+            (should (equal (buffer-string) "; new\n")))
+          ;; The absolute include names the copy, not the working tree.
+          (with-temp-buffer
+            (insert-file-contents (expand-file-name "main.ledger" old))
+            (should (equal (buffer-string)
+                           (concat "include " (expand-file-name "sub.ledger" old) "\n"))))
+          ;; An include outside of the repository is refused.
+          (with-temp-file (expand-file-name "main.ledger" top)
+            (insert "include /nonexistent/other.ledger\n"))
+          (ledger-compare-test-commit top "outside")
+          (should-error (ledger-compare-materialize top "HEAD" "main.ledger" new)))
+      (delete-directory top t)
+      (delete-directory old t)
+      (delete-directory new t))))
+
+
+(provide 'compare-test)
+
+;;; compare-test.el ends here
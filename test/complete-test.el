@@ -82,6 +82,125 @@ http://bugs.ledger-cli.org/show_bug.cgi?id=252"
 "))))
 
 
+(ert-deftest ledger-complete/test-003 ()
+  "Baseline test for annotating accounts with their balance and last use."
+  :tags '(complete baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-complete-refresh-balances)
+   (with-timeout (10)
+     (while (null ledger-complete-balances)
+       (accept-process-output nil 0.1)))
+   (should (string-match "40\\.00  2011/04/27\\'"
+                         (ledger-complete-account-annotation
+                          (current-buffer) "Expenses:Books")))
+   (should (null (ledger-complete-account-annotation
+                  (current-buffer) "Expenses:Unknown")))))
+
+
+(ert-deftest ledger-complete/test-004 ()
+  "Baseline test for ranking payees by frequency and recency."
+  :tags '(complete baseline)
+
+  (ledger-tests-with-temp-file
+   (concat (mapconcat (lambda (day)
+                        (format "2009/01/%02d Old Shop\n  Expenses:Misc  $1\n  Assets:Cash\n\n" day))
+                      '(1 2 3 4 5) "")
+           "2011/01/01 New Shop\n  Expenses:Misc  $1\n  Assets:Cash\n\n"
+           "2011/01/02 Grocer\n  Expenses:Misc  $1\n  Assets:Cash\n\n"
+           "2011/01/09 Grocer\n  Expenses:Misc  $1\n  Assets:Cash\n")
+   (should (equal (ledger-payees-in-buffer) '("Grocer" "New Shop" "Old Shop")))
+   (goto-char (point-max))
+   (insert "\n2011/02/01 New Shop\n  Expenses:Misc  $1\n  Assets:Cash\n"
+           "\n2011/02/02 New Shop\n  Expenses:Misc  $1\n  Assets:Cash\n")
+   (should (equal (ledger-payees-in-buffer) '("New Shop" "Grocer" "Old Shop")))
+   (goto-char (point-min))
+   (while (search-forward "Old Shop" nil t)
+     (replace-match "Gone"))
+   (let ((ranked (ledger-payees-in-buffer)))
+     (setq ledger-complete-payees nil)
+     (should (equal ranked (ledger-payees-in-buffer)))
+     (should (equal ranked '("New Shop" "Grocer" "Gone"))))))
+
+
+(ert-deftest ledger-complete/test-005 ()
+  "Baseline test for leaving the payee being typed out of the candidates."
+  :tags '(complete baseline)
+
+  (ledger-tests-with-temp-file
+   (concat "2011/01/02 Grocer\n  Expenses:Misc  $1\n  Assets:Cash\n\n"
+           "2011/01/09 Grocer\n  Expenses:Misc  $1\n  Assets:Cash\n\n"
+           "2011/01/10 Gro")
+   (goto-char (point-max))
+   (should (equal (ledger-payees-in-buffer) '("Grocer")))
+   (goto-char (point-min))
+   (forward-line 1)
+   (should (equal (ledger-payees-in-buffer) '("Grocer" "Gro")))))
+
+
+(defun ledger-complete-test-last-used ()
+  "Return the last use of the accounts of the buffer as a sorted alist."
+  (let (alist)
+    (maphash (lambda (account day)
+               (push (cons account day) alist))
+             (ledger-complete-account-days))
+    (sort alist (lambda (a b) (string< (car a) (car b))))))
+
+
+(ert-deftest ledger-complete/test-006 ()
+  "Regression test for keeping the last use of accounts up to date."
+  :tags '(complete regress)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-complete-account-days)
+   (search-forward "2011/04/27")
+   (replace-match "2011/05/01")
+   (should (= (cdr (assoc "Expenses:Books" (ledger-complete-test-last-used)))
+              (time-to-days (encode-time 0 0 0 1 5 2011))))
+   (ledger-navigate-beginning-of-xact)
+   (delete-region (point) (progn (ledger-navigate-end-of-xact) (point)))
+   (let ((last-used (ledger-complete-test-last-used)))
+     (should (< (cdr (assoc "Expenses:Books" last-used))
+                (time-to-days (encode-time 0 0 0 1 5 2011))))
+     (setq ledger-complete-account-uses nil)
+     (should (equal last-used (ledger-complete-test-last-used))))))
+
+
+(ert-deftest ledger-complete/test-007 ()
+  "Regression test for annotating an included file with the journal balances."
+  :tags '(complete regress)
+
+  (let* ((directory (make-temp-file "ledger-tests-" t))
+         (master (expand-file-name "master.ledger" directory))
+         (included (expand-file-name "included.ledger" directory)))
+    (unwind-protect
+        (progn
+          (with-temp-file master
+            (insert "include included.ledger\n\n"
+                    "2011/01/01 Bookstore\n  Expenses:Books  $10.00\n  Assets:Cash\n"))
+          (with-temp-file included
+            (insert "2011/02/01 Bookstore\n  Expenses:Books  $5.00\n  Assets:Cash\n"))
+          (with-current-buffer (find-file-noselect included)
+            (unwind-protect
+                (progn
+                  (ledger-mode)
+                  (setq-local ledger-master-file master)
+                  (ledger-complete-refresh-balances)
+                  (with-timeout (10)
+                    (while (null ledger-complete-balances)
+                      (accept-process-output nil 0.1)))
+                  (should (string-match "15\\.00  2011/02/01\\'"
+                                        (ledger-complete-account-annotation
+                                         (current-buffer) "Expenses:Books"))))
+              (kill-buffer))))
+      (let ((buffer (get-file-buffer master)))
+        (when buffer
+          (kill-buffer buffer)))
+      (delete-directory directory t))))
+
+
 (provide 'complete-test)
 
 ;;; complete-test.el ends here
@@ -41,6 +41,35 @@ http://bugs.ledger-cli.org/show_bug.cgi?id=254"
      (eq t ledger-works))))
 
 
+(ert-deftest ledger-exec/test-002 ()
+  "Regress test for keeping the errors of background runs out of their output."
+  :tags '(exec regress)
+
+  (let* ((directory (file-name-as-directory (make-temp-file "ledger-tests-" t)))
+         (ledger-binary-path (expand-file-name "ledger" directory))
+         (output nil))
+    (unwind-protect
+        (progn
+          (with-temp-file ledger-binary-path
+            (insert "#!/bin/sh\necho Warning >&2\npwd\ncat\n"))
+          (set-file-modes ledger-binary-path #o755)
+          (with-temp-buffer
+            (setq default-directory directory)
+            (insert "2011/01/01 Store\n")
+            (let ((process (ledger-exec-ledger-async
+                            (current-buffer)
+                            (lambda (buffer)
+                              (setq output (with-current-buffer buffer
+                                             (buffer-string)))))))
+              (with-timeout (10)
+                (while (process-live-p process)
+                  (accept-process-output process 0.1)))))
+          (should (string-match "\\`\\(.*\\)\n2011/01/01 Store\n\\'" output))
+          (should (equal (file-truename (file-name-as-directory (match-string 1 output)))
+                         (file-truename directory))))
+      (delete-directory directory t))))
+
+
 (provide 'exec-test)
 
 ;;; exec-test.el ends here
@@ -0,0 +1,81 @@
+;;; index-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-index
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-index-test-record (payee)
+  "Return the index record of the xact of the current buffer paid to PAYEE."
+  (let (found)
+    (maphash (lambda (_marker record)
+               (when (equal (aref record 1) payee)
+                 (setq found record)))
+             (ledger-index-update))
+    found))
+
+
+(ert-deftest ledger-index/test-001 ()
+  "Baseline test for parsing amounts."
+  :tags '(index baseline)
+
+  (should (equal (ledger-parse-amount "$1,200.00") '(1200.0 "$")))
+  (should (equal (ledger-parse-amount "-$10") '(-10 "$")))
+  (should (equal (ledger-parse-amount "$-10") '(-10 "$")))
+  (should (equal (ledger-parse-amount "10 EUR @ $1.10") '(10 "EUR")))
+  (should (equal (ledger-parse-amount "\"ABC 1\" 5") '(5 "ABC 1")))
+  (should (equal (ledger-parse-amount "10") '(10 nil)))
+  (should (null (ledger-parse-amount "(10 * 2)")))
+  (should (null (ledger-parse-amount nil))))
+
+
+(ert-deftest ledger-index/test-002 ()
+  "Baseline test for keeping the index up to date with edits."
+  :tags '(index baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let ((record (ledger-index-test-record "Book Store")))
+     (should (equal (aref record 0)
+                    (time-to-days (encode-time 0 0 0 27 1 2011))))
+     (should (equal (aref record 2)
+                    '(("Expenses:Books" "$20.00" 20.0 "$")
+                      ("Liabilities:MasterCard" nil)))))
+   (goto-char (point-min))
+   (search-forward "$20.00")
+   (replace-match "$25.00")
+   (should (equal (nth 2 (car (aref (ledger-index-test-record "Book Store") 2)))
+                  25.0))
+   (ledger-navigate-beginning-of-xact)
+   (delete-region (point) (progn (ledger-navigate-end-of-xact) (point)))
+   (should (null (ledger-index-test-record "Book Store")))
+   (should (null (ledger-verify-buffer)))))
+
+
+(provide 'index-test)
+
+;;; index-test.el ends here
@@ -0,0 +1,137 @@
+;;; lots-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-lots
+
+;;; Code:
+(require 'test-helper)
+
+
+(defvar ledger-lots-test-journal
+  "2016/01/05 Buy
+    Assets:Broker    10 AAPL @ $100
+    Assets:Checking
+
+2016/02/05 Buy
+    Assets:Broker    10 AAPL {$120}
+    Assets:Checking
+
+2016/03/05 Sell
+    Assets:Broker    -15 AAPL @ $130
+    Assets:Checking  $1950
+    Income:Gains
+"
+  "Journal buying and selling lots of a commodity.")
+
+
+(defun ledger-lots-test-total (gains)
+  "Return the realized and unrealized totals of GAINS as a list."
+  (let ((realized 0)
+        (unrealized 0))
+    (dolist (sale (car gains))
+      (setq realized (+ realized (nth 3 sale))))
+    (dolist (entry (nth 1 gains))
+      (setq unrealized (+ unrealized (nth 4 entry))))
+    (list realized unrealized)))
+
+
+(ert-deftest ledger-lots/test-001 ()
+  "Baseline test for FIFO and LIFO gains."
+  :tags '(lots baseline)
+
+  (ledger-tests-with-temp-file
+   ledger-lots-test-journal
+   (ledger-index-update)
+   (let ((buffers (list (current-buffer)))
+         (day (time-to-days (encode-time 0 0 0 5 3 2016))))
+     (let ((ledger-lots-method 'fifo))
+       (should (equal (ledger-lots-test-total (ledger-lots-gains buffers day))
+                      '(350 50))))
+     (let ((ledger-lots-method 'lifo))
+       (should (equal (ledger-lots-test-total (ledger-lots-gains buffers day))
+                      '(250 150))))
+     ;; Before the sale, nothing is realized.
+     (let* ((ledger-lots-method 'fifo)
+            (gains (ledger-lots-gains buffers (1- day))))
+       (should (null (car gains)))
+       (should (= (length (nth 1 gains)) 2))))))
+
+
+(ert-deftest ledger-lots/test-002 ()
+  "Baseline test for adding trades incrementally."
+  :tags '(lots baseline)
+
+  (ledger-tests-with-temp-file
+   ledger-lots-test-journal
+   (ledger-index-update)
+   (let ((buffers (list (current-buffer)))
+         (ledger-lots-method 'fifo)
+         (day (time-to-days (encode-time 0 0 0 10 4 2016))))
+     (ledger-lots-gains buffers day)
+     (goto-char (point-max))
+     (insert "\n2016/04/01 Sell\n    Assets:Broker    -3 AAPL @ $140\n    Assets:Checking\n"
+             "\nP 2016/04/08 AAPL $150\n")
+     (ledger-index-update)
+     (should ledger-lots-state)
+     (should (= (length ledger-lots-pending) 1))
+     (let ((incremental (ledger-lots-gains buffers day)))
+       (setq ledger-lots-state nil)
+       (should (equal (ledger-lots-test-total incremental)
+                      (ledger-lots-test-total (ledger-lots-gains buffers day))))
+       (should (equal (ledger-lots-test-total incremental) '(410 60)))))))
+
+
+(ert-deftest ledger-lots/test-003 ()
+  "Baseline test for closing lots of fractional quantities."
+  :tags '(lots baseline)
+
+  (ledger-tests-with-temp-file
+   "2016/01/05 Buy
+    Assets:Broker    0.1 BTC @ $400
+    Assets:Checking
+
+2016/01/06 Buy
+    Assets:Broker    0.2 BTC @ $500
+    Assets:Checking
+
+2016/02/05 Sell
+    Assets:Broker    -0.3 BTC @ $600
+    Assets:Checking
+"
+   (ledger-index-update)
+   (let* ((ledger-lots-method 'fifo)
+          (gains (ledger-lots-gains (list (current-buffer))
+                                    (time-to-days (encode-time 0 0 0 5 2 2016)))))
+     ;; No residue of the sale is left open nor sold out of no lot.
+     (should (null (nth 1 gains)))
+     (should (= (length (car gains)) 2))
+     (dolist (sale (car gains))
+       (should (nth 1 sale)))
+     (should (< (abs (- (car (ledger-lots-test-total gains)) 40)) 1e-9)))))
+
+
+(provide 'lots-test)
+
+;;; lots-test.el ends here
@@ -0,0 +1,210 @@
+;;; lsp-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-lsp
+
+;;; Code:
+(require 'test-helper)
+
+
+(defmacro ledger-lsp-test-with-server (&rest body)
+  "Run BODY with the current buffer opened in the language server.
+Messages sent to the client are collected in `sent' instead."
+  (declare (indent 0) (debug t))
+  `(let ((sent nil))
+     (cl-letf (((symbol-function 'ledger-lsp-send)
+                (lambda (message) (push message sent))))
+       (unwind-protect
+           (progn
+             (ledger-lsp-start)
+             (ledger-lsp-did-open
+              (list :textDocument (list :uri (ledger-lsp-file-uri (buffer-file-name))
+                                        :text (buffer-string))))
+             ,@body)
+         (ledger-lsp-stop)))))
+
+
+(defun ledger-lsp-test-params (search)
+  "Return the params of a request at the end of the first match of SEARCH."
+  (save-excursion
+    (goto-char (point-min))
+    (search-forward search)
+    (list :textDocument (list :uri (ledger-lsp-file-uri (buffer-file-name)))
+          :position (ledger-lsp-position (point)))))
+
+
+(defun ledger-lsp-test-frame (message)
+  "Return MESSAGE, a plist, framed and encoded as a client sends it."
+  (let ((body (encode-coding-string (json-encode (append '(:jsonrpc "2.0") message))
+                                    'utf-8)))
+    (concat (format "Content-Length: %d\r\n\r\n" (length body)) body)))
+
+
+(defun ledger-lsp-test-replies (output)
+  "Return the messages framed in the bytes OUTPUT of the server, as plists."
+  (let ((start 0)
+        (json-object-type 'plist)
+        (json-array-type 'list)
+        (json-key-type 'keyword)
+        replies)
+    (while (string-match "Content-Length: \\([0-9]+\\)\r\n\r\n" output start)
+      (let ((beg (match-end 0)))
+        (setq start (+ beg (string-to-number (match-string 1 output))))
+        (push (json-read-from-string
+               (decode-coding-string (substring output beg start) 'utf-8))
+              replies)))
+    (nreverse replies)))
+
+
+(defun ledger-lsp-test-change (beg end text)
+  "Send the replacement of BEG to END by TEXT to the language server."
+  (ledger-lsp-did-change
+   (list :textDocument (list :uri (ledger-lsp-file-uri (buffer-file-name)))
+         :contentChanges (list (list :range (ledger-lsp-range beg end)
+                                     :text text)))))
+
+
+(ert-deftest ledger-lsp/test-001 ()
+  "Baseline test for completion, hover, definition and references."
+  :tags '(lsp baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-lsp-test-with-server
+     (let ((items (ledger-lsp-completion (ledger-lsp-test-params "  Expenses:Boo"))))
+       (should (member "Expenses:Books"
+                       (mapcar (lambda (item) (plist-get item :label)) items))))
+     (let ((items (ledger-lsp-completion (ledger-lsp-test-params "2011/01/27 Book"))))
+       (should (member "Bookstore"
+                       (mapcar (lambda (item) (plist-get item :label)) items))))
+     (let ((hover (ledger-lsp-hover (ledger-lsp-test-params "  Expenses:Boo"))))
+       (should (string-match-p "\\$ 40\\.0"
+                               (plist-get (plist-get hover :contents) :value))))
+     (let ((hover (ledger-lsp-hover (ledger-lsp-test-params "  Expenses:Foo"))))
+       (should (string-match-p "\\$ 334\\.0"
+                               (plist-get (plist-get hover :contents) :value))))
+     (let ((references (ledger-lsp-references (ledger-lsp-test-params "  Expenses:Boo")))
+           (definition (ledger-lsp-definition (ledger-lsp-test-params "  Expenses:Boo"))))
+       (should (equal (length references) 2))
+       (should (equal definition (vector (aref references 0))))))))
+
+
+(ert-deftest ledger-lsp/test-002 ()
+  "Baseline test for keeping diagnostics up to date with edits."
+  :tags '(lsp baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-lsp-test-with-server
+     (should (equal (ledger-lsp-diagnostics (current-buffer)) []))
+     (ledger-lsp-test-change (point-max) (point-max)
+                             "\n2016/01/01 Test\n  Expenses:Food  $10.00\n  Assets:Cash  $-5.00\n")
+     (let ((diagnostics (ledger-lsp-diagnostics (current-buffer))))
+       (should (equal (length diagnostics) 1))
+       (should (string-match-p "off by \\$ 5"
+                               (plist-get (aref diagnostics 0) :message)))
+       (should (equal (plist-get (car sent) :params)
+                      (list :uri (ledger-lsp-file-uri (buffer-file-name))
+                            :diagnostics diagnostics))))
+     (goto-char (point-min))
+     (search-forward "$-5.00")
+     (ledger-lsp-test-change (match-beginning 0) (match-end 0) "$-10.00")
+     (should (equal (ledger-lsp-diagnostics (current-buffer)) []))
+     (search-backward "$-10.00")
+     (ledger-lsp-test-change (match-beginning 0) (match-end 0) "")
+     (should (equal (ledger-lsp-diagnostics (current-buffer)) []))
+     (search-backward "$10.00")
+     (ledger-lsp-test-change (match-beginning 0) (match-end 0) "")
+     (should (string-match-p "Only one"
+                             (plist-get (aref (ledger-lsp-diagnostics (current-buffer)) 0)
+                                        :message))))))
+
+
+(ert-deftest ledger-lsp/test-003 ()
+  "Baseline test for encoding messages in ASCII."
+  :tags '(lsp baseline)
+
+  (should (equal (ledger-lsp-escape #xe9) "\\u00e9"))
+  (should (equal (ledger-lsp-escape #x1F600) "\\ud83d\\ude00")))
+
+
+(ert-deftest ledger-lsp/test-004 ()
+  "Baseline test for counting columns in UTF-16 code units."
+  :tags '(lsp baseline)
+
+  (ledger-tests-with-temp-file
+   (concat "2016/01/01 " (string #x1F600) " Shop\n"
+           "    Expenses:Food  $10.00\n"
+           "    Assets:Cash\n")
+   (search-forward "Shop")
+   (let ((pos (match-beginning 0)))
+     (should (equal (ledger-lsp-position pos) '(:line 0 :character 14)))
+     (should (= (ledger-lsp-point '(:line 0 :character 14)) pos))
+     (should (= (ledger-lsp-point '(:line 0 :character 100)) (line-end-position))))
+   (forward-line)
+   (should (equal (ledger-lsp-position (point)) '(:line 1 :character 0)))))
+
+
+(ert-deftest ledger-lsp/test-005 ()
+  "Baseline test for the protocol spoken by a server subprocess."
+  :tags '(lsp baseline)
+
+  (let* ((file (make-temp-file "ledger-tests-" nil ".ledger"))
+         (uri (ledger-lsp-file-uri file))
+         (text (concat "2016/01/01 Caf" (string #xe9) " " (string #x1F600) "\n"
+                       "    Expenses:Food  $10.00\n"
+                       "    Assets:Cash  $-5.00\n"))
+         (input (concat
+                 (ledger-lsp-test-frame '(:id 1 :method "initialize" :params (:processId 1)))
+                 (ledger-lsp-test-frame (list :method "textDocument/didOpen"
+                                              :params (list :textDocument
+                                                            (list :uri uri :languageId "ledger"
+                                                                  :version 1 :text text))))
+                 (ledger-lsp-test-frame '(:id 2 :method "shutdown"))
+                 (ledger-lsp-test-frame '(:method "exit"))))
+         (command (ledger-lsp-server-command))
+         (output (unwind-protect
+                     (with-temp-buffer
+                       (let ((coding-system-for-write 'binary)
+                             (coding-system-for-read 'binary))
+                         (should (equal (apply #'call-process-region input nil (car command)
+                                               nil (list t nil) nil (cdr command))
+                                        0)))
+                       (buffer-string))
+                   (delete-file file)))
+         (replies (ledger-lsp-test-replies output)))
+    (should (= (length replies) 3))
+    (should (equal (plist-get (nth 0 replies) :id) 1))
+    (should (plist-get (plist-get (nth 0 replies) :result) :capabilities))
+    (let ((params (plist-get (nth 1 replies) :params)))
+      (should (equal (plist-get (nth 1 replies) :method) "textDocument/publishDiagnostics"))
+      (should (equal (plist-get params :uri) uri))
+      (should (= (length (plist-get params :diagnostics)) 1)))
+    (should (equal (plist-get (nth 2 replies) :id) 2))))
+
+
+(provide 'lsp-test)
+
+;;; lsp-test.el ends here
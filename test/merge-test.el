@@ -0,0 +1,101 @@
+;;; merge-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-merge
+
+;;; Code:
+(require 'test-helper)
+
+
+(defconst ledger-merge-test-base
+  "2020/01/01 Alpha
+    Expenses:Food  $ 10.00
+    Assets:Cash
+
+2020/01/02 Beta
+    Expenses:Food  $ 20.00
+    Assets:Cash
+
+2020/01/03 Gamma
+    Expenses:Food  $ 30.00
+    Assets:Cash
+")
+
+
+(ert-deftest ledger-merge/test-001 ()
+  "Baseline test for merging changes made on both sides."
+  :tags '(merge baseline)
+
+  (let ((ours (concat (replace-regexp-in-string
+                       "Food  \\$ 10" "Food          $ 10" ledger-merge-test-base)
+                      "\n2020/01/05 Delta\n    Expenses:Food  $ 50.00\n    Assets:Cash\n"))
+        (theirs (concat (replace-regexp-in-string
+                         "\\$ 20" "$ 25" ledger-merge-test-base)
+                        "\n2020/01/04 Epsilon\n    Assets:Cash\n    Assets:Cash\n")))
+    (should
+     (equal (ledger-merge-strings ledger-merge-test-base ours theirs)
+            (cons "2020/01/01 Alpha
+    Expenses:Food          $ 10.00
+    Assets:Cash
+
+2020/01/02 Beta
+    Expenses:Food  $ 25.00
+    Assets:Cash
+
+2020/01/03 Gamma
+    Expenses:Food  $ 30.00
+    Assets:Cash
+
+2020/01/04 Epsilon
+    Assets:Cash
+    Assets:Cash
+
+2020/01/05 Delta
+    Expenses:Food  $ 50.00
+    Assets:Cash
+"
+                  0)))))
+
+
+(ert-deftest ledger-merge/test-002 ()
+  "Baseline test for conflicting changes of a transaction."
+  :tags '(merge baseline)
+
+  (let* ((ours (replace-regexp-in-string "\\$ 20" "$ 21" ledger-merge-test-base))
+         (theirs (replace-regexp-in-string "\\$ 20" "$ 22" ledger-merge-test-base))
+         (result (ledger-merge-strings ledger-merge-test-base ours theirs)))
+    (should (= (cdr result) 1))
+    (should (string-match-p (concat "<<<<<<< ours\n2020/01/02 Beta\n.*\\$ 21"
+                                    "[^=]*=======\n2020/01/02 Beta\n.*\\$ 22")
+                            (car result))))
+  ;; The same change on both sides is no conflict.
+  (let ((both (replace-regexp-in-string "\\$ 20" "$ 21" ledger-merge-test-base)))
+    (should (equal (ledger-merge-strings ledger-merge-test-base both both)
+                   (cons both 0)))))
+
+
+(provide 'merge-test)
+
+;;; merge-test.el ends here
@@ -44,6 +44,71 @@ http://bugs.ledger-cli.org/show_bug.cgi?id=441"
    (should (eq 104 (point)))))
 
 
+(ert-deftest ledger-navigate/test-002 ()
+  "Baseline test for the line table under edits."
+  :tags '(navigate baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (forward-line 10)
+   (narrow-to-region (point) (point-max))
+   (ledger-navigate-to-line 2)
+   (should (= (line-number-at-pos) 2))
+   (widen)
+   (let ((ledger-navigate-line-chunk-size 4))
+     (random "ledger-navigate")
+     (dotimes (_i 200)
+       (let ((pos (+ (point-min) (random (1+ (buffer-size))))))
+         (if (zerop (random 2))
+             (delete-region pos (min (point-max) (+ pos (random 20))))
+           (goto-char pos)
+           (insert (nth (random 3) '("\n" "x" "\n  Assets:Cash\n\n")))))
+       (let ((line (random (+ 3 (count-lines (point-min) (point-max))))))
+         (goto-char (point-min))
+         (forward-line (1- line))
+         (should (= (ledger-navigate-line-position line) (point)))
+         (should (= (ledger-navigate-line-number (point)) (line-number-at-pos)))))
+     (should (null (ledger-verify-buffer))))))
+
+
+(ert-deftest ledger-navigate/test-003 ()
+  "Baseline test for the comment block index under edits."
+  :tags '(navigate baseline)
+
+  (ledger-tests-with-temp-file
+   (concat "; header\n; more\n\n"
+           "!comment\n2011/01/01 Hidden\n  Assets:Cash  $1\n!end_comment\n\n"
+           demo-ledger)
+   (should (equal (ledger-navigate-find-element-extents 1) '(1 17)))
+   (search-forward "Hidden")
+   (should (equal (ledger-navigate-find-element-extents (point)) '(18 76)))
+   (random "ledger-navigate")
+   (dotimes (_i 200)
+     (let ((pos (+ (point-min) (random (1+ (buffer-size))))))
+       (if (zerop (random 2))
+           (delete-region pos (min (point-max) (+ pos (random 20))))
+         (goto-char pos)
+         (insert (nth (random 5) '("\n" "; x\n" "comment\n" "end comment\n" ";"))))))
+   (should (null (ledger-verify-buffer)))))
+
+
+(ert-deftest ledger-navigate/test-004 ()
+  "Baseline test for shifting the comment blocks lazily."
+  :tags '(navigate baseline)
+
+  (ledger-tests-with-temp-file
+   (concat "; header\n\n" demo-ledger "\n; footer\n")
+   (ledger-navigate-comment-at (point-min))
+   (let ((top (copy-marker 11))
+         (bottom (copy-marker (- (point-max) 10))))
+     (dotimes (i 40)
+       ;; Alternate between two places, so the pending shift moves.
+       (goto-char (if (zerop (% i 2)) top bottom))
+       (insert (nth (% i 3) '("; x\n" "\n" "  ; y\n")))
+       (should (equal (ledger-navigate-comments-snapshot)
+                      (ledger-navigate-comments-scan)))))))
+
+
 (provide 'navigate-test)
 
 ;;; navigate-test.el ends here
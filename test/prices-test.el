@@ -0,0 +1,98 @@
+;;; prices-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-prices
+
+;;; Code:
+(require 'test-helper)
+
+
+(defvar ledger-prices-test-db
+  "; Prices
+P 2016/01/04 AAPL $105.35
+P 2016/01/04 EUR $1.08
+P 2016/02/01 AAPL $96.43
+P 2016/01/15 AAPL 97.13 USD
+P 2016/03/01 \"VANGUARD 500\" $190.50
+"
+  "Price database with prices out of date order.")
+
+
+(ert-deftest ledger-prices/test-001 ()
+  "Baseline test for looking up prices."
+  :tags '(prices baseline)
+
+  (with-temp-buffer
+    (ledger-prices-mode)
+    (insert ledger-prices-test-db)
+    (should (equal (ledger-prices-lookup "AAPL" "2016/01/20") "97.13 USD"))
+    (should (equal (ledger-prices-lookup "AAPL" "2016/03/01") "$96.43"))
+    (should (equal (ledger-prices-lookup "AAPL" "2016/01/04") "$105.35"))
+    (should (null (ledger-prices-lookup "AAPL" "2015/12/31")))
+    (should (equal (ledger-prices-lookup "VANGUARD 500" "2016/03/01") "$190.50"))
+    (ledger-prices-goto "EUR" "2016/06/01")
+    (should (looking-at "P 2016/01/04 EUR"))))
+
+
+(ert-deftest ledger-prices/test-002 ()
+  "Baseline test for appending prices without rebuilding the index."
+  :tags '(prices baseline)
+
+  (with-temp-buffer
+    (ledger-prices-mode)
+    (insert ledger-prices-test-db)
+    (let ((index (ledger-prices-update)))
+      (goto-char (point-max))
+      (insert "P 2016/04/01 AAPL $109.99")
+      (should (equal (ledger-prices-lookup "AAPL" "2016/04/02") "$96.43"))
+      (insert "\n")
+      (should (equal (ledger-prices-lookup "AAPL" "2016/04/02") "$109.99"))
+      (should (eq (ledger-prices-update) index))
+      (goto-char (point-min))
+      (insert "P 2016/04/02 AAPL $110.00\n")
+      (should-not ledger-prices-index)
+      (should (equal (ledger-prices-lookup "AAPL" "2016/04/02") "$110.00")))))
+
+
+(ert-deftest ledger-prices/test-003 ()
+  "Baseline test for fontifying runs of prices."
+  :tags '(prices baseline)
+
+  (with-temp-buffer
+    (ledger-prices-mode)
+    (insert ledger-prices-test-db)
+    (ledger-prices-fontify-region (point-min) (point-max))
+    (should (eq (get-text-property 1 'font-lock-face) 'ledger-font-comment-face))
+    (goto-char (point-min))
+    (search-forward "EUR")
+    (should (eq (get-text-property (point) 'font-lock-face)
+                'ledger-font-price-directive-face))
+    (should (eq (get-text-property (1- (point-max)) 'font-lock-face)
+                'ledger-font-price-directive-face))))
+
+
+(provide 'prices-test)
+
+;;; prices-test.el ends here
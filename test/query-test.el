@@ -0,0 +1,70 @@
+;;; query-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-query
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-query/test-001 ()
+  "Baseline test for querying transactions and accounts."
+  :tags '(query baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let ((xacts (ledger-query-transactions (current-buffer) "Expenses:Books")))
+     (should (equal (mapcar (lambda (xact) (plist-get xact :payee)) xacts)
+                    '("Book Store" "Bookstore")))
+     (should (equal (plist-get (car xacts) :date) (encode-time 0 0 0 27 1 2011)))
+     (should (equal (plist-get (car (plist-get (car xacts) :postings)) :account)
+                    "Expenses:Books"))
+     (let ((sum (ledger-query-sum (ledger-query-postings (current-buffer) "Expenses:Books"))))
+       (should (= (length sum) 1))
+       (should (= (car (car sum)) 40))
+       (should (equal (nth 1 (car sum)) "$"))))
+   (let ((books (car (ledger-query-accounts (current-buffer) "Expenses:Books"))))
+     (should (equal (plist-get books :account) "Expenses"))
+     (should (= (car (car (plist-get books :total))) 40)))))
+
+
+(ert-deftest ledger-query/test-002 ()
+  "Baseline test for querying account balances as JSON records."
+  :tags '(query baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let ((accounts (ledger-query-balances (current-buffer) "Expenses:Books")))
+     (should (equal accounts '((:account "Expenses:Books" :total ((40 "$"))))))
+     (should (equal (ledger-query-sum-accounts accounts) '((40 "$")))))
+   (let ((accounts (ledger-query-balances (current-buffer) "--limit" "cleared"
+                                          "Assets:Checking")))
+     (should (equal (mapcar (lambda (account) (plist-get account :account)) accounts)
+                    '("Assets:Checking"))))))
+
+
+(provide 'query-test)
+
+;;; query-test.el ends here
@@ -735,6 +735,110 @@ http://bugs.ledger-cli.org/show_bug.cgi?id=262"
        (eq (1- line-before-delete) (line-number-at-pos))))))
 
 
+(ert-deftest ledger-reconcile/test-029 ()
+  "Reconcile a statement period: postings after its end are not listed,
+and the cached opening balance plus the period adds up to the balance
+at its end."
+  :tags '(reconcile baseline)
+
+  (ledger-tests-with-temp-file
+      demo-ledger
+    (ledger-reconcile "Assets:Checking" '(0 "$")) ; launch reconciliation
+    (select-window (get-buffer-window ledger-recon-buffer-name)) ; IRL user select recon window
+    (ledger-reconcile-change-period (encode-time 0 0 0 1 1 2011)
+                                    (encode-time 0 0 0 31 1 2011))
+    (should
+     (equal (buffer-string)
+      "Reconciling account Assets:Checking
+
+Statement 2011/01/01 to 2011/01/31
+
+2011/01/14      Bank                                               Assets:Checking                      $ -300.00
+2011/01/19      Grocery Store                                      Assets:Checking                       $ -44.00
+2011/01/25      Bank                                               Assets:Checking                     $ 5,500.00
+2011/01/25      Tom's Used Cars                                    Assets:Checking                    $ -5,500.00"))
+    (should ledger-reconcile-opening-balance)
+    (goto-char (point-min))
+    (forward-line 4)
+    (ledger-reconcile-toggle)                     ; mark pending
+    (let ((opening ledger-reconcile-opening-balance))
+      (should
+       (equal (ledger-reconcile-balance)
+              (ledger-reconcile-get-cleared-or-pending-balance
+               ledger-buf ledger-acct nil (encode-time 0 0 0 1 2 2011))))
+      (should (eq opening ledger-reconcile-opening-balance)))
+    (ledger-reconcile-quit)))
+
+
+(ert-deftest ledger-reconcile/test-030 ()
+  "Reconcile a statement period: uncleared postings from before its
+start are listed, and toggling one of them updates the opening balance."
+  :tags '(reconcile baseline)
+
+  (ledger-tests-with-temp-file
+      "2010/12/20 Check 101
+    Expenses:Rent                            $500.00
+    Assets:Checking
+
+2011/01/05 * Paycheck
+    Assets:Checking                        $1,000.00
+    Income:Salary
+
+2011/01/10 Grocery Store
+    Expenses:Food                             $40.00
+    Assets:Checking
+"
+    (ledger-reconcile "Assets:Checking" '(0 "$"))
+    (select-window (get-buffer-window ledger-recon-buffer-name))
+    (ledger-reconcile-change-period (encode-time 0 0 0 1 1 2011)
+                                    (encode-time 0 0 0 31 1 2011))
+    (should (string-match-p "^2010/12/20 +Check 101 " (buffer-string)))
+    (should (string-match-p "^2011/01/10 +Grocery Store " (buffer-string)))
+    (goto-char (point-min))
+    (forward-line 4)
+    (ledger-reconcile-toggle)           ; mark the check pending
+    (should (equal (cdr ledger-reconcile-opening-balance) '((-500 "$"))))
+    (should (= 500 (car (ledger-reconcile-balance))))
+    (ledger-reconcile-quit)))
+
+
+
+(ert-deftest ledger-reconcile/test-031 ()
+  "Reconcile a statement period: saving an edit before its start
+updates the opening balance, which may be in another commodity."
+  :tags '(reconcile baseline)
+
+  (ledger-tests-with-temp-file
+      "2010/12/15 * Deposit
+    Assets:Checking                          $100.00
+    Equity:Opening
+
+2010/12/20 * Transfer
+    Assets:Checking                           10 EUR
+    Equity:Opening
+
+2011/01/05 * Paycheck
+    Assets:Checking                        $1,000.00
+    Income:Salary
+"
+    (ledger-reconcile "Assets:Checking" '(0 "$"))
+    (select-window (get-buffer-window ledger-recon-buffer-name))
+    (ledger-reconcile-change-period (encode-time 0 0 0 1 1 2011)
+                                    (encode-time 0 0 0 31 1 2011))
+    (should (equal (ledger-reconcile-balance) '(1100 "$")))
+    (with-current-buffer ledger-buffer
+      (goto-char (point-min))
+      (search-forward "$100.00")
+      (replace-match "$200.00")
+      (save-buffer))
+    (with-current-buffer ledger-recon-buffer-name
+      (should-not ledger-reconcile-opening-balance)
+      (should (equal (ledger-reconcile-balance) '(1200 "$")))
+      (let ((ledger-reconcile-default-commodity "EUR"))
+        (should (equal (ledger-reconcile-balance) '(10 "EUR")))))
+    (ledger-reconcile-quit)))
+
+
 (provide 'reconcile-test)
 
 ;;; reconcile-test.el ends here
@@ -0,0 +1,120 @@
+;;; recur-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-recur
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-recur-test-journal ()
+  "Return a journal of 2016 with payees recurring at various periods."
+  (let (xacts)
+    (dotimes (i 12)
+      (push (list (encode-time 0 0 0 1 (1+ i) 2016)
+                  "Landlord" "Expenses:Rent" "$1,200.00")
+            xacts))
+    (dotimes (i 50)
+      (push (list (encode-time 0 0 0 (+ 4 (* 7 i)) 1 2016)
+                  "Coffee Shop" "Expenses:Coffee" (format "$%d.50" (+ 3 (% i 3))))
+            xacts))
+    (dotimes (i 26)
+      (push (list (encode-time 0 0 0 (+ 8 (* 14 i)) 1 2016)
+                  "Employer" "Income:Salary" "$-2,000.00")
+            xacts))
+    (dotimes (i 4)
+      (push (list (encode-time 0 0 0 15 (+ 2 (* 3 i)) 2016)
+                  "Water Company" "Expenses:Utilities" "$60.00")
+            xacts))
+    (dolist (day '(3 40 45 100 230))
+      (push (list (encode-time 0 0 0 day 1 2016)
+                  "Hardware Store" "Expenses:House" "$35.00")
+            xacts))
+    (mapconcat (lambda (xact)
+                 (format "%s %s\n    %s  %s\n    Assets:Checking\n"
+                         (format-time-string "%Y/%m/%d" (nth 0 xact))
+                         (nth 1 xact) (nth 2 xact) (nth 3 xact)))
+               (sort xacts (lambda (a b) (time-less-p (car a) (car b))))
+               "\n")))
+
+
+(defun ledger-recur-test-descriptors (&optional scheduled)
+  "Return the payees recurring in the current buffer, except SCHEDULED.
+Each is a list (PAYEE DESCRIPTOR STABLE)."
+  (ledger-index-update)
+  (mapcar (lambda (candidate)
+            (list (car candidate)
+                  (ledger-recur-descriptor (cdr candidate))
+                  (plist-get (cdr candidate) :stable)))
+          (ledger-recur-candidates (list (current-buffer)) scheduled)))
+
+
+(ert-deftest ledger-recur/test-001 ()
+  "Baseline test for detecting periods and stable amounts."
+  :tags '(recur baseline)
+
+  (ledger-tests-with-temp-file
+   (ledger-recur-test-journal)
+   (should (equal (ledger-recur-test-descriptors)
+                  '(("Coffee Shop" "[*/*/0Mo]" nil)
+                    ("Employer" "[2016/12/23+2Fr]" t)
+                    ("Landlord" "[*/*/1]" t)
+                    ("Water Company" "[*/2,5,8,11/15]" t))))
+   (should (equal (mapcar #'car (ledger-recur-test-descriptors '("Landlord")))
+                  '("Coffee Shop" "Employer" "Water Company")))
+   ;; Every descriptor is understood by ledger-schedule.
+   (dolist (payee (ledger-recur-test-descriptors))
+     (should (functionp (ledger-schedule-read-descriptor-tree (nth 1 payee)))))))
+
+
+(ert-deftest ledger-recur/test-002 ()
+  "Baseline test for the proposed schedule entries."
+  :tags '(recur baseline)
+
+  (ledger-tests-with-temp-file
+   (ledger-recur-test-journal)
+   (let* ((schedule (make-temp-file "ledger-schedule-"))
+          (ledger-schedule-file schedule)
+          (files (list (buffer-file-name))))
+     (unwind-protect
+         (progn
+           (with-temp-file schedule
+             (insert "[*/*/0Mo] Coffee Shop\n    Expenses:Coffee  $4.50\n    Assets:Checking\n"))
+           (ledger-recur-propose files)
+           (with-current-buffer ledger-recur-buffer-name
+             (let ((text (buffer-string)))
+               (should-not (string-match-p "Coffee Shop" text))
+               (should (string-match-p
+                        (concat "^; Landlord: monthly, 12 times, last on 2016/12/01\n"
+                                "\\[\\*/\\*/1\\] Landlord\n"
+                                "    Expenses:Rent  \\$1,200.00\n"
+                                "    Assets:Checking\n")
+                        text)))))
+       (delete-file schedule)))))
+
+
+(provide 'recur-test)
+
+;;; recur-test.el ends here
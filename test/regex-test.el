@@ -0,0 +1,238 @@
+;;; regex-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression and performance tests for ledger-regex.  The performance
+;;  tests time the regexps and are tagged `performance' so that the
+;;  batch run leaves them out: run them with `make test-performance'.
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-regex-test-repeat (string count)
+  "Return STRING repeated COUNT times."
+  (apply 'concat (make-list count string)))
+
+(defvar ledger-regex-test-corpora
+  (list (cons "long payee"
+              (lambda (size)
+                (concat "2016/01/01 * " (ledger-regex-test-repeat "Payee " (/ size 6)))))
+        (cons "blanks in a payee"
+              (lambda (size) (concat "2016/01/01 A" (make-string size ?\s) "B")))
+        (cons "blanks before a note"
+              (lambda (size) (concat "2016/01/01 A" (make-string size ?\s) ";")))
+        (cons "blanks in a posting"
+              (lambda (size) (concat "    A" (make-string size ?\s) ";")))
+        (cons "long spaces in a posting"
+              (lambda (size)
+                (concat "    A" (ledger-regex-test-repeat "  x" (/ size 3)) ";y")))
+        (cons "long number"
+              (lambda (size) (concat "    A  " (make-string size ?1) "!")))
+        (cons "long separated number"
+              (lambda (size)
+                (concat "    A  " (ledger-regex-test-repeat "1," (/ size 2)) "!")))
+        (cons "long price"
+              (lambda (size) (concat "    A  10 @ " (make-string size ?x) ";")))
+        (cons "unclosed codes"
+              (lambda (size)
+                (ledger-regex-test-repeat "2016/01/01 (x\n" (/ size 13))))
+        (cons "unclosed quotes"
+              (lambda (size) (ledger-regex-test-repeat "  \"x\n" (/ size 5))))
+        (cons "unterminated !comment"
+              (lambda (size)
+                (concat "!comment\n" (ledger-regex-test-repeat "line\n" (/ size 5)))))
+        (cons "long line"
+              (lambda (size) (make-string size ?x))))
+  "Alist of adversarial inputs for the regexps of ledger-regex.el.
+Each element is (NAME . FUNCTION), FUNCTION returning an input of
+about the number of characters it is called with.")
+
+(defvar ledger-regex-test-searched
+  '(ledger-account-any-status-regex
+    ledger-amount-regex
+    ledger-iso-date-regexp
+    ledger-iterate-regex
+    ledger-payee-any-status-regex
+    ledger-post-line-regexp
+    ledger-xact-start-regex)
+  "Regexps that ledger-mode searches for, rather than matches at a line start.
+`ledger-comment-regex' is searched for too but left out: a search
+for blanks followed by a `;' rescans a run of blanks from each of
+its positions, whatever the regexp.")
+
+(defun ledger-regex-test-regexps ()
+  "Return the regexps defined in ledger-regex.el."
+  (let (regexps)
+    (dolist (entry (cdr (assoc (symbol-file 'ledger-amount-regex 'defvar)
+                               load-history)))
+      (when (and (symbolp entry)
+                 (boundp entry)
+                 (stringp (symbol-value entry)))
+        (push entry regexps)))
+    (nreverse regexps)))
+
+(defun ledger-regex-test-time (regexp text searched)
+  "Return the seconds taken to match REGEXP against TEXT.
+If SEARCHED is non-nil, search for all the matches of REGEXP,
+otherwise match it at the start of each line."
+  (with-temp-buffer
+    (set-syntax-table ledger-mode-syntax-table)
+    (insert text "\n")
+    (goto-char (point-min))
+    (garbage-collect)
+    (let ((case-fold-search nil)
+          (start (float-time)))
+      (if searched
+          (while (and (not (eobp))
+                      (re-search-forward regexp nil t))
+            (when (and (= (match-beginning 0) (point))
+                       (not (eobp)))
+              (forward-char)))
+        (while (not (eobp))
+          (looking-at regexp)
+          (forward-line)))
+      (- (float-time) start))))
+
+(defun ledger-regex-test-superlinear (regexps searched)
+  "Return the REGEXPS whose matching time grows faster than their input.
+Each is returned as a list of its name and of the names of the
+corpora on which it does.  SEARCHED is as for `ledger-regex-test-time'."
+  (let (slow)
+    (dolist (regexp regexps)
+      (let (corpora)
+        (dolist (corpus ledger-regex-test-corpora)
+          (let ((small (ledger-regex-test-time (symbol-value regexp)
+                                               (funcall (cdr corpus) 10000)
+                                               searched))
+                (large (ledger-regex-test-time (symbol-value regexp)
+                                               (funcall (cdr corpus) 40000)
+                                               searched)))
+            ;; A quadratic regexp takes sixteen times as long.
+            (when (> large (+ (* 8 small) 0.05))
+              (push (car corpus) corpora))))
+        (when corpora
+          (push (cons regexp (nreverse corpora)) slow))))
+    (nreverse slow)))
+
+
+(ert-deftest ledger-regex/test-001 ()
+  "Performance test for matching every regexp at line starts."
+  :tags '(regex baseline performance)
+
+  (should (null (ledger-regex-test-superlinear (ledger-regex-test-regexps) nil))))
+
+
+(ert-deftest ledger-regex/test-002 ()
+  "Performance test for searching for the searched regexps."
+  :tags '(regex baseline performance)
+
+  (should (null (ledger-regex-test-superlinear ledger-regex-test-searched t))))
+
+
+(ert-deftest ledger-regex/test-003 ()
+  "Baseline test for the payee regexps."
+  :tags '(regex baseline)
+
+  (dolist (case '(("2016/01/01 Grocery Store" . "Grocery Store")
+                  ("2016/01/01 * Grocery Store" . "Grocery Store")
+                  ("2016/01/01 * (1024) Grocery Store  ; note" . "Grocery Store")
+                  ("2016/01/01=2016/01/02 Grocery Store;note" . "Grocery Store")
+                  ("2016/01/01 Grocery Store   " . "Grocery Store")
+                  ("2016/01/01 *" . "*")))
+    (should (string-match ledger-payee-any-status-regex (car case)))
+    (should (equal (match-string 3 (car case)) (cdr case))))
+  (should (string-match ledger-payee-cleared-regex "2016/01/01 * (12) Store ; x"))
+  (should (equal (match-string 1 "2016/01/01 * (12) Store ; x") "(12) "))
+  (should (equal (match-string 2 "2016/01/01 * (12) Store ; x") "Store"))
+  (should-not (string-match ledger-payee-uncleared-regex "2016/01/01 * Store")))
+
+
+(ert-deftest ledger-regex/test-004 ()
+  "Baseline test for the amount regexp."
+  :tags '(regex baseline)
+
+  (let ((case-fold-search nil))
+    (dolist (case '(("    Assets  $1,000.00" "1,000" ".00")
+                    ("    Assets  1.000,00 EUR" "1.000" ",00")
+                    ("    Assets\t-10 EUR @ $1.25" "10" nil)
+                    ("    Assets \t 10 AAPL {$2} @ $3  ; note" "10" nil)
+                    ("    Assets  10 = $0" "10" nil)))
+      (should (string-match ledger-amount-regex (car case)))
+      (should (equal (match-string 3 (car case)) (nth 1 case)))
+      (should (equal (match-string 4 (car case)) (nth 2 case))))
+    (should-not (string-match ledger-amount-regex "    Assets 10"))
+    (should-not (string-match ledger-amount-regex "    Assets  10 !"))))
+
+
+(ert-deftest ledger-regex/test-005 ()
+  "Baseline test for the transaction and posting line regexps."
+  :tags '(regex baseline)
+
+  (let ((line "2016/01/01 * (12) Grocery Store  ; note"))
+    (should (string-match ledger-xact-line-regexp line))
+    (should (equal (match-string ledger-regex-xact-line-group-code line) "12"))
+    (should (equal (match-string ledger-regex-xact-line-group-note line) " note")))
+  (let ((line "2016/01/01 Grocery Store ; not a note"))
+    (should (string-match ledger-xact-line-regexp line))
+    (should (null (match-string ledger-regex-xact-line-group-note line))))
+  (let ((line "    * [Budget:Food]    10 EUR  ; note"))
+    (should (string-match ledger-post-line-regexp line))
+    (should (equal (match-string ledger-regex-post-line-group-state line) "*"))
+    (should (equal (match-string ledger-regex-post-line-group-account line) "Budget:Food"))
+    (should (equal (match-string ledger-regex-post-line-group-account-kind line) "["))
+    (should (equal (ledger-xact-trim (match-string ledger-regex-post-line-group-amount line))
+                   "10 EUR"))
+    (should (equal (match-string ledger-regex-post-line-group-note line) " note")))
+  (let ((line "    Assets:Checking   ;"))
+    (should (string-match ledger-post-line-regexp line))
+    (should (equal (match-string ledger-regex-post-line-group-account line) "Assets:Checking"))
+    (should (null (match-string ledger-regex-post-line-group-amount line))))
+  (should-not (string-match ledger-code-regexp "(12\n3)")))
+
+
+(ert-deftest ledger-regex/test-006 ()
+  "Baseline test for the multiline comment regexp."
+  :tags '(regex baseline)
+
+  (should (string-match ledger-multiline-comment-regex
+                        "!comment\nline\n\n!end_comment\n2016/01/01 Store\n"))
+  (should (= (match-end 0) 27))
+  (should-not (string-match ledger-multiline-comment-regex
+                            (concat "!comment\n"
+                                    (ledger-regex-test-repeat "line\n" 1000)))))
+
+
+(ert-deftest ledger-regex/test-007 ()
+  "Baseline test for the regexps the performance tests cover."
+  :tags '(regex baseline)
+
+  (should (> (length (ledger-regex-test-regexps)) 40))
+  (dolist (regexp ledger-regex-test-searched)
+    (should (memq regexp (ledger-regex-test-regexps)))))
+
+
+(provide 'regex-test)
+
+;;; regex-test.el ends here
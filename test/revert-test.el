@@ -0,0 +1,72 @@
+;;; revert-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-revert
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-revert/test-001 ()
+  "Baseline test for merging an append made on disk."
+  :tags '(revert baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (save-buffer)
+   (let ((marker (progn (search-forward "2011/01/27 Book Store")
+                        (copy-marker (line-beginning-position))))
+         (appended "\n2012/01/02 Phone App\n  Expenses:Food  $ 4.00\n  Assets:Checking\n")
+         changed)
+     (write-region appended nil (buffer-file-name) t)
+     (let ((ledger-revert-functions
+            (list (lambda (beg end) (setq changed (cons beg end))))))
+       (ledger-revert-buffer nil t))
+     (should (equal (buffer-string) (concat demo-ledger appended)))
+     (should (equal changed (cons (1+ (length demo-ledger)) (point-max))))
+     (should (= marker (save-excursion
+                         (goto-char (point-min))
+                         (search-forward "2011/01/27 Book Store")
+                         (line-beginning-position))))
+     (should-not (buffer-modified-p)))))
+
+
+(ert-deftest ledger-revert/test-002 ()
+  "Baseline test for merging a change in the middle of the file."
+  :tags '(revert baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (save-buffer)
+   (let ((edited (replace-regexp-in-string "Book Store" "Bookshop" demo-ledger)))
+     (write-region edited nil (buffer-file-name))
+     (ledger-revert-buffer nil t)
+     (should (equal (buffer-string) edited))
+     (should-not (buffer-modified-p)))))
+
+
+(provide 'revert-test)
+
+;;; revert-test.el ends here
@@ -0,0 +1,95 @@
+;;; search-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-search
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-search-test-payees (query)
+  "Return the payees of the current journal matching QUERY."
+  (mapcar (lambda (match) (nth 3 match))
+          (ledger-search-journal (ledger-search-tokenize-query query)
+                                 (list (buffer-file-name)))))
+
+
+(ert-deftest ledger-search/test-001 ()
+  "Baseline test for searching notes, tags and prefixes."
+  :tags '(search baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (should (equal (ledger-search-test-payees "transfer") '("Bank" "Bank")))
+   (should (equal (length (ledger-search-test-payees "nobudget")) 3))
+   (should (equal (ledger-search-test-payees "transfer car") '("Bank")))
+   (should (equal (length (ledger-search-test-payees "car*")) 3))
+   (should (null (ledger-search-test-payees "transfer mortgage")))))
+
+
+(ert-deftest ledger-search/test-002 ()
+  "Baseline test for keeping the index up to date with edits."
+  :tags '(search baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (should (null (ledger-search-test-payees "warranty")))
+   (goto-char (point-min))
+   (search-forward "2011/01/27 Book Store")
+   (insert " ; warranty")
+   (should (equal (ledger-search-test-payees "warranty") '("Book Store")))
+   (ledger-navigate-beginning-of-xact)
+   (delete-region (point) (progn (ledger-navigate-end-of-xact) (point)))
+   (should (null (ledger-search-test-payees "warranty")))
+   (should (equal (ledger-search-test-payees "book*") '("Bookstore")))))
+
+
+
+(ert-deftest ledger-search/test-003 ()
+  "Regression test for indexing only the xacts touched by an edit."
+  :tags '(search regress)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-search-update)
+   (let ((index-xact (symbol-function 'ledger-search-index-xact))
+         (indexed 0))
+     (cl-letf (((symbol-function 'ledger-search-index-xact)
+                (lambda (marker)
+                  (setq indexed (1+ indexed))
+                  (funcall index-xact marker))))
+       (goto-char (point-min))
+       (search-forward "2011/01/27 Book Store")
+       (insert " ; warranty")
+       (goto-char (point-max))
+       (insert "\n2011/12/02 Cafe\n  Expenses:Food  $3.00\n  Assets:Cash\n")
+       (ledger-search-update))
+     (should (= indexed 2))
+     (should (equal (ledger-search-test-payees "warranty") '("Book Store"))))))
+
+
+(provide 'search-test)
+
+;;; search-test.el ends here
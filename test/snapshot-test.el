@@ -0,0 +1,102 @@
+;;; snapshot-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-snapshot
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-snapshot/test-001 ()
+  "Baseline test for comparing the accounts of two snapshots."
+  :tags '(snapshot baseline)
+
+  (let ((old '(("Assets" (100 "$"))
+               ("Expenses" (40 "$") (2 "EUR"))
+               ("Expenses:Food" (40 "$"))
+               ("Income" (-50 "$"))))
+        (new '(("Assets" (100 "$"))
+               ("Expenses" (40 "$") (3 "EUR"))
+               ("Expenses:Food" (40 "$"))
+               ("Liabilities" (-20 "$")))))
+    (should (equal (ledger-snapshot-diff old new)
+                   '(("Expenses" ((40 "$") (2 "EUR")) ((40 "$") (3 "EUR")) ((1 "EUR")))
+                     ("Income" ((-50 "$")) nil ((50 "$")))
+                     ("Liabilities" nil ((-20 "$")) ((-20 "$"))))))
+    (should (null (ledger-snapshot-diff old old)))
+    (should (null (ledger-snapshot-diff nil nil)))))
+
+
+(ert-deftest ledger-snapshot/test-002 ()
+  "Baseline test for saving and listing snapshots."
+  :tags '(snapshot baseline)
+
+  (let* ((ledger-snapshot-directory (make-temp-file "ledger-snapshot-" t))
+         (accounts (ledger-snapshot-accounts
+                    '((:account "Expenses:Food" :total ((40 "$")))
+                      (:account "Expenses" :total ((40 "$")))
+                      (:account "Assets Held" :total ((10 "$")))
+                      (:account "Assets" :total ((-50 "$"))))))
+         (hash (secure-hash 'sha1 demo-ledger)))
+    (unwind-protect
+        (progn
+          (should (equal (mapcar #'car accounts)
+                         '("Assets" "Assets Held" "Expenses" "Expenses:Food")))
+          (should-not (equal (ledger-snapshot-prefix "bal")
+                             (ledger-snapshot-prefix "bal.x")))
+          (ledger-snapshot-save (list "bal" 1000000000.0 hash "ledger bal" accounts))
+          (ledger-snapshot-save (list "bal" 1000086400.0 hash "ledger bal" nil))
+          (ledger-snapshot-save (list "bal 2" 1000000000.0 hash "ledger bal" nil))
+          (let ((files (ledger-snapshot-files "bal")))
+            (should (= (length files) 2))
+            (should (equal (ledger-snapshot-read (car files))
+                           (list "bal" 1000000000.0 hash "ledger bal" accounts)))
+            (should (null (nth 4 (ledger-snapshot-read (nth 1 files))))))
+          (should (= (length (ledger-snapshot-files "bal 2")) 1))
+          (let ((ledger-snapshot-keep 2))
+            (ledger-snapshot-save (list "bal" 1000172800.0 hash "ledger bal" nil))
+            (should (equal (mapcar (lambda (file) (nth 1 (ledger-snapshot-read file)))
+                                   (ledger-snapshot-files "bal"))
+                           '(1000086400.0 1000172800.0)))))
+      (delete-directory ledger-snapshot-directory t))))
+
+
+(ert-deftest ledger-snapshot/test-003 ()
+  "Baseline test for turning a report command into a snapshot query."
+  :tags '(snapshot baseline)
+
+  (let ((query (ledger-snapshot-query "ledger -f /tmp/main.ledger bal Expenses")))
+    (should (string-prefix-p "ledger -f /tmp/main.ledger balance --flat " query))
+    (should (string-suffix-p " Expenses" query))
+    (should (string-match-p (regexp-quote (shell-quote-argument
+                                           ledger-query-balance-format))
+                            query)))
+  (should (ledger-snapshot-query "ledger reg"))
+  (should-not (ledger-snapshot-query "ledger -f /tmp/main.ledger print Expenses")))
+
+
+(provide 'snapshot-test)
+
+;;; snapshot-test.el ends here
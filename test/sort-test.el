@@ -130,6 +130,117 @@ http://bugs.ledger-cli.org/show_bug.cgi?id=260"
     Assets:Bar
 "))))
 
+(ert-deftest ledger-sort/test-004 ()
+  "Baseline test for keeping the transactions sorted as dates are edited."
+  :tags '(sort baseline)
+
+  (ledger-tests-with-temp-file
+   "2016/01/01 A
+    Expenses:A  $1
+    Assets:Cash
+
+2016/01/05 B
+    Expenses:B  $2
+    Assets:Cash
+
+2016/01/10 C
+    Expenses:C  $3
+    Assets:Cash
+"
+   (ledger-sort-keep-mode 1)
+   (search-forward "2016/01/05")
+   (replace-match "2016/01/20")
+   ;; Nothing moves while point is in the xact.
+   (ledger-sort-keep)
+   (should (search-backward "2016/01/20 B" nil t))
+   (should (< (point) (save-excursion (search-forward "2016/01/10 C"))))
+   (goto-char (point-min))
+   (ledger-sort-keep)
+   (should (equal (buffer-string)
+                  "2016/01/01 A
+    Expenses:A  $1
+    Assets:Cash
+
+2016/01/10 C
+    Expenses:C  $3
+    Assets:Cash
+
+2016/01/20 B
+    Expenses:B  $2
+    Assets:Cash
+"))
+   (should (= (point) (point-min)))
+   (let ((before (progn (delete-char 10) (insert "2016/01/15") (buffer-string))))
+     (goto-char (point-max))
+     (undo-boundary)
+     (ledger-sort-keep)
+     (should (equal (buffer-string)
+                    "2016/01/10 C
+    Expenses:C  $3
+    Assets:Cash
+
+2016/01/15 A
+    Expenses:A  $1
+    Assets:Cash
+
+2016/01/20 B
+    Expenses:B  $2
+    Assets:Cash
+"))
+     (primitive-undo 1 buffer-undo-list)
+     (should (equal (buffer-string) before)))))
+
+
+(ert-deftest ledger-sort/test-005 ()
+  "Regression test for keeping sorted several xacts edited at once."
+  :tags '(sort regress)
+
+  (ledger-tests-with-temp-file
+   "; journal
+
+2016/01/01 A
+    Expenses:A  $1
+    Assets:Cash
+
+2016/01/05 B
+    Expenses:B  $2
+    Assets:Cash
+
+2016/01/10 C
+    Expenses:C  $3
+    Assets:Cash
+
+2016/02/01 D
+    Expenses:D  $4
+    Assets:Cash
+"
+   (ledger-sort-keep-mode 1)
+   (goto-char (point-min))
+   (while (search-forward "2016/01/0" nil t)
+     (replace-match "2016/03/0"))
+   (goto-char (point-min))
+   (ledger-sort-keep)
+   (should (null ledger-sort-edited))
+   (should (equal (buffer-string)
+                  "; journal
+
+2016/01/10 C
+    Expenses:C  $3
+    Assets:Cash
+
+2016/02/01 D
+    Expenses:D  $4
+    Assets:Cash
+
+2016/03/01 A
+    Expenses:A  $1
+    Assets:Cash
+
+2016/03/05 B
+    Expenses:B  $2
+    Assets:Cash
+"))))
+
 
 (provide 'sort-test)
 
@@ -0,0 +1,67 @@
+;;; stats-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-stats
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-stats/test-001 ()
+  "Baseline test for the statistics of a journal."
+  :tags '(stats baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-index-update)
+   (let* ((stats (ledger-stats-journal (list (current-buffer))))
+          (file (car (plist-get stats :files))))
+     (should (equal (plist-get file :file) (buffer-file-name)))
+     (should (= (plist-get file :xacts) (hash-table-count ledger-index-xacts)))
+     (should (equal (cdr (assq 2010 (plist-get file :years))) 3))
+     (should (numberp (plist-get file :build-time)))
+     (should (equal (aref (cdr (car (plist-get stats :largest))) 1) "Organic Co-op"))
+     (should (<= (length (plist-get stats :largest)) ledger-stats-largest)))))
+
+
+(ert-deftest ledger-stats/test-002 ()
+  "Baseline test for the statistics buffer."
+  :tags '(stats baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let ((journal (current-buffer)))
+     (ledger-stats-display (list (buffer-file-name)))
+     (with-current-buffer ledger-stats-buffer-name
+       (goto-char (point-min))
+       (should (search-forward "Largest transactions" nil t))
+       (should (search-forward "Organic Co-op" nil t))
+       (let ((source (get-text-property (point) 'ledger-source)))
+         (should (eq (marker-buffer (cdr source)) journal)))))))
+
+
+(provide 'stats-test)
+
+;;; stats-test.el ends here
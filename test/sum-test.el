@@ -0,0 +1,88 @@
+;;; sum-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-sum
+
+;;; Code:
+(require 'test-helper)
+
+
+(ert-deftest ledger-sum/test-001 ()
+  "Baseline test for the totals of the region."
+  :tags '(sum baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (transient-mark-mode 1)
+   (goto-char (point-min))
+   (search-forward "Acme Mortgage")
+   (forward-line 1)
+   (set-mark (point))
+   (forward-line 2)
+   (ledger-sum-mode 1)
+   (should (= ledger-sum-count 2))
+   (should (equal (mapcar #'cadr ledger-sum-totals) '("$")))
+   (should (= (car (car ledger-sum-totals)) 700))
+   (let ((check (lambda ()
+                  (ledger-sum-update)
+                  (let ((count ledger-sum-count)
+                        (totals (copy-tree ledger-sum-totals)))
+                    (setq ledger-sum-range nil)
+                    (ledger-sum-update)
+                    (should (= count ledger-sum-count))
+                    (should (equal (mapcar #'cadr totals)
+                                   (mapcar #'cadr ledger-sum-totals)))
+                    (should (= (car (car totals)) (car (car ledger-sum-totals))))))))
+     (forward-line 1)
+     (funcall check)
+     (should (= ledger-sum-count 3))
+     (should (= (car (car ledger-sum-totals)) 1000))
+     (search-backward "Organic Co-op")
+     (funcall check)
+     (forward-line 3)
+     (funcall check)
+     (should (= ledger-sum-count 5)))
+   (deactivate-mark)
+   (ledger-sum-update)
+   (should (equal (ledger-sum-lighter) ""))))
+
+
+
+(ert-deftest ledger-sum/test-002 ()
+  "Regression test for formatting summed amounts."
+  :tags '(sum regress)
+
+  (should (equal (ledger-format-amount 0.125 "BTC") "0.125 BTC"))
+  (should (equal (ledger-format-amount 20 "$") "$20.00"))
+  (should (equal (ledger-format-amount (- (+ 0.1 0.2) 0.3) "$") "$0.00"))
+  (should (equal (ledger-format-amount (- 0.3 (+ 0.1 0.2)) "$") "$0.00"))
+  (should (equal (ledger-format-amount (+ 0.1 0.2) "EUR") "0.30 EUR"))
+  (let ((ledger-environment-alist '(("decimal-comma"))))
+    (should (equal (ledger-format-amount -1.5 "EUR") "-1,50 EUR"))))
+
+
+(provide 'sum-test)
+
+;;; sum-test.el ends here
@@ -0,0 +1,140 @@
+;;; track-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-track
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-track-test-events (events)
+  "Return EVENTS as (OP KIND TEXT) lists, TEXT being the first line of the element."
+  (mapcar (lambda (event)
+            (let ((marker (plist-get event :marker)))
+              (list (plist-get event :op)
+                    (plist-get event :kind)
+                    (save-excursion
+                      (goto-char marker)
+                      (buffer-substring-no-properties
+                       (point) (line-end-position))))))
+          events))
+
+
+(ert-deftest ledger-track/test-001 ()
+  "Baseline test for the events of edits."
+  :tags '(track baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let (events)
+     (ledger-track-subscribe (lambda (batch)
+                               (setq events (ledger-track-test-events batch))))
+     (should (= (length (ledger-track-markers 'xact)) 13))
+     ;; Modify a posting
+     (search-forward "$20.00")
+     (replace-match "$25.00")
+     (ledger-track-flush)
+     (should (equal events '((modified xact "2011/01/27 Book Store"))))
+     ;; Add a transaction before another one
+     (setq events nil)
+     (ledger-navigate-beginning-of-xact)
+     (insert "2011/01/26 Cafe\n  Expenses:Food  $ 3.00\n  Assets:Checking\n\n")
+     (ledger-track-flush)
+     (should (equal events '((added xact "2011/01/26 Cafe"))))
+     ;; Add a directive and a comment
+     (setq events nil)
+     (goto-char (point-min))
+     (insert "; header\n\naccount Expenses:Food\n\n")
+     (ledger-track-flush)
+     (should (equal events '((added comment "; header")
+                             (added directive "account Expenses:Food"))))
+     (should (= (length (ledger-track-markers)) 16)))))
+
+
+(ert-deftest ledger-track/test-002 ()
+  "Baseline test for removing and joining elements."
+  :tags '(track baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let (events)
+     (ledger-track-subscribe (lambda (batch)
+                               (setq events (mapcar (lambda (event)
+                                                      (list (plist-get event :op)
+                                                            (plist-get event :kind)))
+                                                    batch))))
+     (ledger-track-markers)
+     ;; Delete a transaction
+     (search-forward "2011/01/27 Book Store")
+     (ledger-navigate-beginning-of-xact)
+     (delete-region (point) (progn (ledger-navigate-end-of-xact) (point)))
+     (ledger-track-flush)
+     (should (equal events '((removed xact))))
+     ;; Indenting a header joins the transaction to the previous one
+     (setq events nil)
+     (goto-char (point-min))
+     (search-forward "2010/12/20")
+     (beginning-of-line)
+     (delete-char -1)
+     (insert "  ")
+     (ledger-track-flush)
+     (should (equal events '((modified xact) (removed xact))))
+     (should (= (length (ledger-track-markers 'xact)) 11)))))
+
+
+
+(ert-deftest ledger-track/test-003 ()
+  "Regression test for comment blocks and many scattered edits."
+  :tags '(track regress)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (let ((ledger-track-max-ranges 4)
+         events)
+     (ledger-track-subscribe (lambda (batch)
+                               (setq events (ledger-track-test-events batch))))
+     (ledger-track-markers)
+     ;; A !comment block is one element, whatever it contains
+     (goto-char (point-min))
+     (insert "!comment\n2011/01/01 Hidden\n  Expenses:Food  $1.00\n!end_comment\n\n")
+     (ledger-track-flush)
+     (should (equal events '((added comment "!comment"))))
+     ;; Edits in more places than the cap within one command
+     (setq events nil)
+     (goto-char (point-min))
+     (let ((count 0))
+       (while (re-search-forward "^\\(20[0-9][0-9]\\)/" nil t)
+         (replace-match "2012" nil nil nil 1)
+         (setq count (1+ count)))
+       (should (> count ledger-track-max-ranges))
+       (should (<= (length ledger-track-dirty) ledger-track-max-ranges))
+       (ledger-track-flush)
+       (should (= (length events) count)))
+     (should (equal (ledger-track-snapshot) (ledger-track-scan))))))
+
+
+(provide 'track-test)
+
+;;; track-test.el ends here
@@ -0,0 +1,137 @@
+;;; tree-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-tree
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-tree-test-total (root account)
+  "Return the total string of ACCOUNT below ROOT."
+  (let ((node root))
+    (dolist (name (split-string account ":"))
+      (setq node (gethash name (aref node 1))))
+    (ledger-tree-total-string (aref node 2))))
+
+
+(ert-deftest ledger-tree/test-001 ()
+  "Baseline test for the totals of the account tree."
+  :tags '(tree baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (ledger-index-update)
+   (let ((root (ledger-tree-build (list (current-buffer)))))
+     (should (equal (ledger-tree-total-string (aref root 2)) "0"))
+     (should (equal (ledger-tree-test-total root "Expenses:Food:Groceries") "$334.00"))
+     (should (equal (ledger-tree-test-total root "Expenses:Books") "$40.00"))
+     (should (equal (ledger-tree-test-total root "Liabilities:MasterCard") "$-20.00"))
+     (should (equal (ledger-tree-test-total root "Equity") "$-1000.00")))
+   (should (equal (ledger-tree-cost "10 AAPL @ $50" 10 "AAPL") '(500 "$")))
+   (let ((cost (ledger-tree-cost "-10 AAPL {{$500}}" -10 "AAPL")))
+     (should (= (car cost) -500))
+     (should (equal (nth 1 cost) "$")))))
+
+
+(ert-deftest ledger-tree/test-002 ()
+  "Baseline test for updating and expanding the account tree."
+  :tags '(tree baseline)
+
+  (ledger-tests-with-temp-file
+   demo-ledger
+   (unwind-protect
+       (progn
+         (ledger-tree)
+         (goto-char (point-min))
+         (search-forward "Bookstore")
+         (search-forward "$20.00")
+         (replace-match "$25.00")
+         (ledger-index-update)
+         (should (equal (ledger-tree-test-total ledger-tree-root "Expenses:Books")
+                        "$45.00"))
+         (should (equal (ledger-tree-test-total ledger-tree-root "Assets:Checking")
+                        (ledger-tree-test-total
+                         (ledger-tree-build (list (current-buffer)))
+                         "Assets:Checking")))
+         (with-current-buffer ledger-tree-buffer-name
+           (goto-char (point-min))
+           (should (re-search-forward "^\\+ Expenses" nil t))
+           (should-not (search-forward "Books" nil t))
+           (ledger-tree-toggle)
+           (goto-char (point-min))
+           (should (re-search-forward "^  \\+ Books\\|^    Books" nil t))))
+     (kill-buffer ledger-tree-buffer-name))))
+
+
+
+(ert-deftest ledger-tree/test-003 ()
+  "Regression test for redrawing the lines of the changed accounts."
+  :tags '(tree regress)
+
+  (ledger-tests-with-temp-file
+   "2011/01/01 Shop
+  Expenses:Misc:Tools  $10.00
+  Assets:Cash
+"
+   (unwind-protect
+       (let (misc text)
+         (ledger-tree)
+         (setq misc (gethash "Misc" (aref (gethash "Expenses" (aref ledger-tree-root 1)) 1)))
+         (with-current-buffer ledger-tree-buffer-name
+           (goto-char (point-min))
+           (search-forward "Expenses")
+           (ledger-tree-toggle)
+           (search-forward "Misc")
+           (ledger-tree-toggle))
+         ;; The only xact below an expanded account changes
+         (goto-char (point-min))
+         (search-forward "$10.00")
+         (replace-match "$12.00")
+         (ledger-tree-after-save)
+         (should (eq misc (gethash "Misc" (aref (gethash "Expenses" (aref ledger-tree-root 1)) 1))))
+         (with-current-buffer ledger-tree-buffer-name
+           (setq text (buffer-string))
+           (should (string-match "^  - Misc" text))
+           (should (string-match "^      Tools +\\$12" text))
+           (ledger-tree-draw)
+           (should (equal text (buffer-string))))
+         ;; Its account changes
+         (goto-char (point-min))
+         (search-forward "Expenses:Misc:Tools")
+         (replace-match "Expenses:Other")
+         (ledger-tree-after-save)
+         (with-current-buffer ledger-tree-buffer-name
+           (setq text (buffer-string))
+           (should-not (string-match "Misc" text))
+           (should (string-match "^    Other +\\$12" text))
+           (ledger-tree-draw)
+           (should (equal text (buffer-string)))))
+     (kill-buffer ledger-tree-buffer-name))))
+
+
+(provide 'tree-test)
+
+;;; tree-test.el ends here
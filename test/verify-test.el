@@ -0,0 +1,102 @@
+;;; verify-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Soak tests of the incremental structures checked by ledger-verify
+
+;;; Code:
+(require 'test-helper)
+
+
+(defconst ledger-verify-test-snippets
+  '("\n" "\n\n" "  " ";" "; note :tag: " "x" "2017/06/01 "
+    "  Expenses:Food  $ 1.00\n" "2017/06/02 Cafe\n  Assets:Cash\n\n"
+    "account Assets:Cash\n" "comment\n" "end comment\n")
+  "Text inserted by the random edits.")
+
+
+(defun ledger-verify-test-journal (count)
+  "Return a random journal of COUNT transactions."
+  (let ((payees ["Grocery Store" "Book Store" "Employer" "Bank" "Cafe"])
+        (accounts ["Expenses:Food" "Expenses:Books" "Assets:Checking" "Income:Salary"])
+        (notes ["" "  ; weekly" "  ; :nobudget:" "  ; project: house"]))
+    (mapconcat (lambda (_i)
+                 (format "2017/%02d/%02d %s\n    %s  $ %d.00%s\n    %s\n"
+                         (1+ (random 12)) (1+ (random 28))
+                         (aref payees (random (length payees)))
+                         (aref accounts (random (length accounts)))
+                         (random 500)
+                         (aref notes (random (length notes)))
+                         (aref accounts (random (length accounts)))))
+               (number-sequence 1 count)
+               "\n")))
+
+
+(defun ledger-verify-test-edit ()
+  "Make a random edit in the current buffer."
+  (let ((pos (+ (point-min) (random (1+ (buffer-size))))))
+    (if (and (> (buffer-size) 0) (zerop (random 2)))
+        (delete-region pos (min (point-max) (+ pos 1 (random 30))))
+      (goto-char pos)
+      (insert (nth (random (length ledger-verify-test-snippets))
+                   ledger-verify-test-snippets)))))
+
+
+(ert-deftest ledger-verify/test-001 ()
+  "Soak test of the incremental structures under random edits."
+  :tags '(verify baseline)
+
+  (random "ledger-verify")
+  (with-temp-buffer
+    (ledger-mode)
+    (insert (ledger-verify-test-journal 200))
+    (ledger-search-update)
+    (ledger-navigate-line-position 1)
+    (ledger-complete-ranked-payees)
+    (ledger-complete-account-days)
+    (should (null (ledger-verify-buffer)))
+    ;; Flush after batches of edits, so that flushes see several dirty
+    ;; ranges, and now and then more edits than `ledger-track-max-ranges'.
+    (let ((batch 1)
+          (checked 0)
+          (most 0))
+      (dotimes (i 3000)
+        (ledger-verify-test-edit)
+        (when (zerop (setq batch (1- batch)))
+          (setq most (max most (length ledger-track-dirty)))
+          (ledger-track-flush)
+          (when (>= (- i checked) 100)
+            (setq checked i)
+            (should (null (ledger-verify-buffer))))
+          (setq batch (if (zerop (random 10))
+                          (+ ledger-track-max-ranges 1 (random 20))
+                        (1+ (random 20))))))
+      (should (> most 1)))
+    (ledger-track-flush)
+    (should (null (ledger-verify-buffer)))))
+
+
+(provide 'verify-test)
+
+;;; verify-test.el ends here
@@ -0,0 +1,216 @@
+;;; window-test.el --- ERT for ledger-mode  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2003-2017 John Wiegley <johnw AT gnu DOT org>
+
+;; Author: Thierry <thdox AT free DOT fr>
+;; Keywords: languages
+;; Homepage: https://github.com/ledger/ledger-mode
+
+;; This file is not part of GNU Emacs.
+
+;; This program is free software; you can redistribute it and/or modify it under
+;; the terms of the GNU General Public License as published by the Free Software
+;; Foundation; either version 2 of the License, or (at your option) any later
+;; version.
+;;
+;; This program is distributed in the hope that it will be useful, but WITHOUT
+;; ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+;; FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+;; details.
+;;
+;; You should have received a copy of the GNU General Public License along with
+;; this program; if not, write to the Free Software Foundation, Inc., 51
+;; Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+;;; Commentary:
+;;  Regression tests for ledger-window
+
+;;; Code:
+(require 'test-helper)
+
+
+(defun ledger-window-test-journal ()
+  "Return a journal with three xacts a month in 2010, in date order."
+  (mapconcat (lambda (n)
+               (format "2010/%02d/%02d Shop %d\n  Expenses:Misc  $1\n  Assets:Cash\n\n"
+                       (1+ (/ n 3)) (1+ (* 10 (% n 3))) n))
+             (number-sequence 0 35) ""))
+
+
+(defun ledger-window-test-contents (file)
+  "Return the bytes of FILE as a string."
+  (with-temp-buffer
+    (insert-file-contents-literally file)
+    (buffer-string)))
+
+
+(ert-deftest ledger-window/test-001 ()
+  "Baseline test for finding the start of the window by binary search."
+  :tags '(window baseline)
+
+  (let ((journal (ledger-window-test-journal))
+        (file (make-temp-file "ledger-window-"))
+        (ledger-window-chunk-size 64))
+    (unwind-protect
+        (progn
+          (with-temp-file file
+            (insert journal))
+          (dolist (month '(1 2 6 10 12))
+            (should (= (ledger-window-start-offset file (encode-time 0 0 0 1 month 2010))
+                       (string-match (format "^2010/%02d/01" month) journal))))
+          (should (= (ledger-window-start-offset file (encode-time 0 0 0 5 7 2010))
+                     (string-match "^2010/07/11" journal)))
+          (should (= (ledger-window-start-offset file (encode-time 0 0 0 1 1 2011))
+                     (length journal))))
+      (delete-file file))))
+
+
+(ert-deftest ledger-window/test-002 ()
+  "Baseline test for writing the changes of the window back into its journal."
+  :tags '(window baseline)
+
+  (let* ((journal (ledger-window-test-journal))
+         (file (make-temp-file "ledger-window-"))
+         (offset (string-match "^2010/10/01" journal))
+         (head (substring journal 0 offset))
+         (write (symbol-function 'ledger-window-write))
+         (rewrite (symbol-function 'ledger-window-rewrite))
+         (buffer (generate-new-buffer "*ledger-window-test*"))
+         writes
+         rewrites)
+    (unwind-protect
+        (cl-letf (((symbol-function 'ledger-window-cutoff)
+                   (lambda (_months) (encode-time 0 0 0 1 10 2010)))
+                  ((symbol-function 'ledger-window-write)
+                   (lambda (bytes name start)
+                     (push start writes)
+                     (funcall write bytes name start)))
+                  ((symbol-function 'ledger-window-rewrite)
+                   (lambda (bytes name start)
+                     (push start rewrites)
+                     (funcall rewrite bytes name start))))
+          (with-temp-file file
+            (insert journal))
+          (with-current-buffer buffer
+            (ledger-window-load file 3)
+            (should (= ledger-window-offset offset))
+            (should (equal (buffer-string) (substring journal offset)))
+            ;; A change of the same size is written in place from its position
+            (goto-char (point-max))
+            (search-backward "$1")
+            (let ((changed (point)))
+              (replace-match "$2")
+              ;; The lowest change is kept as a marker
+              (should (markerp ledger-window-changed))
+              (should (= ledger-window-changed changed))
+              (ledger-window-save)
+              (should (equal writes (list (+ offset (1- changed))))))
+            (should (null ledger-window-changed))
+            (should (equal (ledger-window-test-contents file) (concat head (buffer-string))))
+            ;; So is one making the window longer
+            (goto-char (point-min))
+            (search-forward "$1")
+            (insert "0")
+            (ledger-window-save)
+            (should (= (length writes) 2))
+            (should (equal (ledger-window-test-contents file) (concat head (buffer-string))))
+            ;; One making it shorter rewrites the file
+            (goto-char (point-min))
+            (search-forward "\n\n")
+            (delete-region (point-min) (point))
+            (ledger-window-save)
+            (should (= (length writes) 2))
+            (should (equal rewrites (list offset)))
+            (should (equal (ledger-window-test-contents file) (concat head (buffer-string))))
+            (should (= ledger-window-length (buffer-size)))))
+      (kill-buffer buffer)
+      (delete-file file))))
+
+
+(ert-deftest ledger-window/test-003 ()
+  "Regress test for saving the window through `save-buffer' and on kill."
+  :tags '(window regress)
+
+  (let* ((journal (ledger-window-test-journal))
+         (file (make-temp-file "ledger-window-"))
+         (offset (string-match "^2010/10/01" journal))
+         (head (substring journal 0 offset))
+         (buffer (generate-new-buffer "*ledger-window-test*")))
+    (unwind-protect
+        (cl-letf (((symbol-function 'ledger-window-cutoff)
+                   (lambda (_months) (encode-time 0 0 0 1 10 2010)))
+                  ((symbol-function 'y-or-n-p) (lambda (_prompt) t))
+                  ((symbol-function 'yes-or-no-p) (lambda (_prompt) nil)))
+          (with-temp-file file
+            (insert journal))
+          (with-current-buffer buffer
+            (ledger-window-load file 3)
+            ;; `save-some-buffers' and the exit prompt call `save-buffer' directly
+            (goto-char (point-max))
+            (search-backward "$1")
+            (replace-match "$2")
+            (save-buffer)
+            (should-not (buffer-modified-p))
+            (should (null buffer-file-name))
+            (should (equal (ledger-window-test-contents file) (concat head (buffer-string))))
+            ;; The window is never written to a file of its own
+            (should (eq (command-remapping 'write-file) 'ledger-window-write-file))
+            (should-error (ledger-window-write-file) :type 'user-error)
+            (search-backward "$1")
+            (replace-match "$3")
+            (should-not (ledger-window-kill-emacs-query))
+            (setq journal (concat head (buffer-string))))
+          ;; Killing the window offers to save its changes
+          (kill-buffer buffer)
+          (should (equal (ledger-window-test-contents file) journal)))
+      (when (buffer-live-p buffer)
+        (with-current-buffer buffer
+          (set-buffer-modified-p nil))
+        (kill-buffer buffer))
+      (delete-file file))))
+
+
+(ert-deftest ledger-window/test-004 ()
+  "Regress test for parsing the text before the window while Emacs stays idle."
+  :tags '(window regress)
+
+  (let* ((journal (ledger-window-test-journal))
+         (file (make-temp-file "ledger-window-"))
+         (step (symbol-function 'ledger-window-parse-step))
+         (buffer (generate-new-buffer "*ledger-window-test*"))
+         (ledger-window-chunk-size 64)
+         (ledger-window-parse-time-slice 0)
+         (steps 0))
+    (unwind-protect
+        (cl-letf (((symbol-function 'ledger-window-cutoff)
+                   (lambda (_months) (encode-time 0 0 0 1 10 2010)))
+                  ;; The idle timer fires once, then Emacs stays idle
+                  ((symbol-function 'current-idle-time) (lambda () '(0 1 0)))
+                  ((symbol-function 'ledger-window-parse-step)
+                   (lambda (buffer)
+                     (setq steps (1+ steps))
+                     (funcall step buffer))))
+          (with-temp-file file
+            (insert journal))
+          (with-current-buffer buffer
+            (ledger-window-load file 3)
+            (should ledger-window-parse-timer)
+            (ledger-window-parse-step buffer)
+            (with-timeout (10)
+              (while ledger-window-parse-timer
+                (sleep-for 0.01)))
+            (should (null ledger-window-parse-timer))
+            (should (null ledger-window-parse-resume-timer))
+            (should (> steps 1))
+            (should (>= ledger-window-parse-position ledger-window-offset))
+            (should (gethash "Shop 0" ledger-window-payees))
+            (should (gethash "Shop 26" ledger-window-payees))
+            (should-not (gethash "Shop 27" ledger-window-payees))
+            (should (gethash "Expenses:Misc" ledger-window-accounts))))
+      (kill-buffer buffer)
+      (delete-file file))))
+
+
+(provide 'window-test)
+
+;;; window-test.el ends here